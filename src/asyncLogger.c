@@ -0,0 +1,379 @@
+#include "asyncLogger.h"
+#include "chunk.h"
+
+#include <pthread.h> /* pthread_create, pthread_key_t, pthread_cond_t */
+#include <sys/uio.h> /* struct iovec */
+#include <time.h> /* clock_gettime */
+/* calloc, posix_memalign, free */
+/* snprintf */
+/* TRUE, FALSE */
+/* debug_t, level_t, DBG_MAX */
+
+/**
+ * Default number of messages per thread ring
+ */
+#define ASYNC_LOGGER_SLOTS 256
+
+/**
+ * Maximum number of messages written with a single writev()
+ */
+#define ASYNC_LOGGER_BATCH 64
+
+/**
+ * Time the writer sleeps if it was not woken up, in ms
+ */
+#define ASYNC_LOGGER_IDLE 100
+
+/**
+ * Size of a cache line, to keep producer and consumer indices apart
+ */
+#define ASYNC_LOGGER_CACHE_LINE 64
+
+typedef struct logEntry_t logEntry_t;
+typedef struct logRing_t logRing_t;
+
+/**
+ * A formatted log line in a ring
+ */
+struct logEntry_t {
+	uint32_t len;						/**!< length of line */
+	char line[ASYNC_LOGGER_LINE_LEN];	/**!< line, including newline */
+};
+
+/**
+ * Single producer, single consumer ring of a logging thread
+ */
+struct logRing_t {
+	logRing_t *next;	/**!< next ring in list of all rings */
+	uint32_t owned;		/**!< TRUE while a thread uses the ring */
+	uint64_t head __attribute__((aligned(ASYNC_LOGGER_CACHE_LINE)));
+						/**!< next entry to write, by producer */
+	uint64_t tail __attribute__((aligned(ASYNC_LOGGER_CACHE_LINE)));
+						/**!< next entry to read, by writer thread */
+	logEntry_t entries[];	/**!< ring entries */
+};
+
+struct asyncLogger_t {
+	logger_t logger;			/**!< implements logger_t, must be first */
+	int fd;						/**!< file descriptor to write to */
+	asyncLoggerPolicy_t policy;	/**!< behavior if a ring is full */
+	uint32_t slots;				/**!< entries per ring, a power of 2 */
+	level_t levels[DBG_MAX];	/**!< log level by group */
+	logRing_t *rings;			/**!< all rings, prepended atomically */
+	pthread_key_t ring;			/**!< ring of the current thread */
+	pthread_t writer;			/**!< writer thread */
+	pthread_mutex_t mutex;		/**!< mutex for the condvars */
+	pthread_cond_t wakeup;		/**!< wakes up the writer */
+	pthread_cond_t space;		/**!< signals blocked producers */
+	uint32_t sleeping;			/**!< TRUE while the writer is idle */
+	uint32_t waiting;			/**!< number of blocked producers */
+	bool stop;					/**!< writer shall terminate */
+	uint64_t dropped;			/**!< number of dropped messages */
+	uint64_t reported;			/**!< number of drops already reported */
+};
+
+/**
+ * Release the ring of a terminating thread, for reuse by another thread
+ */
+static void releaseRing(void *ring)
+{
+	__atomic_store_n(&((logRing_t*)ring)->owned, FALSE, __ATOMIC_RELEASE);
+}
+
+/**
+ * Get the ring of the current thread, claim or create one if necessary
+ */
+static logRing_t *getRing(asyncLogger_t *this)
+{
+	logRing_t *ring;
+	uint32_t unowned;
+
+	ring = pthread_getspecific(this->ring);
+	if (ring) {
+		return ring;
+	}
+	for (ring = __atomic_load_n(&this->rings, __ATOMIC_ACQUIRE); ring;
+		 ring = ring->next) {
+		unowned = FALSE;
+		if (__atomic_compare_exchange_n(&ring->owned, &unowned, TRUE, FALSE,
+									__ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+			break;
+		}
+	}
+	if (!ring) {
+		if (posix_memalign((void**)&ring, ASYNC_LOGGER_CACHE_LINE,
+					sizeof(*ring) + this->slots * sizeof(logEntry_t)) != 0) {
+			return NULL;
+		}
+		ring->owned = TRUE;
+		ring->head = ring->tail = 0;
+		ring->next = __atomic_load_n(&this->rings, __ATOMIC_RELAXED);
+		while (!__atomic_compare_exchange_n(&this->rings, &ring->next, ring,
+									FALSE, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+			/* ring->next got updated, retry */
+		}
+	}
+	pthread_setspecific(this->ring, ring);
+	return ring;
+}
+
+/**
+ * Get an absolute timeout in ms from now
+ */
+static struct timespec timeoutIn(int ms)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	ts.tv_sec += ms / 1000;
+	ts.tv_nsec += (ms % 1000) * 1000000;
+	if (ts.tv_nsec >= 1000000000) {
+		ts.tv_sec++;
+		ts.tv_nsec -= 1000000000;
+	}
+	return ts;
+}
+
+/**
+ * Implementation of logger_t.log
+ */
+static void logMessage(logger_t *logger, debug_t group, level_t level,
+					   int thread, ikeSa_t *ikeSa, const char *message)
+{
+	asyncLogger_t *this = (asyncLogger_t*)logger;
+	struct timespec timeout;
+	logEntry_t *entry;
+	logRing_t *ring;
+	uint64_t head;
+	int len;
+
+	ring = getRing(this);
+	if (!ring) {
+		__atomic_add_fetch(&this->dropped, 1, __ATOMIC_RELAXED);
+		return;
+	}
+	head = ring->head;
+	while (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= this->slots) {
+		if (this->policy == ASYNC_LOGGER_DROP) {
+			__atomic_add_fetch(&this->dropped, 1, __ATOMIC_RELAXED);
+			return;
+		}
+		pthread_mutex_lock(&this->mutex);
+		__atomic_add_fetch(&this->waiting, 1, __ATOMIC_RELAXED);
+		pthread_cond_signal(&this->wakeup);
+		timeout = timeoutIn(ASYNC_LOGGER_IDLE);
+		pthread_cond_timedwait(&this->space, &this->mutex, &timeout);
+		__atomic_sub_fetch(&this->waiting, 1, __ATOMIC_RELAXED);
+		pthread_mutex_unlock(&this->mutex);
+	}
+
+	entry = &ring->entries[head & (this->slots - 1)];
+	len = snprintf(entry->line, sizeof(entry->line), "%.2d[%.2d] %s\n",
+				   thread, group, message);
+	if (len < 0) {
+		return;
+	}
+	if (len >= sizeof(entry->line)) {
+		len = sizeof(entry->line) - 1;
+		entry->line[len - 1] = '\n';
+	}
+	entry->len = len;
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_SEQ_CST);
+
+	if (__atomic_load_n(&this->sleeping, __ATOMIC_SEQ_CST)) {
+		pthread_mutex_lock(&this->mutex);
+		pthread_cond_signal(&this->wakeup);
+		pthread_mutex_unlock(&this->mutex);
+	}
+}
+
+/**
+ * Implementation of logger_t.getLevel
+ */
+static level_t getLevel(logger_t *logger, debug_t group)
+{
+	asyncLogger_t *this = (asyncLogger_t*)logger;
+
+	return this->levels[group];
+}
+
+/**
+ * Write the pending messages of all rings, returns the number written
+ */
+static int drainRings(asyncLogger_t *this)
+{
+	struct iovec iov[ASYNC_LOGGER_BATCH];
+	logEntry_t *entry;
+	logRing_t *ring;
+	uint64_t head, tail;
+	int count, total = 0;
+
+	for (ring = __atomic_load_n(&this->rings, __ATOMIC_ACQUIRE); ring;
+		 ring = ring->next) {
+		tail = ring->tail;
+		head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+		while (tail != head) {
+			for (count = 0; count < ASYNC_LOGGER_BATCH && tail + count != head;
+				 count++) {
+				entry = &ring->entries[(tail + count) & (this->slots - 1)];
+				iov[count].iov_base = entry->line;
+				iov[count].iov_len = entry->len;
+			}
+			/* on write errors there is nobody to tell, just move on */
+			chunkWritev(this->fd, iov, count);
+			tail += count;
+			total += count;
+			__atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+		}
+	}
+	if (total && __atomic_load_n(&this->waiting, __ATOMIC_RELAXED)) {
+		pthread_mutex_lock(&this->mutex);
+		pthread_cond_broadcast(&this->space);
+		pthread_mutex_unlock(&this->mutex);
+	}
+	return total;
+}
+
+/**
+ * Check if any ring has pending messages
+ */
+static bool pending(asyncLogger_t *this)
+{
+	logRing_t *ring;
+
+	for (ring = __atomic_load_n(&this->rings, __ATOMIC_ACQUIRE); ring;
+		 ring = ring->next) {
+		if (__atomic_load_n(&ring->head, __ATOMIC_SEQ_CST) != ring->tail) {
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+/**
+ * Report messages dropped since the last report
+ */
+static void reportDropped(asyncLogger_t *this)
+{
+	struct iovec iov;
+	uint64_t dropped;
+	char buf[64];
+	int len;
+
+	dropped = __atomic_load_n(&this->dropped, __ATOMIC_RELAXED);
+	if (dropped != this->reported) {
+		len = snprintf(buf, sizeof(buf), "%llu log messages dropped\n",
+					   (unsigned long long)(dropped - this->reported));
+		iov.iov_base = buf;
+		iov.iov_len = len;
+		chunkWritev(this->fd, &iov, 1);
+		this->reported = dropped;
+	}
+}
+
+/**
+ * Writer thread, drains the rings until stopped
+ */
+static void *writerThread(void *data)
+{
+	asyncLogger_t *this = data;
+	struct timespec timeout;
+	bool stop;
+
+	while (TRUE) {
+		if (drainRings(this)) {
+			reportDropped(this);
+			continue;
+		}
+		reportDropped(this);
+
+		pthread_mutex_lock(&this->mutex);
+		__atomic_store_n(&this->sleeping, TRUE, __ATOMIC_SEQ_CST);
+		stop = this->stop;
+		if (!stop && !pending(this)) {
+			timeout = timeoutIn(ASYNC_LOGGER_IDLE);
+			pthread_cond_timedwait(&this->wakeup, &this->mutex, &timeout);
+		}
+		__atomic_store_n(&this->sleeping, FALSE, __ATOMIC_RELAXED);
+		pthread_mutex_unlock(&this->mutex);
+
+		if (stop && !pending(this)) {
+			break;
+		}
+	}
+	return NULL;
+}
+
+asyncLogger_t *asyncLoggerCreate(int fd, level_t level,
+								 asyncLoggerPolicy_t policy, uint32_t slots)
+{
+	asyncLogger_t *this = (asyncLogger_t *)calloc(1, sizeof(*this));
+
+	this->logger.log = logMessage;
+	this->logger.getLevel = getLevel;
+	this->fd = fd;
+	this->policy = policy;
+	this->slots = 1;
+	while (this->slots < (slots ?: ASYNC_LOGGER_SLOTS)) {
+		this->slots *= 2;
+	}
+	asyncLoggerSetLevel(this, DBG_MAX, level);
+
+	pthread_key_create(&this->ring, releaseRing);
+	pthread_mutex_init(&this->mutex, NULL);
+	pthread_cond_init(&this->wakeup, NULL);
+	pthread_cond_init(&this->space, NULL);
+
+	if (pthread_create(&this->writer, NULL, writerThread, this) != 0) {
+		pthread_key_delete(this->ring);
+		pthread_mutex_destroy(&this->mutex);
+		pthread_cond_destroy(&this->wakeup);
+		pthread_cond_destroy(&this->space);
+		free(this);
+		return NULL;
+	}
+	return this;
+}
+
+logger_t *asyncLoggerGetLogger(asyncLogger_t *this)
+{
+	return &this->logger;
+}
+
+void asyncLoggerSetLevel(asyncLogger_t *this, debug_t group, level_t level)
+{
+	if (group < DBG_MAX) {
+		this->levels[group] = level;
+		return;
+	}
+	for (group = 0; group < DBG_MAX; group++) {
+		this->levels[group] = level;
+	}
+}
+
+uint64_t asyncLoggerGetDropped(asyncLogger_t *this)
+{
+	return __atomic_load_n(&this->dropped, __ATOMIC_RELAXED);
+}
+
+void asyncLoggerDestroy(asyncLogger_t *this)
+{
+	logRing_t *ring, *next;
+
+	pthread_mutex_lock(&this->mutex);
+	this->stop = TRUE;
+	pthread_cond_signal(&this->wakeup);
+	pthread_mutex_unlock(&this->mutex);
+	pthread_join(this->writer, NULL);
+
+	/* exiting threads must not release rings after they are freed */
+	pthread_key_delete(this->ring);
+	for (ring = this->rings; ring; ring = next) {
+		next = ring->next;
+		free(ring);
+	}
+	pthread_mutex_destroy(&this->mutex);
+	pthread_cond_destroy(&this->wakeup);
+	pthread_cond_destroy(&this->space);
+	free(this);
+}
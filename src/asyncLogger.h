@@ -0,0 +1,93 @@
+#ifndef _CHELP_ASYNCLOGGER_H
+#define _CHELP_ASYNCLOGGER_H 1
+
+#include "logger.h" /* logger_t */
+
+/**
+ * Logger writing to a file descriptor from a dedicated thread.
+ *
+ * Logging threads only format the message into a per-thread lock-free ring
+ * buffer, a writer thread drains all rings and writes the messages in
+ * batches with writev(). A slow file or syslog pipe therefore never stalls
+ * the thread raising a log message. If a ring is full the message is either
+ * dropped and counted, or the logging thread waits for the writer, depending
+ * on the configured policy.
+ *
+ * @code
+ * asyncLogger_t *logger = asyncLoggerCreate(fd, 1, ASYNC_LOGGER_DROP, 0);
+ * busAddLogger(bus, asyncLoggerGetLogger(logger));
+ * ...
+ * busRemoveLogger(bus, asyncLoggerGetLogger(logger));
+ * asyncLoggerDestroy(logger);
+ * @endcode
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Maximum length of a single log line, longer messages get truncated.
+ */
+#define ASYNC_LOGGER_LINE_LEN 512
+
+typedef struct asyncLogger_t asyncLogger_t;
+typedef enum asyncLoggerPolicy_t asyncLoggerPolicy_t;
+
+/**
+ * Behavior if the ring buffer of a logging thread is full.
+ */
+enum asyncLoggerPolicy_t {
+	ASYNC_LOGGER_DROP,		/**!< drop the message, count it */
+	ASYNC_LOGGER_BLOCK,		/**!< wait until the writer made room */
+};
+
+/**
+ * Create an asynchronous logger and start its writer thread.
+ *
+ * @param fd		file descriptor to write to, not closed by the logger
+ * @param level		log level used for all groups
+ * @param policy	behavior if a ring buffer is full
+ * @param slots		number of messages per thread ring, 0 for a default
+ * @return			logger instance, NULL if thread creation failed
+ */
+asyncLogger_t *asyncLoggerCreate(int fd, level_t level,
+								 asyncLoggerPolicy_t policy, uint32_t slots);
+
+/**
+ * Get the logger_t interface to register with the bus.
+ *
+ * @return			logger interface
+ */
+logger_t *asyncLoggerGetLogger(asyncLogger_t *this);
+
+/**
+ * Set the log level of a debug group.
+ *
+ * Re-register the logger with the bus for the change to take effect.
+ *
+ * @param group		debug group, DBG_MAX for all groups
+ * @param level		max level to log
+ */
+void asyncLoggerSetLevel(asyncLogger_t *this, debug_t group, level_t level);
+
+/**
+ * Get the number of messages dropped because a ring buffer was full.
+ *
+ * @return			number of dropped messages
+ */
+uint64_t asyncLoggerGetDropped(asyncLogger_t *this);
+
+/**
+ * Destroy an asyncLogger_t, writing all pending messages.
+ *
+ * The logger must be unregistered from the bus before, and no thread may
+ * log to it while it is destroyed.
+ */
+void asyncLoggerDestroy(asyncLogger_t *this);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CHELP_ASYNCLOGGER_H */
@@ -0,0 +1,60 @@
+#include "binaryLogger.h"
+#include "command.h"
+
+#include <stdio.h> /* FILE, fopen, fclose */
+#include <errno.h> /* errno */
+/* strerror */
+/* TRUE, FALSE */
+
+/**
+ * Decode a binary log written by binaryLogger_t
+ */
+static int decodeLog()
+{
+	FILE *in = stdin;
+	char *arg, *file = NULL;
+	bool success;
+
+	while (TRUE) {
+		switch (commandGetOpt(&arg)) {
+			case 'h':
+				return commandUsage(NULL);
+			case 'f':
+				file = arg;
+				continue;
+			case EOF:
+				break;
+			default:
+				return commandUsage("invalid --decode-log option");
+		}
+		break;
+	}
+
+	if (file) {
+		in = fopen(file, "r");
+		if (!in) {
+			fprintf(stderr, "opening '%s' failed: %s\n", file, strerror(errno));
+			return 1;
+		}
+	}
+	success = binaryLogDecode(in, stdout);
+	if (file) {
+		fclose(in);
+	}
+	return success ? 0 : 1;
+}
+
+/**
+ * Register the command.
+ */
+static void __attribute__ ((constructor))reg()
+{
+	commandRegister((command_t) {
+		decodeLog, 'D', "decode-log", "decode a binary log to text",
+		{"[--file <path>]"},
+		{
+			{"help", 'h', 0, "show usage information"},
+			{"file", 'f', 1, "binary log to read, default: stdin"},
+		}
+	});
+}
@@ -0,0 +1,776 @@
+#include "binaryLogger.h"
+#include "chunk.h"
+#include "host.h"
+
+#include <stdarg.h> /* va_list, va_arg, va_copy, va_end */
+#include <pthread.h> /* pthread_mutex_t */
+#include <sys/uio.h> /* struct iovec */
+#include <time.h> /* clock_gettime, localtime_r, strftime */
+#include <errno.h> /* errno */
+/* malloc, calloc, realloc, free, strdup, strndup, strtol */
+/* memcpy, memmove, memcmp, strlen, strnlen, strchr, strerror */
+/* snprintf, vsnprintf, fread, fprintf */
+/* TRUE, FALSE, min, max, streq */
+/* debug_t, level_t, DBG_MAX */
+
+/**
+ * Magic and version at the start of a binary log
+ */
+#define BINARY_LOG_MAGIC "CLOG"
+#define BINARY_LOG_VERSION 1
+
+/**
+ * Maximum size of a single record
+ */
+#define BINARY_LOG_RECORD_SIZE 4096
+
+/**
+ * Size of the record header, kind and payload length
+ */
+#define RECORD_HEADER_LEN (1 + sizeof(uint32_t))
+
+/**
+ * Offset of the format ID in a message record
+ */
+#define RECORD_FORMAT_ID RECORD_HEADER_LEN
+
+/**
+ * Maximum length of a format string stored in a FORMAT record
+ */
+#define RECORD_FORMAT_MAX (BINARY_LOG_RECORD_SIZE - RECORD_HEADER_LEN - \
+						   sizeof(uint32_t))
+
+/**
+ * Kinds of records
+ */
+typedef enum {
+	RECORD_FORMAT = 1,		/**!< format string definition */
+	RECORD_MESSAGE = 2,		/**!< message with raw arguments */
+	RECORD_TEXT = 3,		/**!< message formatted at log time */
+} recordKind_t;
+
+/**
+ * Types of recorded arguments
+ */
+typedef enum {
+	ARG_INT = 1,		/**!< signed integer, int64_t */
+	ARG_UINT = 2,		/**!< unsigned integer, uint64_t */
+	ARG_DOUBLE = 3,		/**!< floating point, double */
+	ARG_STR = 4,		/**!< string, length prefixed */
+	ARG_PTR = 5,		/**!< pointer value, uint64_t */
+	ARG_CHUNK = 6,		/**!< chunk contents, length prefixed */
+	ARG_HOST = 7,		/**!< host sockaddr, length prefixed */
+} argType_t;
+
+typedef struct logSpec_t logSpec_t;
+typedef struct record_t record_t;
+typedef struct formatEntry_t formatEntry_t;
+
+/**
+ * A parsed conversion specification of a format string
+ */
+struct logSpec_t {
+	const char *start;	/**!< position of the '%' */
+	const char *end;	/**!< position after the conversion character */
+	char flags[8];		/**!< flag characters, 0-terminated */
+	bool widthArg;		/**!< width given as '*' argument */
+	bool precArg;		/**!< precision given as '*' argument */
+	int width;			/**!< field width, -1 if none */
+	int prec;			/**!< precision, -1 if none */
+	int rank;			/**!< length modifier, 0 for int, < 0 shorter */
+	char conv;			/**!< conversion character */
+};
+
+/**
+ * Record being built or parsed
+ */
+struct record_t {
+	uint8_t *buf;	/**!< record data */
+	size_t size;	/**!< size of buf */
+	size_t pos;		/**!< current position in buf */
+	bool failed;	/**!< overflow while writing, underflow while reading */
+};
+
+/**
+ * A known format string
+ */
+struct formatEntry_t {
+	const char *ptr;	/**!< pointer passed by the logging code */
+	char *copy;			/**!< copy of the format string */
+	uint32_t id;		/**!< ID of the format in the log */
+};
+
+struct binaryLogger_t {
+	logger_t logger;			/**!< implements logger_t, must be first */
+	int fd;						/**!< file descriptor to write to */
+	level_t levels[DBG_MAX];	/**!< log level by group */
+	pthread_mutex_t mutex;		/**!< serializes writes and format table */
+	formatEntry_t *formats;		/**!< hash table of formats, by pointer */
+	uint32_t mask;				/**!< size of formats - 1 */
+	uint32_t count;				/**!< number of known formats */
+};
+
+/**
+ * Parse the next conversion of a format string, returns FALSE if none
+ */
+static bool nextSpec(const char *pos, logSpec_t *spec)
+{
+	int flags = 0;
+
+	pos = strchr(pos, '%');
+	if (!pos) {
+		return FALSE;
+	}
+	*spec = (logSpec_t) {
+		.start = pos++,
+		.width = -1,
+		.prec = -1,
+	};
+	while (strchr("-+ #0'", *pos) && *pos && flags < sizeof(spec->flags) - 1) {
+		spec->flags[flags++] = *pos++;
+	}
+	if (*pos == '*') {
+		spec->widthArg = TRUE;
+		pos++;
+	} else if (*pos >= '0' && *pos <= '9') {
+		spec->width = strtol(pos, (char**)&pos, 10);
+	}
+	if (*pos == '.') {
+		pos++;
+		if (*pos == '*') {
+			spec->precArg = TRUE;
+			pos++;
+		} else {
+			spec->prec = strtol(pos, (char**)&pos, 10);
+		}
+	}
+	while (TRUE) {
+		switch (*pos) {
+			case 'h':
+				spec->rank--;
+				pos++;
+				continue;
+			case 'l':
+				spec->rank++;
+				pos++;
+				continue;
+			case 'L':
+			case 'q':
+			case 'j':
+				spec->rank = 2;
+				pos++;
+				continue;
+			case 'z':
+			case 't':
+				spec->rank = 1;
+				pos++;
+				continue;
+			default:
+				break;
+		}
+		break;
+	}
+	spec->conv = *pos;
+	spec->end = *pos ? pos + 1 : pos;
+	return TRUE;
+}
+
+/**
+ * Append data to a record
+ */
+static void put(record_t *rec, const void *data, size_t len)
+{
+	if (rec->failed || rec->size - rec->pos < len) {
+		rec->failed = TRUE;
+		return;
+	}
+	memcpy(rec->buf + rec->pos, data, len);
+	rec->pos += len;
+}
+
+/**
+ * Append an argument to a record
+ */
+static void putArg(record_t *rec, argType_t type, const void *data, size_t len)
+{
+	uint8_t tag = type;
+	uint32_t dataLen = len;
+
+	put(rec, &tag, sizeof(tag));
+	if (type == ARG_STR || type == ARG_CHUNK || type == ARG_HOST) {
+		put(rec, &dataLen, sizeof(dataLen));
+	}
+	put(rec, data, len);
+}
+
+/**
+ * Record all arguments of a format string, FALSE if not possible
+ */
+static bool encodeArgs(record_t *rec, const char *fmt, va_list args)
+{
+	logSpec_t spec;
+	int64_t ival;
+	uint64_t uval;
+	double dval;
+	const char *str;
+	chunk_t *chunk;
+	host_t *host;
+	int32_t num;
+	int prec;
+
+	for (; nextSpec(fmt, &spec); fmt = spec.end) {
+		if (spec.widthArg) {
+			ival = va_arg(args, int);
+			putArg(rec, ARG_INT, &ival, sizeof(ival));
+		}
+		prec = spec.prec;
+		if (spec.precArg) {
+			ival = va_arg(args, int);
+			putArg(rec, ARG_INT, &ival, sizeof(ival));
+			/* a negative precision is taken as if omitted */
+			prec = ival < 0 ? -1 : ival;
+		}
+		switch (spec.conv) {
+			case '%':
+				break;
+			case 'd':
+			case 'i':
+				if (spec.rank > 1) {
+					ival = va_arg(args, long long);
+				} else if (spec.rank == 1) {
+					ival = va_arg(args, long);
+				} else {
+					num = va_arg(args, int);
+					ival = spec.rank == -1 ? (short)num :
+						   spec.rank < -1 ? (signed char)num : num;
+				}
+				putArg(rec, ARG_INT, &ival, sizeof(ival));
+				break;
+			case 'u':
+			case 'o':
+			case 'x':
+			case 'X':
+				if (spec.rank > 1) {
+					uval = va_arg(args, unsigned long long);
+				} else if (spec.rank == 1) {
+					uval = va_arg(args, unsigned long);
+				} else {
+					uval = va_arg(args, unsigned int);
+					uval = spec.rank == -1 ? (unsigned short)uval :
+						   spec.rank < -1 ? (unsigned char)uval : uval;
+				}
+				putArg(rec, ARG_UINT, &uval, sizeof(uval));
+				break;
+			case 'c':
+				ival = va_arg(args, int);
+				putArg(rec, ARG_INT, &ival, sizeof(ival));
+				break;
+			case 'p':
+				uval = (uintptr_t)va_arg(args, void*);
+				putArg(rec, ARG_PTR, &uval, sizeof(uval));
+				break;
+			case 's':
+				str = va_arg(args, const char*) ?: "(null)";
+				/* with a precision, the string may not be 0-terminated */
+				putArg(rec, ARG_STR, str,
+					   prec >= 0 ? strnlen(str, prec) : strlen(str));
+				break;
+			case 'm':
+				str = strerror(errno);
+				putArg(rec, ARG_STR, str, strlen(str));
+				break;
+			case 'f':
+			case 'F':
+			case 'e':
+			case 'E':
+			case 'g':
+			case 'G':
+			case 'a':
+			case 'A':
+				dval = spec.rank > 1 ? va_arg(args, long double)
+									 : va_arg(args, double);
+				putArg(rec, ARG_DOUBLE, &dval, sizeof(dval));
+				break;
+			case 'B':
+				chunk = va_arg(args, chunk_t*);
+				putArg(rec, ARG_CHUNK, chunk->ptr, chunk->len);
+				break;
+			case 'H':
+				host = va_arg(args, host_t*);
+				if (host) {
+					putArg(rec, ARG_HOST, hostGetSockaddr(host),
+						   *hostGetSockaddrLen(host));
+				} else {
+					putArg(rec, ARG_HOST, NULL, 0);
+				}
+				break;
+			case 'n':
+			default:
+				/* unknown printf hook, we don't know its arguments */
+				return FALSE;
+		}
+		if (rec->failed) {
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/**
+ * Complete the header of a record
+ */
+static void finishRecord(record_t *rec, recordKind_t kind)
+{
+	uint32_t len = rec->pos - RECORD_HEADER_LEN;
+
+	rec->buf[0] = kind;
+	memcpy(rec->buf + 1, &len, sizeof(len));
+}
+
+/**
+ * Get the ID of a format, registering it if it is new. Returns TRUE if the
+ * format has to be written to the log.
+ */
+static bool lookupFormat(binaryLogger_t *this, const char *fmt, uint32_t *id)
+{
+	formatEntry_t *old;
+	uint32_t i, size;
+
+	for (i = ((uintptr_t)fmt >> 3) & this->mask; this->formats[i].ptr;
+		 i = (i + 1) & this->mask) {
+		if (this->formats[i].ptr == fmt) {
+			if (streq(this->formats[i].copy, fmt)) {
+				*id = this->formats[i].id;
+				return FALSE;
+			}
+			/* the pointer got reused for a different format */
+			free(this->formats[i].copy);
+			this->formats[i].copy = strdup(fmt);
+			this->formats[i].id = *id = ++this->count;
+			return TRUE;
+		}
+	}
+
+	if ((this->count + 1) * 2 > this->mask + 1) {
+		old = this->formats;
+		size = (this->mask + 1) * 2;
+		this->formats = calloc(size, sizeof(formatEntry_t));
+		this->mask = size - 1;
+		for (i = 0; i < size / 2; ++i) {
+			uint32_t j;
+
+			if (!old[i].ptr) {
+				continue;
+			}
+			for (j = ((uintptr_t)old[i].ptr >> 3) & this->mask;
+				 this->formats[j].ptr; j = (j + 1) & this->mask) {
+				/* probe */
+			}
+			this->formats[j] = old[i];
+		}
+		free(old);
+		for (i = ((uintptr_t)fmt >> 3) & this->mask; this->formats[i].ptr;
+			 i = (i + 1) & this->mask) {
+			/* probe */
+		}
+	}
+	this->formats[i] = (formatEntry_t) {
+		.ptr = fmt,
+		.copy = strdup(fmt),
+		.id = ++this->count,
+	};
+	*id = this->count;
+	return TRUE;
+}
+
+/**
+ * Implementation of logger_t.vlog
+ */
+static void vlogMessage(logger_t *logger, debug_t group, level_t level,
+						int thread, ikeSa_t *ikeSa, const char *fmt,
+						va_list args)
+{
+	binaryLogger_t *this = (binaryLogger_t*)logger;
+	uint8_t buf[BINARY_LOG_RECORD_SIZE], fmtBuf[BINARY_LOG_RECORD_SIZE];
+	record_t rec = { .buf = buf, .size = sizeof(buf) };
+	record_t fmtRec = { .buf = fmtBuf, .size = sizeof(fmtBuf) };
+	struct iovec iov[2];
+	struct timespec now;
+	uint32_t id = 0, nsec;
+	uint64_t sec;
+	recordKind_t kind = RECORD_MESSAGE;
+	va_list copy;
+	int32_t val;
+	int len, count = 0;
+
+	clock_gettime(CLOCK_REALTIME, &now);
+	sec = now.tv_sec;
+	nsec = now.tv_nsec;
+
+	rec.pos = RECORD_FORMAT_ID + sizeof(id);
+	put(&rec, &sec, sizeof(sec));
+	put(&rec, &nsec, sizeof(nsec));
+	val = group;
+	put(&rec, &val, sizeof(val));
+	val = level;
+	put(&rec, &val, sizeof(val));
+	val = thread;
+	put(&rec, &val, sizeof(val));
+
+	va_copy(copy, args);
+	/* a format not fitting into a FORMAT record never gets an ID */
+	if (strlen(fmt) > RECORD_FORMAT_MAX || !encodeArgs(&rec, fmt, copy)) {
+		/* format now, dropping the format ID field */
+		kind = RECORD_TEXT;
+		memmove(buf + RECORD_FORMAT_ID, buf + RECORD_FORMAT_ID + sizeof(id),
+				sizeof(sec) + sizeof(nsec) + 3 * sizeof(val));
+		rec.pos = RECORD_FORMAT_ID + sizeof(sec) + sizeof(nsec) +
+				  3 * sizeof(val);
+		rec.failed = FALSE;
+		len = vsnprintf((char*)buf + rec.pos, sizeof(buf) - rec.pos, fmt, args);
+		rec.pos += max(0, min(len, (int)(sizeof(buf) - rec.pos - 1)));
+	}
+	va_end(copy);
+
+	pthread_mutex_lock(&this->mutex);
+	if (kind == RECORD_MESSAGE) {
+		if (lookupFormat(this, fmt, &id)) {
+			fmtRec.pos = RECORD_HEADER_LEN;
+			put(&fmtRec, &id, sizeof(id));
+			put(&fmtRec, fmt, strlen(fmt));
+			finishRecord(&fmtRec, RECORD_FORMAT);
+			iov[count++] = (struct iovec) {
+				.iov_base = fmtBuf,
+				.iov_len = fmtRec.pos,
+			};
+		}
+		memcpy(buf + RECORD_FORMAT_ID, &id, sizeof(id));
+	}
+	finishRecord(&rec, kind);
+	iov[count++] = (struct iovec) {
+		.iov_base = buf,
+		.iov_len = rec.pos,
+	};
+	chunkWritev(this->fd, iov, count);
+	pthread_mutex_unlock(&this->mutex);
+}
+
+/**
+ * Implementation of logger_t.getLevel
+ */
+static level_t getLevel(logger_t *logger, debug_t group)
+{
+	binaryLogger_t *this = (binaryLogger_t*)logger;
+
+	return this->levels[group];
+}
+
+binaryLogger_t *binaryLoggerCreate(int fd, level_t level)
+{
+	binaryLogger_t *this;
+	struct iovec iov;
+	uint8_t header[8];
+	uint32_t version = BINARY_LOG_VERSION;
+
+	memcpy(header, BINARY_LOG_MAGIC, 4);
+	memcpy(header + 4, &version, sizeof(version));
+	iov.iov_base = header;
+	iov.iov_len = sizeof(header);
+	if (!chunkWritev(fd, &iov, 1)) {
+		return NULL;
+	}
+
+	this = (binaryLogger_t *)calloc(1, sizeof(*this));
+	this->logger.vlog = vlogMessage;
+	this->logger.getLevel = getLevel;
+	this->fd = fd;
+	this->mask = 63;
+	this->formats = calloc(this->mask + 1, sizeof(formatEntry_t));
+	pthread_mutex_init(&this->mutex, NULL);
+	binaryLoggerSetLevel(this, DBG_MAX, level);
+
+	return this;
+}
+
+logger_t *binaryLoggerGetLogger(binaryLogger_t *this)
+{
+	return &this->logger;
+}
+
+void binaryLoggerSetLevel(binaryLogger_t *this, debug_t group, level_t level)
+{
+	if (group < DBG_MAX) {
+		this->levels[group] = level;
+		return;
+	}
+	for (group = 0; group < DBG_MAX; group++) {
+		this->levels[group] = level;
+	}
+}
+
+void binaryLoggerDestroy(binaryLogger_t *this)
+{
+	uint32_t i;
+
+	for (i = 0; i <= this->mask; ++i) {
+		free(this->formats[i].copy);
+	}
+	free(this->formats);
+	pthread_mutex_destroy(&this->mutex);
+	free(this);
+}
+
+/**
+ * Read data from a record
+ */
+static void get(record_t *rec, void *data, size_t len)
+{
+	if (rec->failed || rec->size - rec->pos < len) {
+		rec->failed = TRUE;
+		memset(data, 0, len);
+		return;
+	}
+	memcpy(data, rec->buf + rec->pos, len);
+	rec->pos += len;
+}
+
+/**
+ * Read the next argument from a record, expecting a given type
+ */
+static chunk_t getArg(record_t *rec, argType_t type)
+{
+	uint8_t tag;
+	uint32_t len = sizeof(uint64_t);
+	chunk_t data;
+
+	get(rec, &tag, sizeof(tag));
+	if (tag == ARG_STR || tag == ARG_CHUNK || tag == ARG_HOST) {
+		get(rec, &len, sizeof(len));
+	}
+	if (tag != type || rec->size - rec->pos < len) {
+		rec->failed = TRUE;
+		return ChunkEmpty;
+	}
+	data = chunkCreate(rec->buf + rec->pos, len);
+	rec->pos += len;
+	return data;
+}
+
+/**
+ * Read the next integer argument
+ */
+static int64_t getInt(record_t *rec)
+{
+	chunk_t data = getArg(rec, ARG_INT);
+	int64_t val = 0;
+
+	if (data.len == sizeof(val)) {
+		memcpy(&val, data.ptr, sizeof(val));
+	}
+	return val;
+}
+
+/**
+ * Format the conversion of a single spec using the recorded arguments
+ */
+static void decodeSpec(record_t *rec, logSpec_t *spec, FILE *out)
+{
+	char fmt[64], *pos = fmt, *end = fmt + sizeof(fmt);
+	uint64_t uval;
+	double dval;
+	chunk_t data, copy;
+	host_t *host;
+	char *str;
+	int prec;
+
+	pos += snprintf(pos, end - pos, "%%%s", spec->flags);
+	if (spec->widthArg) {
+		pos += snprintf(pos, end - pos, "%d", (int)getInt(rec));
+	} else if (spec->width >= 0) {
+		pos += snprintf(pos, end - pos, "%d", spec->width);
+	}
+	prec = spec->precArg ? getInt(rec) : spec->prec;
+	if (prec >= 0) {
+		pos += snprintf(pos, end - pos, ".%d", prec);
+	}
+
+	switch (spec->conv) {
+		case '%':
+			fputc('%', out);
+			return;
+		case 'd':
+		case 'i':
+			snprintf(pos, end - pos, "ll%c", spec->conv);
+			fprintf(out, fmt, (long long)getInt(rec));
+			return;
+		case 'u':
+		case 'o':
+		case 'x':
+		case 'X':
+			data = getArg(rec, ARG_UINT);
+			uval = 0;
+			if (data.len == sizeof(uval)) {
+				memcpy(&uval, data.ptr, sizeof(uval));
+			}
+			snprintf(pos, end - pos, "ll%c", spec->conv);
+			fprintf(out, fmt, (unsigned long long)uval);
+			return;
+		case 'c':
+			snprintf(pos, end - pos, "c");
+			fprintf(out, fmt, (int)getInt(rec));
+			return;
+		case 'p':
+			data = getArg(rec, ARG_PTR);
+			uval = 0;
+			if (data.len == sizeof(uval)) {
+				memcpy(&uval, data.ptr, sizeof(uval));
+			}
+			snprintf(pos, end - pos, "p");
+			fprintf(out, fmt, (void*)(uintptr_t)uval);
+			return;
+		case 's':
+		case 'm':
+			data = getArg(rec, ARG_STR);
+			str = strndup((char*)data.ptr, data.len);
+			snprintf(pos, end - pos, "s");
+			fprintf(out, fmt, str);
+			free(str);
+			return;
+		case 'B':
+			data = getArg(rec, ARG_CHUNK);
+			copy = data;
+			snprintf(pos, end - pos, "B");
+			fprintf(out, fmt, &copy);
+			return;
+		case 'H':
+			data = getArg(rec, ARG_HOST);
+			host = NULL;
+			if (data.len) {
+				/* copy for alignment */
+				copy = chunkCreate(malloc(data.len), data.len);
+				memcpy(copy.ptr, data.ptr, data.len);
+				host = hostCreateFromSockaddr((sockaddr_t*)copy.ptr);
+				free(copy.ptr);
+			}
+			snprintf(pos, end - pos, "H");
+			fprintf(out, fmt, host);
+			if (host) {
+				hostDestroy(host);
+			}
+			return;
+		default:
+			data = getArg(rec, ARG_DOUBLE);
+			dval = 0;
+			if (data.len == sizeof(dval)) {
+				memcpy(&dval, data.ptr, sizeof(dval));
+			}
+			snprintf(pos, end - pos, "%c", spec->conv);
+			fprintf(out, fmt, dval);
+			return;
+	}
+}
+
+/**
+ * Print the common part of message and text records
+ */
+static void decodePrefix(record_t *rec, FILE *out)
+{
+	uint64_t sec;
+	uint32_t nsec;
+	int32_t group, level, thread;
+	struct tm tm;
+	time_t t;
+	char buf[32];
+
+	get(rec, &sec, sizeof(sec));
+	get(rec, &nsec, sizeof(nsec));
+	get(rec, &group, sizeof(group));
+	get(rec, &level, sizeof(level));
+	get(rec, &thread, sizeof(thread));
+
+	t = sec;
+	localtime_r(&t, &tm);
+	strftime(buf, sizeof(buf), "%b %e %T", &tm);
+	fprintf(out, "%s.%06u %.2d[%.2d] ", buf, nsec / 1000, thread, group);
+}
+
+bool binaryLogDecode(FILE *in, FILE *out)
+{
+	uint8_t header[RECORD_HEADER_LEN], *buf = NULL;
+	char **formats = NULL;
+	uint32_t count = 0, id, len, version;
+	const char *fmt;
+	logSpec_t spec;
+	record_t rec;
+	bool success = FALSE;
+
+	if (fread(header, 1, 4, in) != 4 || memcmp(header, BINARY_LOG_MAGIC, 4) ||
+		fread(&version, 1, sizeof(version), in) != sizeof(version) ||
+		version != BINARY_LOG_VERSION) {
+		fprintf(stderr, "not a binary log or unsupported version\n");
+		return FALSE;
+	}
+
+	buf = malloc(BINARY_LOG_RECORD_SIZE + 1);
+	while (TRUE) {
+		if (fread(header, 1, sizeof(header), in) != sizeof(header)) {
+			success = feof(in);
+			break;
+		}
+		memcpy(&len, header + 1, sizeof(len));
+		if (len > BINARY_LOG_RECORD_SIZE || fread(buf, 1, len, in) != len) {
+			fprintf(stderr, "truncated or invalid record\n");
+			break;
+		}
+		rec = (record_t) { .buf = buf, .size = len };
+
+		switch (header[0]) {
+			case RECORD_FORMAT:
+				get(&rec, &id, sizeof(id));
+				/* IDs are assigned sequentially */
+				if (rec.failed || id == 0 || id > count + 1) {
+					rec.failed = TRUE;
+					break;
+				}
+				if (id == count + 1) {
+					formats = realloc(formats, (count + 1) * sizeof(char*));
+					formats[count++] = NULL;
+				}
+				free(formats[id - 1]);
+				formats[id - 1] = strndup((char*)buf + rec.pos, len - rec.pos);
+				break;
+			case RECORD_MESSAGE:
+				get(&rec, &id, sizeof(id));
+				if (rec.failed || id == 0 || id > count || !formats[id - 1]) {
+					rec.failed = TRUE;
+					break;
+				}
+				decodePrefix(&rec, out);
+				for (fmt = formats[id - 1]; nextSpec(fmt, &spec); fmt = spec.end) {
+					fwrite(fmt, 1, spec.start - fmt, out);
+					decodeSpec(&rec, &spec, out);
+				}
+				fprintf(out, "%s\n", fmt);
+				break;
+			case RECORD_TEXT:
+				decodePrefix(&rec, out);
+				fwrite(buf + rec.pos, 1, len - min(len, rec.pos), out);
+				fputc('\n', out);
+				break;
+			default:
+				rec.failed = TRUE;
+				break;
+		}
+		if (rec.failed) {
+			fprintf(stderr, "invalid record of type %d\n", header[0]);
+			break;
+		}
+	}
+
+	while (count) {
+		free(formats[--count]);
+	}
+	free(formats);
+	free(buf);
+	return success;
+}
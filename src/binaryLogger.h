@@ -0,0 +1,78 @@
+#ifndef _CHELP_BINARYLOGGER_H
+#define _CHELP_BINARYLOGGER_H 1
+
+#include "logger.h" /* logger_t */
+
+#include <stdio.h> /* FILE */
+
+/**
+ * Logger recording messages in a compact binary format, formatted offline.
+ *
+ * Instead of running the (custom) printf machinery on the logging path, the
+ * logger records a reference to the format string and the raw arguments.
+ * Contents of chunks (%B) and addresses of hosts (%H) are copied, as they
+ * are not valid anymore when the log is read. Each format string is written
+ * to the log only once. binaryLogDecode() restores the text, e.g. using the
+ * "decode-log" command.
+ *
+ * Messages using a printf hook unknown to the logger are formatted
+ * immediately and stored as text.
+ *
+ * The log uses the byte order of the host, it is not meant to be decoded
+ * on a different architecture.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct binaryLogger_t binaryLogger_t;
+
+/**
+ * Create a binary logger.
+ *
+ * @param fd		file descriptor to write to, not closed by the logger
+ * @param level		log level used for all groups
+ * @return			logger instance, NULL if writing the header failed
+ */
+binaryLogger_t *binaryLoggerCreate(int fd, level_t level);
+
+/**
+ * Get the logger_t interface to register with the bus.
+ *
+ * @return			logger interface
+ */
+logger_t *binaryLoggerGetLogger(binaryLogger_t *this);
+
+/**
+ * Set the log level of a debug group.
+ *
+ * Re-register the logger with the bus for the change to take effect.
+ *
+ * @param group		debug group, DBG_MAX for all groups
+ * @param level		max level to log
+ */
+void binaryLoggerSetLevel(binaryLogger_t *this, debug_t group, level_t level);
+
+/**
+ * Destroy a binaryLogger_t.
+ */
+void binaryLoggerDestroy(binaryLogger_t *this);
+
+/**
+ * Decode a binary log to text.
+ *
+ * The printf hooks used by the logged messages (e.g. %B, %H) must be
+ * registered for the conversion.
+ *
+ * @param in		binary log to read
+ * @param out		stream to write the text log to
+ * @return			TRUE if the log was decoded completely
+ */
+bool binaryLogDecode(FILE *in, FILE *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CHELP_BINARYLOGGER_H */
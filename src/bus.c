@@ -0,0 +1,345 @@
+#include "bus.h"
+#include "epoch.h"
+#include "logger.h"
+
+#include <stdarg.h> /* va_list, va_start, va_copy, va_end */
+#include <pthread.h> /* pthread_mutex_t, pthread_key_t */
+/* malloc, free */
+/* vsnprintf */
+/* TRUE, FALSE */
+/* debug_t, level_t, DBG_MAX, LEVEL_SILENT */
+
+/**
+ * Buffer size for log messages passed to logger_t.log()
+ */
+#define BUS_LOG_BUFFER 2048
+
+typedef struct busListeners_t busListeners_t;
+typedef struct busLoggers_t busLoggers_t;
+typedef struct busLoggerEntry_t busLoggerEntry_t;
+
+/**
+ * Immutable snapshot of the registered listeners
+ */
+struct busListeners_t {
+	int count;					/**!< number of listeners */
+	listener_t *listeners[];	/**!< registered listeners */
+};
+
+/**
+ * A logger registered for a debug group
+ */
+struct busLoggerEntry_t {
+	logger_t *logger;	/**!< registered logger */
+	level_t level;		/**!< max level the logger wants for the group */
+};
+
+/**
+ * Immutable snapshot of the loggers registered for a debug group
+ */
+struct busLoggers_t {
+	int count;					/**!< number of loggers */
+	busLoggerEntry_t entries[];	/**!< registered loggers */
+};
+
+/**
+ * The listener and logger sets are immutable snapshots published through
+ * atomic pointers. Dispatching only enters an epoch read section and never
+ * takes a lock, registration builds a new snapshot, swaps it in and waits
+ * for readers of the old one before freeing it.
+ */
+struct bus_t {
+	epoch_t *epoch;					/**!< protects snapshots from reclamation */
+	pthread_mutex_t mutex;			/**!< serializes registration */
+	busListeners_t *listeners;		/**!< registered listeners */
+	busLoggers_t *loggers[DBG_MAX];	/**!< registered loggers, by group */
+	level_t maxLevel[DBG_MAX];		/**!< max level of any logger, by group */
+	pthread_key_t threadSa;		/**!< IKE_SA registered by each thread */
+};
+
+/**
+ * Numerical ID of the current thread, passed to loggers
+ */
+static __thread int threadId = 0;
+
+/**
+ * Last thread ID assigned
+ */
+static int lastThreadId = 0;
+
+/**
+ * Get the ID of the current thread
+ */
+static inline int currentThreadId()
+{
+	if (!threadId) {
+		threadId = __atomic_add_fetch(&lastThreadId, 1, __ATOMIC_RELAXED);
+	}
+	return threadId;
+}
+
+/**
+ * Publish a new snapshot, free the old one once no reader uses it anymore
+ */
+static void publish(bus_t *this, void **ptr, void *snapshot)
+{
+	void *old;
+
+	old = __atomic_exchange_n(ptr, snapshot, __ATOMIC_ACQ_REL);
+	epochSynchronize(this->epoch);
+	free(old);
+}
+
+bus_t *busCreate()
+{
+	bus_t *this = (bus_t *)calloc(1, sizeof(*this));
+	debug_t group;
+
+	this->epoch = epochCreate();
+	pthread_mutex_init(&this->mutex, NULL);
+	pthread_key_create(&this->threadSa, NULL);
+	this->listeners = calloc(1, sizeof(busListeners_t));
+	for (group = 0; group < DBG_MAX; group++) {
+		this->maxLevel[group] = LEVEL_SILENT;
+	}
+
+	return this;
+}
+
+void busAddListener(bus_t *this, listener_t *listener)
+{
+	busListeners_t *old, *new;
+
+	pthread_mutex_lock(&this->mutex);
+	old = this->listeners;
+	new = malloc(sizeof(*new) + (old->count + 1) * sizeof(listener_t*));
+	memcpy(new->listeners, old->listeners, old->count * sizeof(listener_t*));
+	new->listeners[old->count] = listener;
+	new->count = old->count + 1;
+	publish(this, (void**)&this->listeners, new);
+	pthread_mutex_unlock(&this->mutex);
+}
+
+void busRemoveListener(bus_t *this, listener_t *listener)
+{
+	busListeners_t *old, *new;
+	int i;
+
+	pthread_mutex_lock(&this->mutex);
+	old = this->listeners;
+	new = malloc(sizeof(*new) + old->count * sizeof(listener_t*));
+	new->count = 0;
+	for (i = 0; i < old->count; ++i) {
+		if (old->listeners[i] != listener) {
+			new->listeners[new->count++] = old->listeners[i];
+		}
+	}
+	publish(this, (void**)&this->listeners, new);
+	pthread_mutex_unlock(&this->mutex);
+}
+
+/**
+ * Replace the registration of a logger in all groups, or remove it
+ */
+static void updateLogger(bus_t *this, logger_t *logger, bool add)
+{
+	busLoggers_t *old[DBG_MAX], *new;
+	level_t level, maxLevel;
+	debug_t group;
+	int i;
+
+	pthread_mutex_lock(&this->mutex);
+	for (group = 0; group < DBG_MAX; group++) {
+		old[group] = this->loggers[group];
+		level = add ? logger->getLevel(logger, group) : LEVEL_SILENT;
+
+		new = malloc(sizeof(*new) + ((old[group] ? old[group]->count : 0) + 1) *
+					 sizeof(busLoggerEntry_t));
+		new->count = 0;
+		maxLevel = LEVEL_SILENT;
+		for (i = 0; old[group] && i < old[group]->count; ++i) {
+			if (old[group]->entries[i].logger != logger) {
+				new->entries[new->count++] = old[group]->entries[i];
+				maxLevel = max(maxLevel, old[group]->entries[i].level);
+			}
+		}
+		if (level > LEVEL_SILENT) {
+			new->entries[new->count++] = (busLoggerEntry_t) {
+				.logger = logger,
+				.level = level,
+			};
+			maxLevel = max(maxLevel, level);
+		}
+		__atomic_store_n(&this->loggers[group], new, __ATOMIC_RELEASE);
+		__atomic_store_n(&this->maxLevel[group], maxLevel, __ATOMIC_RELAXED);
+	}
+	/* a single grace period for all groups */
+	epochSynchronize(this->epoch);
+	for (group = 0; group < DBG_MAX; group++) {
+		free(old[group]);
+	}
+	pthread_mutex_unlock(&this->mutex);
+}
+
+void busAddLogger(bus_t *this, logger_t *logger)
+{
+	updateLogger(this, logger, TRUE);
+}
+
+void busRemoveLogger(bus_t *this, logger_t *logger)
+{
+	updateLogger(this, logger, FALSE);
+}
+
+void busSetSa(bus_t *this, ikeSa_t *ikeSa)
+{
+	pthread_setspecific(this->threadSa, ikeSa);
+}
+
+ikeSa_t* busGetSa(bus_t *this)
+{
+	return pthread_getspecific(this->threadSa);
+}
+
+level_t busGetLevel(bus_t *this, debug_t group)
+{
+	return __atomic_load_n(&this->maxLevel[group], __ATOMIC_RELAXED);
+}
+
+void busVlog(bus_t *this, debug_t group, level_t level,
+			 char* format, va_list args)
+{
+	char buf[BUS_LOG_BUFFER];
+	busLoggers_t *loggers;
+	busLoggerEntry_t *entry;
+	bool formatted = FALSE;
+	ikeSa_t *ikeSa;
+	va_list copy;
+	int i, thread;
+
+	if (level > __atomic_load_n(&this->maxLevel[group], __ATOMIC_RELAXED)) {
+		/* no logger is interested, skip the read section and formatting */
+		return;
+	}
+
+	epochEnter(this->epoch);
+	loggers = __atomic_load_n(&this->loggers[group], __ATOMIC_ACQUIRE);
+	if (loggers && loggers->count) {
+		thread = currentThreadId();
+		ikeSa = busGetSa(this);
+
+		for (i = 0; i < loggers->count; ++i) {
+			entry = &loggers->entries[i];
+			if (entry->level < level) {
+				continue;
+			}
+			if (entry->logger->log) {
+				if (!formatted) {
+					/* format only once for all loggers */
+					va_copy(copy, args);
+					vsnprintf(buf, sizeof(buf), format, copy);
+					va_end(copy);
+					formatted = TRUE;
+				}
+				entry->logger->log(entry->logger, group, level, thread,
+								   ikeSa, buf);
+			}
+			if (entry->logger->vlog) {
+				va_copy(copy, args);
+				entry->logger->vlog(entry->logger, group, level, thread,
+									ikeSa, format, copy);
+				va_end(copy);
+			}
+		}
+	}
+	epochExit(this->epoch);
+}
+
+void busLog(bus_t *this, debug_t group, level_t level, char* format, ...)
+{
+	va_list args;
+
+	if (level > __atomic_load_n(&this->maxLevel[group], __ATOMIC_RELAXED)) {
+		return;
+	}
+	va_start(args, format);
+	busVlog(this, group, level, format, args);
+	va_end(args);
+}
+
+/**
+ * Unregister listeners that returned FALSE, after leaving the read section
+ */
+static void removeListeners(bus_t *this, listener_t **remove, int count)
+{
+	int i;
+
+	for (i = 0; i < count; ++i) {
+		busRemoveListener(this, remove[i]);
+	}
+	free(remove);
+}
+
+void busAssignVips(bus_t *this, ikeSa_t *ikeSa, bool assign)
+{
+	busListeners_t *listeners;
+	listener_t *listener, **remove = NULL;
+	int i, count = 0;
+
+	epochEnter(this->epoch);
+	listeners = __atomic_load_n(&this->listeners, __ATOMIC_ACQUIRE);
+	for (i = 0; i < listeners->count; ++i) {
+		listener = listeners->listeners[i];
+		if (listener->assignVips &&
+			!listener->assignVips(listener, ikeSa, assign)) {
+			if (!remove) {
+				remove = malloc(listeners->count * sizeof(listener_t*));
+			}
+			remove[count++] = listener;
+		}
+	}
+	epochExit(this->epoch);
+
+	if (remove) {
+		removeListeners(this, remove, count);
+	}
+}
+
+void busHandleVips(bus_t *this, ikeSa_t *ikeSa, bool handle)
+{
+	busListeners_t *listeners;
+	listener_t *listener, **remove = NULL;
+	int i, count = 0;
+
+	epochEnter(this->epoch);
+	listeners = __atomic_load_n(&this->listeners, __ATOMIC_ACQUIRE);
+	for (i = 0; i < listeners->count; ++i) {
+		listener = listeners->listeners[i];
+		if (listener->handleVips &&
+			!listener->handleVips(listener, ikeSa, handle)) {
+			if (!remove) {
+				remove = malloc(listeners->count * sizeof(listener_t*));
+			}
+			remove[count++] = listener;
+		}
+	}
+	epochExit(this->epoch);
+
+	if (remove) {
+		removeListeners(this, remove, count);
+	}
+}
+
+void busDestroy(bus_t *this)
+{
+	debug_t group;
+
+	for (group = 0; group < DBG_MAX; group++) {
+		free(this->loggers[group]);
+	}
+	free(this->listeners);
+	pthread_key_delete(this->threadSa);
+	pthread_mutex_destroy(&this->mutex);
+	epochDestroy(this->epoch);
+	free(this);
+}
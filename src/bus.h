@@ -8,6 +8,14 @@
  * The bus receives events and sends them to all registered listeners.
  *
  * Loggers are handled separately.
+ *
+ * Dispatching events and log messages is lock-free: the registered
+ * listeners and loggers are kept in immutable snapshots, read within an
+ * epoch section (see epoch.h). Registering or unregistering builds a new
+ * snapshot and waits until no thread dispatches over the old one, so these
+ * calls are comparably expensive and must not be made from within a
+ * listener or logger callback. A listener may still unregister itself by
+ * returning FALSE from a hook.
  */
 
 #ifdef __cplusplus
@@ -91,12 +99,46 @@ void busSetSa(bus_t *this, ikeSa_t *ikeSa);
  */
 ikeSa_t* busGetSa(bus_t *this);
 
+/**
+ * Get the maximum log level any registered logger accepts for a group.
+ *
+ * The value is cached by the bus and updated whenever a logger is added or
+ * removed, so checking it costs a single load.
+ *
+ * @param group		debugging group
+ * @return			max level of all loggers, LEVEL_SILENT if none
+ */
+level_t busGetLevel(bus_t *this, debug_t group);
+
+/**
+ * Send a log message to the bus, if any logger accepts it.
+ *
+ * Unlike calling busLog() directly, the format arguments are not evaluated
+ * at all if no registered logger accepts the group and level.
+ *
+ * @param bus		bus to log to
+ * @param group		debugging group
+ * @param level		verbosity level of the signal
+ * @param fmt		printf() style format string
+ * @param ...		printf() style argument list
+ */
+#define BUS_LOG(bus, group, level, fmt, ...) do { \
+	bus_t *_bus = (bus); \
+	debug_t _group = (group); \
+	level_t _level = (level); \
+	if (_level <= busGetLevel(_bus, _group)) { \
+		busLog(_bus, _group, _level, (fmt), ##__VA_ARGS__); \
+	} \
+} while (0)
+
 /**
  * Send a log message to the bus.
  *
  * The format string specifies an additional informational or error
  * message with a printf() like variable argument list.
- * Use the DBG() macros.
+ * Use the DBG() macros or BUS_LOG().
+ *
+ * Messages no registered logger accepts are dropped before formatting.
  *
  * @param group		debugging group
  * @param level		verbosity level of the signal
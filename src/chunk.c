@@ -2,6 +2,16 @@
 
 /* memcpy, malloc, memcmp */
 #include <stdargs.h> /* va_list, va_arg, va_end */
+#include <endian.h> /* le64toh */
+#include <fcntl.h> /* open */
+#include <sys/mman.h> /* mmap, munmap, msync */
+#include <sys/stat.h> /* fstat */
+#include <sys/uio.h> /* writev */
+#include <errno.h> /* errno, EINTR */
+#include <time.h> /* time */
+#ifdef __SSE2__
+#include <emmintrin.h> /* __m128i, _mm_loadu_si128, _mm_unpacklo_epi8 */
+#endif /* __SSE2__ */
 /* TRUE */
 /* min */
 
@@ -162,15 +172,413 @@ int32_t chunkCompare(chunk_t a, chunk_t b)
 	return memcmp(a.ptr, b.ptr, len);
 }
 
+typedef struct mappedChunk_t mappedChunk_t;
+
+/**
+ * Chunk returned by chunkMap(), with the state to unmap it
+ */
+struct mappedChunk_t {
+	chunk_t public;		/**!< mapped chunk, may be altered by the user */
+	int fd;				/**!< file descriptor of mapped file */
+	void *map;			/**!< start of mapping, NULL for empty files */
+	size_t len;			/**!< length of mapping */
+	bool wr;			/**!< TRUE if mapped writeable */
+};
+
+chunk_t *chunkMap(char *path, bool wr)
+{
+	mappedChunk_t *chunk;
+	struct stat sb;
+	int err;
+
+	chunk = malloc(sizeof(*chunk));
+	chunk->wr = wr;
+	chunk->fd = open(path, wr ? O_RDWR : O_RDONLY);
+	if (chunk->fd == -1) {
+		free(chunk);
+		return NULL;
+	}
+	if (fstat(chunk->fd, &sb) == -1) {
+		err = errno;
+		close(chunk->fd);
+		free(chunk);
+		errno = err;
+		return NULL;
+	}
+	chunk->map = NULL;
+	chunk->len = sb.st_size;
+	/* mmap() fails for empty files */
+	if (chunk->len) {
+		chunk->map = mmap(NULL, chunk->len, PROT_READ | PROT_WRITE,
+						  wr ? MAP_SHARED : MAP_PRIVATE, chunk->fd, 0);
+		if (chunk->map == MAP_FAILED) {
+			err = errno;
+			close(chunk->fd);
+			free(chunk);
+			errno = err;
+			return NULL;
+		}
+	}
+	chunk->public = chunkCreate(chunk->map, chunk->len);
+	return &chunk->public;
+}
+
+bool chunkUnmap(chunk_t *public)
+{
+	mappedChunk_t *chunk = (mappedChunk_t*)public;
+	bool success = TRUE;
+	int err = 0;
+
+	if (chunk->map) {
+		if (chunk->wr && msync(chunk->map, chunk->len, MS_SYNC) == -1) {
+			success = FALSE;
+			err = errno;
+		}
+		if (munmap(chunk->map, chunk->len) == -1 && success) {
+			success = FALSE;
+			err = errno;
+		}
+	}
+	close(chunk->fd);
+	free(chunk);
+	if (!success) {
+		errno = err;
+	}
+	return success;
+}
+
+bool chunkWritev(int fd, struct iovec *iov, int count)
+{
+	ssize_t len;
+
+	while (count) {
+		len = writev(fd, iov, count);
+		if (len < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return FALSE;
+		}
+		while (count && len >= iov->iov_len) {
+			len -= iov->iov_len;
+			iov++;
+			count--;
+		}
+		if (count) {
+			iov->iov_base = (uint8_t*)iov->iov_base + len;
+			iov->iov_len -= len;
+		}
+	}
+	return TRUE;
+}
+
+/**
+ * Key used by chunkHashStatic(), never changes
+ */
+static const uint8_t staticKey[16] = {
+	0x2c, 0x86, 0x4e, 0x61, 0x0f, 0x95, 0x3a, 0xd1,
+	0x7b, 0x14, 0xe8, 0x52, 0xc3, 0x09, 0xa6, 0x3f,
+};
+
+/**
+ * Key used by chunkHash(), initialized by chunkHashSeed()
+ */
+static uint8_t seedKey[16];
+
+/**
+ * TRUE once seedKey has been initialized
+ */
+static bool seeded = FALSE;
+
+void chunkHashSeed()
+{
+	ssize_t len;
+	size_t done = 0;
+	int fd;
+
+	if (seeded) {
+		return;
+	}
+	fd = open("/dev/urandom", O_RDONLY);
+	if (fd >= 0) {
+		while (done < sizeof(seedKey)) {
+			len = read(fd, seedKey + done, sizeof(seedKey) - done);
+			if (len <= 0) {
+				break;
+			}
+			done += len;
+		}
+		close(fd);
+	}
+	if (done < sizeof(seedKey)) {
+		/* not really random, but hash flooding is not a concern then */
+		srandom(time(NULL) + getpid());
+		for (done = 0; done < sizeof(seedKey); ++done) {
+			seedKey[done] = (uint8_t)random();
+		}
+	}
+	seeded = TRUE;
+}
+
+#define SIP_ROTL(x, b) (uint64_t)(((x) << (b)) | ((x) >> (64 - (b))))
+
+/**
+ * A single SipRound
+ */
+static inline void sipRound(chunkHash_t *this)
+{
+	this->v0 += this->v1;
+	this->v1 = SIP_ROTL(this->v1, 13);
+	this->v1 ^= this->v0;
+	this->v0 = SIP_ROTL(this->v0, 32);
+
+	this->v2 += this->v3;
+	this->v3 = SIP_ROTL(this->v3, 16);
+	this->v3 ^= this->v2;
+
+	this->v0 += this->v3;
+	this->v3 = SIP_ROTL(this->v3, 21);
+	this->v3 ^= this->v0;
+
+	this->v2 += this->v1;
+	this->v1 = SIP_ROTL(this->v1, 17);
+	this->v1 ^= this->v2;
+	this->v2 = SIP_ROTL(this->v2, 32);
+}
+
+/**
+ * Compress a single 64-bit message word (SipHash-2-4, two rounds)
+ */
+static inline void sipCompress(chunkHash_t *this, uint64_t m)
+{
+	this->v3 ^= m;
+	sipRound(this);
+	sipRound(this);
+	this->v0 ^= m;
+}
+
+/**
+ * Load a 64-bit little-endian word from an unaligned address
+ */
+static inline uint64_t sipLoad(const uint8_t *ptr)
+{
+	uint64_t m;
+
+	memcpy(&m, ptr, sizeof(m));
+	return le64toh(m);
+}
+
+void chunkHashInit(chunkHash_t *this, const uint8_t *key)
+{
+	uint64_t k0, k1;
+
+	if (!key) {
+		key = staticKey;
+	}
+	k0 = sipLoad(key);
+	k1 = sipLoad(key + 8);
+
+	*this = (chunkHash_t) {
+		.v0 = k0 ^ 0x736f6d6570736575ULL,
+		.v1 = k1 ^ 0x646f72616e646f6dULL,
+		.v2 = k0 ^ 0x6c7967656e657261ULL,
+		.v3 = k1 ^ 0x7465646279746573ULL,
+	};
+}
+
+void chunkHashUpdate(chunkHash_t *this, chunk_t chunk)
+{
+	const uint8_t *pos = chunk.ptr, *end = chunk.ptr + chunk.len;
+	size_t used = this->len % 8;
+
+	this->len += chunk.len;
+
+	/* complete a word left over from a previous update */
+	if (used) {
+		while (used < 8 && pos < end) {
+			this->tail |= (uint64_t)*pos++ << (8 * used++);
+		}
+		if (used < 8) {
+			return;
+		}
+		sipCompress(this, this->tail);
+		this->tail = 0;
+	}
+
+	/* bulk of the data, a full word per iteration */
+	while (end - pos >= 8) {
+		sipCompress(this, sipLoad(pos));
+		pos += 8;
+	}
+
+	for (used = 0; pos < end; ++used) {
+		this->tail |= (uint64_t)*pos++ << (8 * used);
+	}
+}
+
+uint32_t chunkHashFinal(chunkHash_t *this)
+{
+	uint64_t b = ((uint64_t)this->len << 56) | this->tail;
+
+	sipCompress(this, b);
+	this->v2 ^= 0xff;
+	sipRound(this);
+	sipRound(this);
+	sipRound(this);
+	sipRound(this);
+
+	return (uint32_t)(this->v0 ^ this->v1 ^ this->v2 ^ this->v3);
+}
+
+uint32_t chunkHashInc(chunk_t chunk, uint32_t hash)
+{
+	chunkHash_t state;
+
+	chunkHashInit(&state, seedKey);
+	chunkHashUpdate(&state, chunkCreate((uint8_t*)&hash, sizeof(hash)));
+	chunkHashUpdate(&state, chunk);
+	return chunkHashFinal(&state);
+}
+
+uint32_t chunkHash(chunk_t chunk)
+{
+	chunkHash_t state;
+
+	chunkHashInit(&state, seedKey);
+	chunkHashUpdate(&state, chunk);
+	return chunkHashFinal(&state);
+}
+
+uint32_t chunkHashStatic(chunk_t chunk)
+{
+	chunkHash_t state;
+
+	chunkHashInit(&state, NULL);
+	chunkHashUpdate(&state, chunk);
+	return chunkHashFinal(&state);
+}
+
 #ifdef HAVE_PRINTF_HOOK_H
 
+/**
+ * Lower case hex digits
+ */
+static const char hexDigits[] = "0123456789abcdef";
+
+#ifdef __SSE2__
+
+/**
+ * Convert nibbles 0-15 to lower case hex digits
+ */
+static inline __m128i hexDigits16(__m128i nibbles)
+{
+	__m128i letters;
+
+	letters = _mm_cmpgt_epi8(nibbles, _mm_set1_epi8(9));
+	return _mm_add_epi8(_mm_add_epi8(nibbles, _mm_set1_epi8('0')),
+						_mm_and_si128(letters, _mm_set1_epi8('a' - '0' - 10)));
+}
+
+/**
+ * Encode 16 bytes to 32 hex digits
+ */
+static inline void hexEncode16(char *out, const uint8_t *in)
+{
+	__m128i v, hi, lo;
+
+	v = _mm_loadu_si128((const __m128i*)in);
+	hi = hexDigits16(_mm_and_si128(_mm_srli_epi16(v, 4), _mm_set1_epi8(0x0f)));
+	lo = hexDigits16(_mm_and_si128(v, _mm_set1_epi8(0x0f)));
+	_mm_storeu_si128((__m128i*)out, _mm_unpacklo_epi8(hi, lo));
+	_mm_storeu_si128((__m128i*)(out + 16), _mm_unpackhi_epi8(hi, lo));
+}
+
+#else /* __SSE2__ */
+
+/**
+ * Encode 16 bytes to 32 hex digits
+ */
+static inline void hexEncode16(char *out, const uint8_t *in)
+{
+	int i;
+
+	for (i = 0; i < 16; i++) {
+		*out++ = hexDigits[in[i] >> 4];
+		*out++ = hexDigits[in[i] & 0x0f];
+	}
+}
+
+#endif /* __SSE2__ */
+
+/**
+ * Encode bytes to hex, optionally separated by colons.
+ *
+ * Only what fits into out is written, the output is not 0-terminated.
+ *
+ * @param out		output buffer
+ * @param size		size of output buffer
+ * @param in		bytes to encode
+ * @param len		number of bytes to encode
+ * @param colons	TRUE to separate bytes by ':'
+ * @return			length of the complete encoding
+ */
+static size_t hexEncode(char *out, size_t size, const uint8_t *in, size_t len,
+						bool colons)
+{
+	char digits[32], tail[3];
+	size_t i = 0, o = 0, fit, total;
+	int j, tailLen = 0;
+
+	if (!len) {
+		return 0;
+	}
+	if (colons) {
+		total = len * 3 - 1;
+		/* the digits of byte i end at 3 * i + 2 */
+		fit = size >= 2 ? min(len, (size - 2) / 3 + 1) : 0;
+		for (; i + 16 <= fit; i += 16) {
+			hexEncode16(digits, in + i);
+			for (j = 0; j < 16; j++) {
+				if (o) {
+					out[o++] = ':';
+				}
+				memcpy(out + o, digits + j * 2, 2);
+				o += 2;
+			}
+		}
+	} else {
+		total = len * 2;
+		fit = min(len, size / 2);
+		for (; i + 16 <= fit; i += 16) {
+			hexEncode16(out + o, in + i);
+			o += 32;
+		}
+	}
+	for (; i < fit; i++) {
+		if (colons && o) {
+			out[o++] = ':';
+		}
+		out[o++] = hexDigits[in[i] >> 4];
+		out[o++] = hexDigits[in[i] & 0x0f];
+	}
+	if (i < len && o < size) {
+		/* truncated within the next byte */
+		if (colons && o) {
+			tail[tailLen++] = ':';
+		}
+		tail[tailLen++] = hexDigits[in[i] >> 4];
+		tail[tailLen++] = hexDigits[in[i] & 0x0f];
+		memcpy(out + o, tail, min(size - o, tailLen));
+	}
+	return total;
+}
+
 int32_t chunkPrintfHook(printfHookData_t *data, printfHookSpec_t *spec,
 					  const void *const *args)
 {
 	chunk_t *chunk = *((chunk_t**)(args[0]));
-	bool first = TRUE;
-	chunk_t copy = *chunk;
-	int32_t written = 0;
+	size_t size, written;
+	char *out;
 
 	if (!spec->hash && !spec->plus) {
 		uint32_t chunkLen = chunk->len;
@@ -178,18 +586,10 @@ int32_t chunkPrintfHook(printfHookData_t *data, printfHookSpec_t *spec,
 		return mem_printf_hook(data, spec, newArgs);
 	}
 
-	while (copy.len > 0) {
-		if (first) {
-			first = FALSE;
-		} else if (!spec->plus) {
-			written += printInHook(data, ":");
-		}
-		written += printInHook(data, "%02x", *copy.ptr++);
-		copy.len--;
-	}
+	out = printInHookBuffer(data, &size);
+	written = hexEncode(out, size, chunk->ptr, chunk->len, !spec->plus);
+	printInHookAdvance(data, written);
 	return written;
 }
 
 #endif /* #ifdef HAVE_PRINTF_HOOK_H */
-
-
@@ -7,6 +7,7 @@
 #ifdef HAVE_PRINTF_HOOK_H
 #include "printfHook.h" /* printfHookData_t, printfHookSpec_t */
 #endif /* HAVE_PRINTF_HOOK_H */
+#include <sys/uio.h> /* struct iovec */
 
 #ifdef __cplusplus
 extern "C" {
@@ -158,6 +159,89 @@ chunk_t *chunkMap(char *path, bool wr);
  */
 bool chunkUnmap(chunk_t *chunk);
 
+/**
+ * writev() all of the given buffers, handling partial writes
+ *
+ * The iovec array is modified to track progress. On error, errno is set
+ * appropriately.
+ *
+ * @param fd			file descriptor to write to
+ * @param iov			buffers to write
+ * @param count			number of buffers
+ * @return				TRUE if all buffers written
+ */
+bool chunkWritev(int fd, struct iovec *iov, int count);
+
+typedef struct chunkHash_t chunkHash_t;
+
+/**
+ * State of an incremental chunk hash (SipHash-2-4).
+ *
+ * Feeding data through chunkHashUpdate() in any number of pieces results in
+ * the same value as hashing the concatenated data at once.
+ */
+struct chunkHash_t {
+	uint64_t v0;		/**!< SipHash internal state */
+	uint64_t v1;		/**!< SipHash internal state */
+	uint64_t v2;		/**!< SipHash internal state */
+	uint64_t v3;		/**!< SipHash internal state */
+	uint64_t tail;		/**!< buffered bytes not forming a full word yet */
+	size_t len;			/**!< total number of bytes hashed */
+};
+
+/**
+ * Initialize the key used by chunkHash(), must be called once at startup.
+ *
+ * The key is randomly generated, hash values of chunkHash() therefore differ
+ * between processes.
+ */
+void chunkHashSeed();
+
+/**
+ * Start an incremental hash.
+ *
+ * @param key			16 byte key, NULL to use the same key as chunkHashStatic()
+ */
+void chunkHashInit(chunkHash_t *this, const uint8_t *key);
+
+/**
+ * Feed data to an incremental hash.
+ *
+ * @param chunk			data to hash, may be of arbitrary length
+ */
+void chunkHashUpdate(chunkHash_t *this, chunk_t chunk);
+
+/**
+ * Complete an incremental hash.
+ *
+ * The state must be initialized again with chunkHashInit() before reuse.
+ *
+ * @return				hash value
+ */
+uint32_t chunkHashFinal(chunkHash_t *this);
+
+/**
+ * Computes a 32 bit hash of the given chunk.
+ *
+ * The key is initialized with chunkHashSeed(), use this function for hash
+ * tables keyed by data from untrusted sources.
+ *
+ * @note This hash is not intended for cryptographic purposes.
+ *
+ * @param chunk			data to hash
+ * @return				hash value
+ */
+uint32_t chunkHash(chunk_t chunk);
+
+/**
+ * Incremental version of chunkHash(), to hash multiple chunks to a single value.
+ *
+ * @param chunk			data to hash
+ * @param hash			previous hash value
+ * @return				hash value
+ */
+uint32_t chunkHashInc(chunk_t chunk, uint32_t hash);
+
 /**
  * Computes a 32 bit hash of the given chunk.
  *
@@ -165,6 +249,9 @@ bool chunkUnmap(chunk_t *chunk);
  * same input.  Therefore, it should not be used for hash tables (to prevent
  * hash flooding).
  *
+ * Large inputs may be hashed in pieces with chunkHashInit() using a NULL key,
+ * chunkHashUpdate() and chunkHashFinal().
+ *
  * @note This hash is not intended for cryptographic purposes.
  *
  * @param chunk			data to hash
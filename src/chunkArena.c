@@ -0,0 +1,265 @@
+#include "chunkArena.h"
+
+#include <stdarg.h> /* va_list, va_start, va_arg, va_end */
+/* malloc, free */
+/* memcpy */
+/* memwipe */
+/* min, TRUE */
+
+/**
+ * Default size of a block allocated from heap
+ */
+#define ARENA_BLOCK_SIZE 4096
+
+/**
+ * Alignment of allocations returned by the arena
+ */
+#define ARENA_ALIGN (2 * sizeof(void*))
+
+typedef struct arenaBlock_t arenaBlock_t;
+
+/**
+ * A block of memory allocations are served from
+ */
+struct arenaBlock_t {
+	arenaBlock_t *next;	/**!< next block in list */
+	size_t size;		/**!< usable size of data */
+	size_t used;		/**!< number of bytes allocated from data */
+	uint8_t *data;		/**!< aligned start of usable memory */
+	uint8_t mem[];		/**!< memory of the block */
+};
+
+struct chunkArena_t {
+	arenaBlock_t *blocks;	/**!< blocks of blockSize, reused after reset */
+	arenaBlock_t *current;	/**!< block allocations are currently served from */
+	arenaBlock_t *large;	/**!< dedicated blocks for oversized allocations */
+	size_t blockSize;		/**!< size of regular blocks */
+	bool sensitive;			/**!< wipe memory on reset */
+};
+
+/**
+ * Allocate a new block having at least size bytes usable
+ */
+static arenaBlock_t *createBlock(size_t size)
+{
+	arenaBlock_t *block;
+
+	block = malloc(sizeof(*block) + size + ARENA_ALIGN);
+	block->next = NULL;
+	block->size = size;
+	block->used = 0;
+	block->data = (uint8_t*)(((uintptr_t)block->mem + ARENA_ALIGN - 1) &
+							 ~(uintptr_t)(ARENA_ALIGN - 1));
+	return block;
+}
+
+/**
+ * Free a list of blocks, optionally wiping the used part
+ */
+static void destroyBlocks(arenaBlock_t *block, bool sensitive)
+{
+	arenaBlock_t *next;
+
+	while (block) {
+		next = block->next;
+		if (sensitive) {
+			memwipe(block->data, block->used);
+		}
+		free(block);
+		block = next;
+	}
+}
+
+chunkArena_t *chunkArenaCreate(size_t blockSize, bool sensitive)
+{
+	chunkArena_t *this = (chunkArena_t *)malloc(sizeof(*this));
+
+	this->blockSize = blockSize ? blockSize : ARENA_BLOCK_SIZE;
+	this->sensitive = sensitive;
+	this->blocks = this->current = createBlock(this->blockSize);
+	this->large = NULL;
+
+	return this;
+}
+
+void *chunkArenaAlloc(chunkArena_t *this, size_t len)
+{
+	arenaBlock_t *block;
+	size_t aligned;
+	void *ptr;
+
+	aligned = (len + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+
+	if (aligned > this->blockSize / 4) {
+		/* don't waste regular blocks on large allocations */
+		block = createBlock(aligned);
+		block->used = aligned;
+		block->next = this->large;
+		this->large = block;
+		return block->data;
+	}
+
+	block = this->current;
+	if (block->size - block->used < aligned) {
+		if (!block->next) {
+			block->next = createBlock(this->blockSize);
+		}
+		block = this->current = block->next;
+	}
+	ptr = block->data + block->used;
+	block->used += aligned;
+
+	return ptr;
+}
+
+chunk_t chunkArenaClone(chunkArena_t *this, chunk_t chunk)
+{
+	chunk_t clone = ChunkEmpty;
+
+	if (chunk.ptr && chunk.len > 0) {
+		clone.ptr = chunkArenaAlloc(this, chunk.len);
+		clone.len = chunk.len;
+		memcpy(clone.ptr, chunk.ptr, chunk.len);
+	}
+
+	return clone;
+}
+
+chunk_t chunkArenaCreateCat(chunkArena_t *this, const char *mode, ...)
+{
+	va_list chunks;
+	const char *pos;
+	size_t len = 0;
+	uint8_t *ptr;
+
+	/* the same as chunkLen(), but we can't pass on our va_list */
+	va_start(chunks, mode);
+	for (pos = mode; *pos == 'm' || *pos == 'c' || *pos == 's'; ++pos) {
+		len += va_arg(chunks, chunk_t).len;
+	}
+	va_end(chunks);
+
+	if (!len) {
+		ptr = NULL;
+	} else {
+		ptr = chunkArenaAlloc(this, len);
+	}
+
+	va_start(chunks, mode);
+	len = 0;
+	while (TRUE) {
+		bool freeChunk = FALSE,
+			clearChunk = FALSE;
+		chunk_t ch;
+
+		switch (*mode++) {
+			case 's':
+				clearChunk = TRUE;
+				/* FALL */
+			case 'm':
+				freeChunk = TRUE;
+				/* FALL */
+			case 'c':
+				ch = va_arg(chunks, chunk_t);
+				if (ch.len) {
+					memcpy(ptr + len, ch.ptr, ch.len);
+					len += ch.len;
+				}
+				if (clearChunk) {
+					chunkClear(&ch);
+				} else if (freeChunk) {
+					free(ch.ptr);
+				}
+				continue;
+			default:
+				break;
+		}
+		break;
+	}
+	va_end(chunks);
+
+	return chunkCreate(ptr, len);
+}
+
+void chunkArenaSplit(chunkArena_t *this, chunk_t chunk, const char *mode, ...)
+{
+	va_list chunks;
+	uint32_t len;
+	chunk_t *ch;
+
+	va_start(chunks, mode);
+	while (*mode != '\0') {
+		len = va_arg(chunks, uint32_t);
+		ch = va_arg(chunks, chunk_t*);
+		/* a null chunk means skipping len bytes */
+		if (NULL == ch) {
+			chunk = chunkSkip(chunk, len);
+			mode++;
+			continue;
+		}
+		switch (*mode++) {
+			case 'm':
+			{
+				ch->len = min(chunk.len, len);
+				if (ch->len) {
+					ch->ptr = chunk.ptr;
+				} else {
+					ch->ptr = NULL;
+				}
+				chunk = chunkSkip(chunk, ch->len);
+				continue;
+			}
+			case 'a':
+			{
+				ch->len = min(chunk.len, len);
+				if (ch->len) {
+					ch->ptr = chunkArenaAlloc(this, ch->len);
+					memcpy(ch->ptr, chunk.ptr, ch->len);
+				} else {
+					ch->ptr = NULL;
+				}
+				chunk = chunkSkip(chunk, ch->len);
+				continue;
+			}
+			case 'c':
+			{
+				ch->len = min(ch->len, chunk.len);
+				ch->len = min(ch->len, len);
+				if (ch->len) {
+					memcpy(ch->ptr, chunk.ptr, ch->len);
+				} else {
+					ch->ptr = NULL;
+				}
+				chunk = chunkSkip(chunk, ch->len);
+				continue;
+			}
+			default:
+				break;
+		}
+		break;
+	}
+	va_end(chunks);
+}
+
+void chunkArenaReset(chunkArena_t *this)
+{
+	arenaBlock_t *block;
+
+	for (block = this->blocks; block; block = block->next) {
+		if (this->sensitive) {
+			memwipe(block->data, block->used);
+		}
+		block->used = 0;
+	}
+	this->current = this->blocks;
+
+	destroyBlocks(this->large, this->sensitive);
+	this->large = NULL;
+}
+
+void chunkArenaDestroy(chunkArena_t *this)
+{
+	destroyBlocks(this->blocks, this->sensitive);
+	destroyBlocks(this->large, this->sensitive);
+	free(this);
+}
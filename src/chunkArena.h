@@ -0,0 +1,92 @@
+#ifndef _CHELP_CHUNKARENA_H
+#define _CHELP_CHUNKARENA_H 1
+
+#include "chunk.h" /* chunk_t */
+
+/**
+ * Bump allocator for chunk data with a common lifetime.
+ *
+ * Chunks allocated from an arena are not freed individually, they are all
+ * released at once with chunkArenaReset() or chunkArenaDestroy(). This avoids
+ * a malloc()/free() pair for each chunk when decoding messages containing
+ * many small elements.
+ *
+ * @note Never pass a chunk allocated from an arena to chunkFree(), chunkClear()
+ * or to the 'm'/'s' modes of chunkCreateCat().
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct chunkArena_t chunkArena_t;
+
+/**
+ * Create a chunk arena.
+ *
+ * @param blockSize		size of the blocks allocated from heap, 0 for default
+ * @param sensitive		TRUE to wipe all data on reset/destroy, as chunkClear()
+ * @return				arena instance
+ */
+chunkArena_t *chunkArenaCreate(size_t blockSize, bool sensitive);
+
+/**
+ * Allocate memory from the arena.
+ *
+ * The returned memory is aligned for any basic type.
+ *
+ * @param len			number of bytes to allocate
+ * @return				allocated memory, valid until reset/destroy
+ */
+void *chunkArenaAlloc(chunkArena_t *this, size_t len);
+
+/**
+ * Clone a chunk to memory allocated from the arena.
+ *
+ * @param chunk			chunk to clone
+ * @return				clone, ChunkEmpty for an empty chunk
+ */
+chunk_t chunkArenaClone(chunkArena_t *this, chunk_t chunk);
+
+/**
+ * Concatenate chunks into a chunk allocated from the arena.
+ *
+ * Same as chunkCreateCat(), but the required memory is allocated from the
+ * arena. The mode string specifies the number of chunks, and how to handle
+ * each of them with a single character: 'c' for copy, 'm' for move (free
+ * given chunk) or 's' for sensitive-move (clear given chunk, then free).
+ *
+ * @param mode			mode string, followed by the chunks to concatenate
+ * @return				concatenated chunk
+ */
+chunk_t chunkArenaCreateCat(chunkArena_t *this, const char *mode, ...);
+
+/**
+ * Split up a chunk into parts, allocating from the arena.
+ *
+ * Same as chunkSplit(), but chunks for the "a" (alloc) mode are allocated
+ * from the arena instead of the heap. E.g.:
+ * chunkArenaSplit(arena, chunk, "mcac", 3, &a, 7, &b, 5, &c, d.len, &d);
+ *
+ * @param chunk			chunk to split
+ * @param mode			mode string, followed by length/chunk pointer pairs
+ */
+void chunkArenaSplit(chunkArena_t *this, chunk_t chunk, const char *mode, ...);
+
+/**
+ * Release all allocations at once, keeping the memory for reuse.
+ *
+ * If the arena is sensitive, all allocated data is wiped.
+ */
+void chunkArenaReset(chunkArena_t *this);
+
+/**
+ * Destroy a chunkArena_t, releasing all allocations.
+ */
+void chunkArenaDestroy(chunkArena_t *this);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CHELP_CHUNKARENA_H */
@@ -0,0 +1,217 @@
+#include "epoch.h"
+
+#include <pthread.h> /* pthread_once, pthread_key_create, pthread_mutex_t */
+#include <sched.h> /* sched_yield */
+/* calloc, free */
+/* TRUE, FALSE */
+
+/**
+ * Size of a cache line, to keep reader slots of different threads apart
+ */
+#define EPOCH_CACHE_LINE 64
+
+typedef struct epochSlot_t epochSlot_t;
+
+/**
+ * Reader state of a single thread
+ */
+struct epochSlot_t {
+	uint64_t epoch;		/**!< epoch the reader entered, 0 if inactive */
+	uint32_t nesting;	/**!< nesting of read sections, owner thread only */
+} __attribute__((aligned(EPOCH_CACHE_LINE)));
+
+struct epoch_t {
+	uint64_t current;	/**!< current global epoch, starts at 1 */
+	uint32_t overflow;	/**!< readers without a slot of their own */
+	pthread_mutex_t mutex;	/**!< serializes writers */
+	epochSlot_t slots[EPOCH_MAX_THREADS];	/**!< reader slots, by thread */
+};
+
+/**
+ * Slot index of the current thread, -1 if not yet assigned
+ */
+static __thread int threadSlot = -1;
+
+/**
+ * Nesting of read sections of threads without a slot, per thread
+ */
+static __thread uint32_t overflowNesting = 0;
+
+/**
+ * Slot indices released by terminated threads
+ */
+static int freeSlots[EPOCH_MAX_THREADS];
+
+/**
+ * Number of entries in freeSlots
+ */
+static int freeCount = 0;
+
+/**
+ * Number of slot indices ever handed out
+ */
+static int usedSlots = 0;
+
+/**
+ * Protects slot assignment
+ */
+static pthread_mutex_t slotMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Key to release the slot of a terminating thread
+ */
+static pthread_key_t slotKey;
+
+/**
+ * Initializes slotKey once
+ */
+static pthread_once_t slotOnce = PTHREAD_ONCE_INIT;
+
+/**
+ * Release the slot of a terminating thread for reuse
+ */
+static void releaseSlot(void *slot)
+{
+	pthread_mutex_lock(&slotMutex);
+	freeSlots[freeCount++] = (int)(uintptr_t)slot - 1;
+	pthread_mutex_unlock(&slotMutex);
+	/* later destructors entering a read section get a new slot */
+	threadSlot = -1;
+}
+
+static void createSlotKey()
+{
+	pthread_key_create(&slotKey, releaseSlot);
+}
+
+/**
+ * Get the slot index of the current thread, EPOCH_MAX_THREADS if none left
+ */
+static inline int getSlot()
+{
+	if (threadSlot >= 0) {
+		return threadSlot;
+	}
+	pthread_once(&slotOnce, createSlotKey);
+	pthread_mutex_lock(&slotMutex);
+	if (freeCount) {
+		threadSlot = freeSlots[--freeCount];
+	} else if (usedSlots < EPOCH_MAX_THREADS) {
+		threadSlot = usedSlots++;
+	} else {
+		threadSlot = EPOCH_MAX_THREADS;
+	}
+	pthread_mutex_unlock(&slotMutex);
+	if (threadSlot < EPOCH_MAX_THREADS) {
+		pthread_setspecific(slotKey, (void*)(uintptr_t)(threadSlot + 1));
+	}
+	return threadSlot;
+}
+
+epoch_t *epochCreate()
+{
+	epoch_t *this;
+
+	if (posix_memalign((void**)&this, EPOCH_CACHE_LINE, sizeof(*this)) != 0) {
+		return NULL;
+	}
+	memset(this, 0, sizeof(*this));
+	this->current = 1;
+	pthread_mutex_init(&this->mutex, NULL);
+
+	return this;
+}
+
+void epochEnter(epoch_t *this)
+{
+	int slot = getSlot();
+
+	if (slot == EPOCH_MAX_THREADS) {
+		if (overflowNesting++ == 0) {
+			__atomic_add_fetch(&this->overflow, 1, __ATOMIC_SEQ_CST);
+		}
+		return;
+	}
+	if (this->slots[slot].nesting++ == 0) {
+		/* the store must be visible before we read any protected pointer */
+		__atomic_store_n(&this->slots[slot].epoch,
+						 __atomic_load_n(&this->current, __ATOMIC_RELAXED),
+						 __ATOMIC_SEQ_CST);
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	}
+}
+
+void epochExit(epoch_t *this)
+{
+	int slot = threadSlot;
+
+	if (slot == EPOCH_MAX_THREADS) {
+		if (--overflowNesting == 0) {
+			__atomic_sub_fetch(&this->overflow, 1, __ATOMIC_RELEASE);
+		}
+		return;
+	}
+	if (--this->slots[slot].nesting == 0) {
+		__atomic_store_n(&this->slots[slot].epoch, 0, __ATOMIC_RELEASE);
+	}
+}
+
+void epochSynchronize(epoch_t *this)
+{
+	uint64_t target, epoch;
+	int i, count;
+
+	pthread_mutex_lock(&this->mutex);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	target = __atomic_add_fetch(&this->current, 1, __ATOMIC_SEQ_CST);
+
+	pthread_mutex_lock(&slotMutex);
+	count = usedSlots;
+	pthread_mutex_unlock(&slotMutex);
+
+	for (i = 0; i < count; ++i) {
+		while (TRUE) {
+			epoch = __atomic_load_n(&this->slots[i].epoch, __ATOMIC_ACQUIRE);
+			if (epoch == 0 || epoch >= target) {
+				break;
+			}
+			sched_yield();
+		}
+	}
+	while (__atomic_load_n(&this->overflow, __ATOMIC_ACQUIRE)) {
+		sched_yield();
+	}
+	pthread_mutex_unlock(&this->mutex);
+}
+
+uint64_t epochDefer(epoch_t *this)
+{
+	/* like epochSynchronize(), but readers are checked later */
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	return __atomic_add_fetch(&this->current, 1, __ATOMIC_SEQ_CST);
+}
+
+bool epochPassed(epoch_t *this, uint64_t token)
+{
+	uint64_t epoch;
+	int i, count;
+
+	pthread_mutex_lock(&slotMutex);
+	count = usedSlots;
+	pthread_mutex_unlock(&slotMutex);
+
+	for (i = 0; i < count; ++i) {
+		epoch = __atomic_load_n(&this->slots[i].epoch, __ATOMIC_ACQUIRE);
+		if (epoch != 0 && epoch < token) {
+			return FALSE;
+		}
+	}
+	/* readers without a slot don't record their epoch, assume the worst */
+	return __atomic_load_n(&this->overflow, __ATOMIC_ACQUIRE) == 0;
+}
+
+void epochDestroy(epoch_t *this)
+{
+	pthread_mutex_destroy(&this->mutex);
+	free(this);
+}
@@ -0,0 +1,91 @@
+#ifndef _CHELP_EPOCH_H
+#define _CHELP_EPOCH_H 1
+
+/**
+ * Epoch based reclamation for read-mostly data (RCU style).
+ *
+ * Readers access data published through an atomic pointer between
+ * epochEnter() and epochExit(). These calls never block and touch only
+ * memory private to the calling thread. A writer replaces the pointer
+ * and then calls epochSynchronize(), which waits until every reader that
+ * might still see the old data has left, so the old data can be freed.
+ *
+ * @code
+ * epochEnter(epoch);
+ * data = __atomic_load_n(&shared, __ATOMIC_ACQUIRE);
+ * ... use data ...
+ * epochExit(epoch);
+ *
+ * old = __atomic_exchange_n(&shared, new, __ATOMIC_ACQ_REL);
+ * epochSynchronize(epoch);
+ * free(old);
+ * @endcode
+ *
+ * Read sections may be nested. epochSynchronize() must not be called from
+ * within a read section of the same epoch, as it would wait for itself.
+ * Writers that can't block use epochDefer() and poll epochPassed() instead.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Number of threads that get a private reader slot, further threads share
+ * a single counter (still correct, but contended).
+ */
+#define EPOCH_MAX_THREADS 256
+
+typedef struct epoch_t epoch_t;
+
+/**
+ * Create an epoch instance.
+ *
+ * @return			epoch instance
+ */
+epoch_t *epochCreate();
+
+/**
+ * Enter a read section.
+ */
+void epochEnter(epoch_t *this);
+
+/**
+ * Leave a read section.
+ */
+void epochExit(epoch_t *this);
+
+/**
+ * Wait until all read sections entered before this call have been left.
+ */
+void epochSynchronize(epoch_t *this);
+
+/**
+ * Start waiting for read sections without blocking, to defer freeing data
+ * replaced before this call.
+ *
+ * @return			token to check with epochPassed()
+ */
+uint64_t epochDefer(epoch_t *this);
+
+/**
+ * Check if all read sections entered before epochDefer() returned the given
+ * token have been left. Unlike epochSynchronize(), this may be called from
+ * within a read section, but then never succeeds for data deferred after
+ * entering it.
+ *
+ * @param token		token returned by epochDefer()
+ * @return			TRUE if data deferred with token can be freed
+ */
+bool epochPassed(epoch_t *this, uint64_t token);
+
+/**
+ * Destroy an epoch_t, no reader may be active.
+ */
+void epochDestroy(epoch_t *this);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CHELP_EPOCH_H */
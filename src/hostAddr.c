@@ -0,0 +1,350 @@
+#include "hostAddr.h"
+
+#include <arpa/inet.h> /* inet_pton */
+#ifdef __SSE2__
+#include <emmintrin.h> /* __m128i, _mm_loadu_si128, _mm_cmpeq_epi8 */
+#endif /* __SSE2__ */
+/* memset, memcpy, strncpy, strlen, strchr */
+/* hostCreateFromSockaddr, hostGetSockaddr */
+
+bool hostAddrFromString(hostAddr_t *this, char *string, int family,
+						uint16_t port)
+{
+	memset(this, 0, sizeof(*this));
+
+	if (family != AF_INET6 &&
+		inet_pton(AF_INET, string, &this->sin.sin_addr) == 1) {
+		this->sin.sin_family = AF_INET;
+		this->sin.sin_port = htons(port);
+		return TRUE;
+	}
+	if (family != AF_INET &&
+		inet_pton(AF_INET6, string, &this->sin6.sin6_addr) == 1) {
+		this->sin6.sin6_family = AF_INET6;
+		this->sin6.sin6_port = htons(port);
+		return TRUE;
+	}
+	memset(this, 0, sizeof(*this));
+	return FALSE;
+}
+
+bool hostAddrFromChunk(hostAddr_t *this, int family, chunk_t address,
+					   uint16_t port)
+{
+	memset(this, 0, sizeof(*this));
+
+	switch (family) {
+		case AF_INET:
+			if (address.len && address.len != sizeof(this->sin.sin_addr)) {
+				return FALSE;
+			}
+			this->sin.sin_family = AF_INET;
+			this->sin.sin_port = htons(port);
+			if (address.len) {
+				memcpy(&this->sin.sin_addr, address.ptr, address.len);
+			}
+			return TRUE;
+		case AF_INET6:
+			if (address.len && address.len != sizeof(this->sin6.sin6_addr)) {
+				return FALSE;
+			}
+			this->sin6.sin6_family = AF_INET6;
+			this->sin6.sin6_port = htons(port);
+			if (address.len) {
+				memcpy(&this->sin6.sin6_addr, address.ptr, address.len);
+			}
+			return TRUE;
+		default:
+			return FALSE;
+	}
+}
+
+bool hostAddrFromSockaddr(hostAddr_t *this, sockaddr_t *sockaddr)
+{
+	memset(this, 0, sizeof(*this));
+
+	switch (sockaddr->sa_family) {
+		case AF_INET:
+			memcpy(&this->sin, sockaddr, sizeof(this->sin));
+			return TRUE;
+		case AF_INET6:
+			memcpy(&this->sin6, sockaddr, sizeof(this->sin6));
+			return TRUE;
+		default:
+			return FALSE;
+	}
+}
+
+bool hostAddrFromHost(hostAddr_t *this, host_t *host)
+{
+	return hostAddrFromSockaddr(this, hostGetSockaddr(host));
+}
+
+host_t *hostAddrToHost(hostAddr_t *this)
+{
+	if (!hostAddrGetSockaddrLen(this)) {
+		return NULL;
+	}
+	return hostCreateFromSockaddr(&this->sa);
+}
+
+/**
+ * Number of bytes classified at once, covers IPv4 CIDR forms and most IPv6
+ * addresses
+ */
+#define CLASSIFY_LEN 32
+
+/**
+ * Maximum length of an IPv6 address in text form, including 0-terminator
+ */
+#define ADDR6_MAX_LEN 46
+
+/**
+ * Character classes of the first CLASSIFY_LEN bytes of a string, one bit
+ * per byte
+ */
+typedef struct {
+	uint32_t end;		/**!< 0-terminator */
+	uint32_t digit;		/**!< '0'-'9' */
+	uint32_t dot;		/**!< '.' */
+	uint32_t colon;		/**!< ':' */
+	uint32_t slash;		/**!< '/' */
+} addrClasses_t;
+
+#ifdef __SSE2__
+
+/**
+ * Load 16 bytes without crossing into a page the string does not cover
+ */
+#ifdef __SANITIZE_ADDRESS__
+__attribute__((no_sanitize_address))
+#endif /* __SANITIZE_ADDRESS__ */
+static inline __m128i load16(const char *str)
+{
+	char buf[16] = {};
+
+	if (((uintptr_t)str & 4095) <= 4096 - 16) {
+		/* may read past the terminator, but stays within the page */
+		return _mm_loadu_si128((const __m128i*)str);
+	}
+	strncpy(buf, str, sizeof(buf));
+	return _mm_loadu_si128((const __m128i*)buf);
+}
+
+/**
+ * Classify 16 bytes
+ */
+static inline void classify16(__m128i v, int shift, addrClasses_t *classes)
+{
+	__m128i digit;
+
+	/* signed compare works as all characters of interest are ASCII */
+	digit = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('0' - 1)),
+						  _mm_cmplt_epi8(v, _mm_set1_epi8('9' + 1)));
+	classes->digit |= (uint32_t)_mm_movemask_epi8(digit) << shift;
+	classes->end |= (uint32_t)_mm_movemask_epi8(
+						_mm_cmpeq_epi8(v, _mm_setzero_si128())) << shift;
+	classes->dot |= (uint32_t)_mm_movemask_epi8(
+						_mm_cmpeq_epi8(v, _mm_set1_epi8('.'))) << shift;
+	classes->colon |= (uint32_t)_mm_movemask_epi8(
+						_mm_cmpeq_epi8(v, _mm_set1_epi8(':'))) << shift;
+	classes->slash |= (uint32_t)_mm_movemask_epi8(
+						_mm_cmpeq_epi8(v, _mm_set1_epi8('/'))) << shift;
+}
+
+/**
+ * Classify the first CLASSIFY_LEN bytes of a string, bytes after the
+ * terminator are undefined
+ */
+static inline void classify(const char *str, addrClasses_t *classes)
+{
+	*classes = (addrClasses_t){};
+	classify16(load16(str), 0, classes);
+	if (!classes->end) {
+		classify16(load16(str + 16), 16, classes);
+	}
+}
+
+#else /* __SSE2__ */
+
+/**
+ * Classify the first CLASSIFY_LEN bytes of a string, bytes after the
+ * terminator are undefined
+ */
+static inline void classify(const char *str, addrClasses_t *classes)
+{
+	uint32_t bit;
+	int i;
+
+	*classes = (addrClasses_t){};
+	for (i = 0; i < CLASSIFY_LEN; i++) {
+		bit = 1U << i;
+		switch (str[i]) {
+			case '\0':
+				classes->end |= bit;
+				return;
+			case '.':
+				classes->dot |= bit;
+				break;
+			case ':':
+				classes->colon |= bit;
+				break;
+			case '/':
+				classes->slash |= bit;
+				break;
+			default:
+				if (str[i] >= '0' && str[i] <= '9') {
+					classes->digit |= bit;
+				}
+				break;
+		}
+	}
+}
+
+#endif /* __SSE2__ */
+
+/**
+ * Convert a run of 1-3 decimal digits, returns -1 if invalid
+ */
+static inline int parseDecimal(const char *str, int len, bool leadingZero)
+{
+	int value;
+
+	switch (len) {
+		case 1:
+			return str[0] - '0';
+		case 2:
+			value = (str[0] - '0') * 10 + (str[1] - '0');
+			break;
+		case 3:
+			value = (str[0] - '0') * 100 + (str[1] - '0') * 10 +
+					(str[2] - '0');
+			break;
+		default:
+			return -1;
+	}
+	if (!leadingZero && str[0] == '0') {
+		return -1;
+	}
+	return value;
+}
+
+/**
+ * Parse a dotted IPv4 address of the given length, using the classes of
+ * the string
+ */
+static bool parseAddr4(const char *str, int len, addrClasses_t *classes,
+					   struct in_addr *addr)
+{
+	uint32_t mask = (1U << len) - 1, dots = classes->dot & mask;
+	uint8_t *bytes = (uint8_t*)addr;
+	int i, start = 0, end, value;
+
+	/* only digits and exactly three dots, the first byte is a digit */
+	if ((((classes->digit | classes->dot) & mask) ^ mask) ||
+		__builtin_popcount(dots) != 3) {
+		return FALSE;
+	}
+	for (i = 0; i < 4; i++) {
+		end = i < 3 ? __builtin_ctz(dots) : len;
+		dots &= dots - 1;
+		/* inet_pton() rejects leading zeros, so do we */
+		value = parseDecimal(str + start, end - start, FALSE);
+		if (value < 0 || value > 255) {
+			return FALSE;
+		}
+		bytes[i] = value;
+		start = end + 1;
+	}
+	return TRUE;
+}
+
+/**
+ * Parse a single string
+ */
+static hostAddrParseError_t parseOne(char *str, int family,
+									 hostAddrParse_t *result)
+{
+	char buf[ADDR6_MAX_LEN];
+	addrClasses_t classes;
+	uint32_t mask;
+	int len, addrLen, bitsLen, maxBits, i;
+
+	memset(&result->addr, 0, sizeof(result->addr));
+	classify(str, &classes);
+	if (classes.end) {
+		len = __builtin_ctz(classes.end);
+		mask = (1U << len) - 1;
+	} else {
+		/* longer than what we classified, must be IPv6 */
+		len = strlen(str);
+		mask = ~0U;
+	}
+
+	addrLen = len;
+	if (classes.slash & mask) {
+		addrLen = __builtin_ctz(classes.slash & mask);
+	} else if (len > CLASSIFY_LEN) {
+		addrLen = strchr(str, '/') ? strchr(str, '/') - str : len;
+	}
+	if (addrLen == 0) {
+		return HOST_ADDR_PARSE_SYNTAX;
+	}
+
+	if ((classes.colon & mask) || addrLen > CLASSIFY_LEN) {
+		if (addrLen >= ADDR6_MAX_LEN) {
+			return HOST_ADDR_PARSE_SYNTAX;
+		}
+		memcpy(buf, str, addrLen);
+		buf[addrLen] = '\0';
+		if (inet_pton(AF_INET6, buf, &result->addr.sin6.sin6_addr) != 1) {
+			return HOST_ADDR_PARSE_SYNTAX;
+		}
+		result->addr.sin6.sin6_family = AF_INET6;
+		maxBits = 128;
+	} else {
+		/* IPv4 addresses are much shorter, and the masks can't cover more */
+		if (addrLen >= CLASSIFY_LEN ||
+			!parseAddr4(str, addrLen, &classes, &result->addr.sin.sin_addr)) {
+			return HOST_ADDR_PARSE_SYNTAX;
+		}
+		result->addr.sin.sin_family = AF_INET;
+		maxBits = 32;
+	}
+	if (family != AF_UNSPEC && family != result->addr.sa.sa_family) {
+		memset(&result->addr, 0, sizeof(result->addr));
+		return HOST_ADDR_PARSE_FAMILY;
+	}
+
+	result->netbits = maxBits;
+	if (addrLen < len) {
+		bitsLen = len - addrLen - 1;
+		for (i = addrLen + 1; i < len; i++) {
+			if (str[i] < '0' || str[i] > '9') {
+				return HOST_ADDR_PARSE_NETBITS;
+			}
+		}
+		/* as strtol() in hostCreateFromSubnet(), leading zeros are fine */
+		result->netbits = parseDecimal(str + addrLen + 1, bitsLen, TRUE);
+		if (result->netbits < 0 || result->netbits > maxBits) {
+			result->netbits = maxBits;
+			return HOST_ADDR_PARSE_NETBITS;
+		}
+	}
+	return HOST_ADDR_PARSE_OK;
+}
+
+int hostAddrParseBatch(char **strings, int count, int family,
+					   hostAddrParse_t *results)
+{
+	int i, parsed = 0;
+
+	for (i = 0; i < count; i++) {
+		results[i].netbits = 0;
+		results[i].error = parseOne(strings[i], family, &results[i]);
+		if (results[i].error == HOST_ADDR_PARSE_OK) {
+			parsed++;
+		}
+	}
+	return parsed;
+}
@@ -0,0 +1,277 @@
+#ifndef _CHELP_HOSTADDR_H
+#define _CHELP_HOSTADDR_H 1
+
+#include <netinet/in.h> /* sockaddr_in, sockaddr_in6 */
+#include "chunk.h" /* chunk_t, chunkHash, chunkHashInc */
+#include "host.h" /* host_t */
+
+/**
+ * Inline address:port value, the allocation free counterpart to host_t.
+ *
+ * A hostAddr_t is a plain 28 byte value that can be embedded in other
+ * structures, copied by assignment and compared or hashed without touching
+ * the heap. The family tag is the sa_family of the contained sockaddr, which
+ * is AF_UNSPEC for an uninitialized (zeroed) value.
+ *
+ * Convert from and to host_t with hostAddrFromHost() and hostAddrToHost()
+ * where an API still requires a host_t.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct hostAddr_t hostAddr_t;
+typedef struct hostAddrParse_t hostAddrParse_t;
+typedef enum hostAddrParseError_t hostAddrParseError_t;
+
+/**
+ * Address and port of a host, stored as sockaddr
+ */
+struct hostAddr_t {
+	union {
+		sockaddr_t sa;					/**!< generic sockaddr, family tag */
+		struct sockaddr_in sin;			/**!< IPv4 address and port */
+		struct sockaddr_in6 sin6;		/**!< IPv6 address and port */
+	};
+};
+
+/**
+ * Initialize from an address string, without DNS resolution.
+ *
+ * @param string		string of an address, "152.96.192.130" or "fec1::1"
+ * @param family		address family, or AF_UNSPEC
+ * @param port			port number
+ * @return				TRUE if string is an address of the given family
+ */
+bool hostAddrFromString(hostAddr_t *this, char *string, int family,
+						uint16_t port);
+
+/**
+ * Initialize from an address in network order.
+ *
+ * An empty address chunk initializes an "any" address of the family.
+ *
+ * @param family		address family, AF_INET or AF_INET6
+ * @param address		address as chunk_t in network order
+ * @param port			port number
+ * @return				TRUE if the address length matches the family
+ */
+bool hostAddrFromChunk(hostAddr_t *this, int family, chunk_t address,
+					   uint16_t port);
+
+/**
+ * Initialize from a sockaddr.
+ *
+ * @param sockaddr		sockaddr struct which contains family, address, and port
+ * @return				TRUE if the family is AF_INET or AF_INET6
+ */
+bool hostAddrFromSockaddr(hostAddr_t *this, sockaddr_t *sockaddr);
+
+/**
+ * Initialize from a host_t.
+ *
+ * @param host			host to copy address and port from
+ * @return				TRUE if the host family is AF_INET or AF_INET6
+ */
+bool hostAddrFromHost(hostAddr_t *this, host_t *host);
+
+/**
+ * Create a host_t having the same address and port.
+ *
+ * @return				allocated host_t, NULL if this is not initialized
+ */
+host_t *hostAddrToHost(hostAddr_t *this);
+
+/**
+ * Result of parsing an address with hostAddrParseBatch()
+ */
+enum hostAddrParseError_t {
+	/** address parsed successfully */
+	HOST_ADDR_PARSE_OK = 0,
+	/** not an IPv4 or IPv6 address */
+	HOST_ADDR_PARSE_SYNTAX,
+	/** address of a family other than requested */
+	HOST_ADDR_PARSE_FAMILY,
+	/** invalid prefix length after '/' */
+	HOST_ADDR_PARSE_NETBITS,
+};
+
+/**
+ * A parsed address
+ */
+struct hostAddrParse_t {
+	hostAddr_t addr;				/**!< address, port 0 */
+	int netbits;					/**!< prefix length, full if none given */
+	hostAddrParseError_t error;		/**!< result of parsing this entry */
+};
+
+/**
+ * Parse many address strings at once.
+ *
+ * Accepts the address forms of hostCreateFromString() without DNS
+ * resolution and the CIDR forms of hostCreateFromSubnet(), e.g.
+ * "10.1.2.0/24". Host bits of CIDR forms are not cleared. The first 32
+ * bytes of each string are classified at once, with SSE2 where available,
+ * making this considerably faster than creating a host_t per string.
+ *
+ * @param strings		strings to parse
+ * @param count			number of strings
+ * @param family		family to accept, or AF_UNSPEC
+ * @param results		receives a result for each string
+ * @return				number of successfully parsed strings
+ */
+int hostAddrParseBatch(char **strings, int count, int family,
+					   hostAddrParse_t *results);
+
+/**
+ * Get the address family, AF_UNSPEC if not initialized.
+ */
+static inline int hostAddrGetFamily(const hostAddr_t *this)
+{
+	return this->sa.sa_family;
+}
+
+/**
+ * Get the length of the contained sockaddr, 0 if not initialized.
+ */
+static inline socklen_t hostAddrGetSockaddrLen(const hostAddr_t *this)
+{
+	switch (this->sa.sa_family) {
+		case AF_INET:
+			return sizeof(struct sockaddr_in);
+		case AF_INET6:
+			return sizeof(struct sockaddr_in6);
+		default:
+			return 0;
+	}
+}
+
+/**
+ * Get the address in network order, pointing into this.
+ *
+ * @return				address, empty chunk if not initialized
+ */
+static inline chunk_t hostAddrGetAddress(const hostAddr_t *this)
+{
+	switch (this->sa.sa_family) {
+		case AF_INET:
+			return chunkCreate((uint8_t*)&this->sin.sin_addr,
+							   sizeof(this->sin.sin_addr));
+		case AF_INET6:
+			return chunkCreate((uint8_t*)&this->sin6.sin6_addr,
+							   sizeof(this->sin6.sin6_addr));
+		default:
+			return chunk_empty;
+	}
+}
+
+/**
+ * Get the port in host order.
+ */
+static inline uint16_t hostAddrGetPort(const hostAddr_t *this)
+{
+	switch (this->sa.sa_family) {
+		case AF_INET:
+			return ntohs(this->sin.sin_port);
+		case AF_INET6:
+			return ntohs(this->sin6.sin6_port);
+		default:
+			return 0;
+	}
+}
+
+/**
+ * Set the port, given in host order.
+ */
+static inline void hostAddrSetPort(hostAddr_t *this, uint16_t port)
+{
+	switch (this->sa.sa_family) {
+		case AF_INET:
+			this->sin.sin_port = htons(port);
+			break;
+		case AF_INET6:
+			this->sin6.sin6_port = htons(port);
+			break;
+		default:
+			break;
+	}
+}
+
+/**
+ * Check if the address is all zero, an "any" address.
+ */
+static inline bool hostAddrIsAnyAddr(const hostAddr_t *this)
+{
+	switch (this->sa.sa_family) {
+		case AF_INET:
+			return this->sin.sin_addr.s_addr == INADDR_ANY;
+		case AF_INET6:
+			return IN6_IS_ADDR_UNSPECIFIED(&this->sin6.sin6_addr);
+		default:
+			return TRUE;
+	}
+}
+
+/**
+ * Compare the addresses, ignoring the port.
+ *
+ * As hostIpEquals(), "any" addresses of different families are equal.
+ */
+static inline bool hostAddrIpEquals(const hostAddr_t *this,
+									const hostAddr_t *other)
+{
+	if (this->sa.sa_family != other->sa.sa_family) {
+		return hostAddrIsAnyAddr(this) && hostAddrIsAnyAddr(other);
+	}
+	switch (this->sa.sa_family) {
+		case AF_INET:
+			return this->sin.sin_addr.s_addr == other->sin.sin_addr.s_addr;
+		case AF_INET6:
+			return memcmp(&this->sin6.sin6_addr, &other->sin6.sin6_addr,
+						  sizeof(this->sin6.sin6_addr)) == 0;
+		default:
+			return TRUE;
+	}
+}
+
+/**
+ * Compare address and port.
+ */
+static inline bool hostAddrEquals(const hostAddr_t *this,
+								  const hostAddr_t *other)
+{
+	return hostAddrIpEquals(this, other) &&
+		   hostAddrGetPort(this) == hostAddrGetPort(other);
+}
+
+/**
+ * Hash the address, ignoring the port, consistent with hostAddrIpEquals().
+ *
+ * Uses the keyed chunkHash(), suitable for tables keyed by peer addresses.
+ */
+static inline uint32_t hostAddrIpHash(const hostAddr_t *this)
+{
+	if (hostAddrIsAnyAddr(this)) {
+		/* any addresses of all families are equal */
+		return chunkHash(chunk_empty);
+	}
+	return chunkHash(hostAddrGetAddress(this));
+}
+
+/**
+ * Hash address and port, consistent with hostAddrEquals().
+ */
+static inline uint32_t hostAddrHash(const hostAddr_t *this)
+{
+	uint16_t port = hostAddrGetPort(this);
+
+	return chunkHashInc(chunkCreate((uint8_t*)&port, sizeof(port)),
+						hostAddrIpHash(this));
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CHELP_HOSTADDR_H */
@@ -0,0 +1,815 @@
+#include "hostLpm.h"
+#include "epoch.h"
+
+#include <pthread.h> /* pthread_mutex_t */
+/* malloc, calloc, free, qsort */
+/* memcpy, memcmp, memset */
+/* chunkHash, chunkCreate */
+/* hostGetFamily, hostGetAddress */
+/* max, TRUE, FALSE */
+
+/**
+ * Number of slots in a node, one per value of an address byte
+ */
+#define LPM_SLOTS 256
+
+/**
+ * Maximum depth of a trie, one level per address byte
+ */
+#define LPM_MAX_DEPTH 16
+
+/**
+ * Length of a prefix key: family index, prefix length and address
+ */
+#define LPM_KEY_LEN (2 + LPM_MAX_DEPTH)
+
+typedef struct lpmSlot_t lpmSlot_t;
+typedef struct lpmLeaf_t lpmLeaf_t;
+typedef struct lpmNode_t lpmNode_t;
+typedef struct lpmRoot_t lpmRoot_t;
+typedef struct lpmPrefix_t lpmPrefix_t;
+typedef struct lpmSet_t lpmSet_t;
+
+/**
+ * Expanded slot of a node, used by writers only
+ */
+struct lpmSlot_t {
+	lpmNode_t *child;	/**!< node for the next address byte, if any */
+	void *value;		/**!< value of the longest prefix ending here */
+	uint8_t len;		/**!< length of that prefix within node, 0 if none */
+};
+
+/**
+ * Value of a run of slots
+ */
+struct lpmLeaf_t {
+	void *value;		/**!< value of the longest prefix, NULL if none */
+	uint8_t len;		/**!< length of that prefix within node, 0 if none */
+};
+
+/**
+ * A compressed trie node, immutable once published.
+ *
+ * Of the 256 slots, only those having a child are stored, located by the
+ * rank of the slot in childMap. Consecutive slots having the same value form
+ * a run, stored once and located by the rank of the slot in leafMap, which
+ * has a bit set for the first slot of each run.
+ */
+struct lpmNode_t {
+	uint64_t childMap[4];		/**!< slots having a child */
+	uint64_t leafMap[4];		/**!< slots starting a run of values */
+	uint16_t childBase[4];		/**!< number of children before each word */
+	uint16_t leafBase[4];		/**!< number of runs before each word */
+	lpmNode_t **children;		/**!< children, allocated with node */
+	lpmLeaf_t *leaves;			/**!< runs, allocated with node */
+};
+
+/**
+ * A published version of the tries
+ */
+struct lpmRoot_t {
+	lpmNode_t *nodes[2];	/**!< IPv4 and IPv6 trie */
+	void *defaults[2];		/**!< value of the /0 prefix of each family */
+};
+
+/**
+ * A subnet in the table, as known to writers
+ */
+struct lpmPrefix_t {
+	uint8_t key[LPM_KEY_LEN];	/**!< family index, length, masked address */
+	uint32_t hash;				/**!< hash of key */
+	void *value;				/**!< associated value */
+	lpmPrefix_t *next;			/**!< next prefix in hash bucket */
+};
+
+/**
+ * Hash set of all prefixes, used to (re-)compute expanded slots
+ */
+struct lpmSet_t {
+	lpmPrefix_t **buckets;		/**!< hash buckets */
+	uint32_t mask;				/**!< number of buckets - 1 */
+	int count;					/**!< number of prefixes */
+};
+
+struct hostLpm_t {
+	epoch_t *epoch;				/**!< protects published nodes */
+	pthread_mutex_t mutex;		/**!< serializes updates */
+	lpmRoot_t *root;			/**!< published tries */
+	lpmSet_t set;				/**!< prefixes in table */
+};
+
+/**
+ * Number of address bytes per family index
+ */
+static const int addressLen[] = { 4, 16 };
+
+/**
+ * Hash a prefix key
+ */
+static inline uint32_t keyHash(const uint8_t *key)
+{
+	return chunkHash(chunkCreate((uint8_t*)key, LPM_KEY_LEN));
+}
+
+/**
+ * Find a prefix in a set
+ */
+static lpmPrefix_t *setFind(lpmSet_t *set, const uint8_t *key, uint32_t hash)
+{
+	lpmPrefix_t *prefix;
+
+	if (!set->buckets) {
+		return NULL;
+	}
+	for (prefix = set->buckets[hash & set->mask]; prefix;
+		 prefix = prefix->next) {
+		if (prefix->hash == hash && !memcmp(prefix->key, key, LPM_KEY_LEN)) {
+			return prefix;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Add a prefix to a set, it must not be contained yet
+ */
+static bool setInsert(lpmSet_t *set, lpmPrefix_t *prefix)
+{
+	lpmPrefix_t **buckets, *current, *next;
+	uint32_t count, i;
+
+	if (!set->buckets || set->count >= set->mask + 1) {
+		count = set->buckets ? (set->mask + 1) * 2 : 64;
+		buckets = calloc(count, sizeof(*buckets));
+		if (!buckets) {
+			return FALSE;
+		}
+		for (i = 0; set->buckets && i <= set->mask; i++) {
+			for (current = set->buckets[i]; current; current = next) {
+				next = current->next;
+				current->next = buckets[current->hash & (count - 1)];
+				buckets[current->hash & (count - 1)] = current;
+			}
+		}
+		free(set->buckets);
+		set->buckets = buckets;
+		set->mask = count - 1;
+	}
+	prefix->next = set->buckets[prefix->hash & set->mask];
+	set->buckets[prefix->hash & set->mask] = prefix;
+	set->count++;
+	return TRUE;
+}
+
+/**
+ * Remove a prefix from a set
+ */
+static void setRemove(lpmSet_t *set, lpmPrefix_t *prefix)
+{
+	lpmPrefix_t **pos;
+
+	for (pos = &set->buckets[prefix->hash & set->mask]; *pos;
+		 pos = &(*pos)->next) {
+		if (*pos == prefix) {
+			*pos = prefix->next;
+			set->count--;
+			return;
+		}
+	}
+}
+
+/**
+ * Destroy all prefixes of a set
+ */
+static void setDestroy(lpmSet_t *set)
+{
+	lpmPrefix_t *prefix, *next;
+	uint32_t i;
+
+	for (i = 0; set->buckets && i <= set->mask; i++) {
+		for (prefix = set->buckets[i]; prefix; prefix = next) {
+			next = prefix->next;
+			free(prefix);
+		}
+	}
+	free(set->buckets);
+	*set = (lpmSet_t){};
+}
+
+/**
+ * Build the key of a subnet, returns FALSE if invalid
+ */
+static bool makeKey(host_t *net, int netbits, uint8_t *key)
+{
+	chunk_t address;
+	int idx, i;
+
+	switch (hostGetFamily(net)) {
+		case AF_INET:
+			idx = 0;
+			break;
+		case AF_INET6:
+			idx = 1;
+			break;
+		default:
+			return FALSE;
+	}
+	address = hostGetAddress(net);
+	if (netbits < 0 || netbits > addressLen[idx] * 8 ||
+		address.len != addressLen[idx]) {
+		return FALSE;
+	}
+	memset(key, 0, LPM_KEY_LEN);
+	key[0] = idx;
+	key[1] = netbits;
+	for (i = 0; i * 8 < netbits; i++) {
+		key[2 + i] = address.ptr[i];
+		if (netbits - i * 8 < 8) {
+			key[2 + i] &= 0xff << (8 - (netbits - i * 8));
+		}
+	}
+	return TRUE;
+}
+
+/**
+ * Number of bits set in a 256 bit map below the given bit
+ */
+static inline int mapRank(const uint64_t *map, const uint16_t *base, int bit)
+{
+	return base[bit >> 6] +
+		   __builtin_popcountll(map[bit >> 6] & ((1ULL << (bit & 63)) - 1));
+}
+
+/**
+ * Check if a bit is set in a 256 bit map
+ */
+static inline bool mapTest(const uint64_t *map, int bit)
+{
+	return (map[bit >> 6] >> (bit & 63)) & 1;
+}
+
+/**
+ * Get the run of values a slot belongs to
+ */
+static inline lpmLeaf_t *nodeLeaf(const lpmNode_t *node, int slot)
+{
+	/* the first slot always starts a run, the index is never negative */
+	return &node->leaves[mapRank(node->leafMap, node->leafBase, slot) +
+						 mapTest(node->leafMap, slot) - 1];
+}
+
+/**
+ * Get the child of a slot, NULL if none
+ */
+static inline lpmNode_t *nodeChild(const lpmNode_t *node, int slot)
+{
+	if (!mapTest(node->childMap, slot)) {
+		return NULL;
+	}
+	return node->children[mapRank(node->childMap, node->childBase, slot)];
+}
+
+/**
+ * Expand a node into slots, a NULL node results in empty slots
+ */
+static void expandNode(const lpmNode_t *node, lpmSlot_t *slots)
+{
+	lpmLeaf_t *leaf;
+	int i;
+
+	memset(slots, 0, sizeof(lpmSlot_t) * LPM_SLOTS);
+	for (i = 0; node && i < LPM_SLOTS; i++) {
+		leaf = nodeLeaf(node, i);
+		slots[i].child = nodeChild(node, i);
+		slots[i].value = leaf->value;
+		slots[i].len = leaf->len;
+	}
+}
+
+/**
+ * Compress slots to a new node
+ *
+ * @param slots			slots to compress
+ * @param node			receives the node, NULL if all slots are empty
+ * @return				FALSE if allocation failed
+ */
+static bool compressNode(const lpmSlot_t *slots, lpmNode_t **node)
+{
+	int i, children = 0, leaves = 0;
+	lpmNode_t *this;
+
+	for (i = 0; i < LPM_SLOTS; i++) {
+		if (slots[i].child) {
+			children++;
+		}
+		if (i == 0 || slots[i].value != slots[i - 1].value ||
+			slots[i].len != slots[i - 1].len) {
+			leaves++;
+		}
+	}
+	if (!children && leaves == 1 && !slots[0].len) {
+		*node = NULL;
+		return TRUE;
+	}
+	this = calloc(1, sizeof(*this) + sizeof(lpmNode_t*) * children +
+					 sizeof(lpmLeaf_t) * leaves);
+	if (!this) {
+		return FALSE;
+	}
+	this->leaves = (lpmLeaf_t*)(this + 1);
+	this->children = (lpmNode_t**)(this->leaves + leaves);
+
+	children = leaves = 0;
+	for (i = 0; i < LPM_SLOTS; i++) {
+		if (i % 64 == 0) {
+			this->childBase[i >> 6] = children;
+			this->leafBase[i >> 6] = leaves;
+		}
+		if (slots[i].child) {
+			this->childMap[i >> 6] |= 1ULL << (i & 63);
+			this->children[children++] = slots[i].child;
+		}
+		if (i == 0 || slots[i].value != slots[i - 1].value ||
+			slots[i].len != slots[i - 1].len) {
+			this->leafMap[i >> 6] |= 1ULL << (i & 63);
+			this->leaves[leaves++] = (lpmLeaf_t){
+				.value = slots[i].value,
+				.len = slots[i].len,
+			};
+		}
+	}
+	*node = this;
+	return TRUE;
+}
+
+/**
+ * Recursively destroy a trie
+ */
+static void destroyNode(lpmNode_t *node)
+{
+	int i;
+
+	if (node) {
+		for (i = 0; i < LPM_SLOTS; i++) {
+			destroyNode(nodeChild(node, i));
+		}
+		free(node);
+	}
+}
+
+/**
+ * Expand a prefix into the slots of the node at its last level, unless they
+ * hold a longer prefix
+ */
+static void expandPrefix(lpmSlot_t *slots, lpmPrefix_t *prefix, int level)
+{
+	int len = prefix->key[1] - level * 8, start, i;
+
+	start = prefix->key[2 + level];
+	for (i = start; i < start + (1 << (8 - len)); i++) {
+		if (slots[i].len <= len) {
+			slots[i].value = prefix->value;
+			slots[i].len = len;
+		}
+	}
+}
+
+/**
+ * Recompute the slots covered by a prefix from the prefixes in the set,
+ * after the prefix has been added, changed or removed
+ */
+static void recomputeSlots(lpmSet_t *set, lpmSlot_t *slots, const uint8_t *key,
+						   int level)
+{
+	uint8_t probe[LPM_KEY_LEN];
+	lpmPrefix_t *prefix;
+	int len = key[1] - level * 8, start, i, l;
+
+	memcpy(probe, key, LPM_KEY_LEN);
+	start = key[2 + level];
+	for (i = start; i < start + (1 << (8 - len)); i++) {
+		slots[i].value = NULL;
+		slots[i].len = 0;
+		for (l = 8; l > 0; l--) {
+			probe[1] = level * 8 + l;
+			probe[2 + level] = i & (0xff << (8 - l));
+			prefix = setFind(set, probe, keyHash(probe));
+			if (prefix) {
+				slots[i].value = prefix->value;
+				slots[i].len = l;
+				break;
+			}
+		}
+	}
+}
+
+/**
+ * Publish new tries and free the replaced nodes once unused, mutex must be
+ * held
+ */
+static void publish(hostLpm_t *this, lpmRoot_t *root, lpmNode_t **garbage,
+					int count)
+{
+	lpmRoot_t *old;
+	int i;
+
+	old = __atomic_exchange_n(&this->root, root, __ATOMIC_ACQ_REL);
+	epochSynchronize(this->epoch);
+	for (i = 0; i < count; i++) {
+		free(garbage[i]);
+	}
+	free(old);
+}
+
+/**
+ * Apply a changed prefix to a copy of the path leading to it and publish
+ * it, the set must already contain the change. Mutex must be held.
+ */
+static bool updatePath(hostLpm_t *this, const uint8_t *key)
+{
+	lpmNode_t *old[LPM_MAX_DEPTH], *copies[LPM_MAX_DEPTH], *node;
+	lpmSlot_t *slots;
+	lpmPrefix_t *prefix;
+	lpmRoot_t *root;
+	int idx = key[0], len = key[1], level, l, count = 0;
+
+	root = malloc(sizeof(*root));
+	if (!root) {
+		return FALSE;
+	}
+	*root = *this->root;
+
+	if (len == 0) {
+		prefix = setFind(&this->set, key, keyHash(key));
+		root->defaults[idx] = prefix ? prefix->value : NULL;
+		publish(this, root, NULL, 0);
+		return TRUE;
+	}
+
+	level = (len - 1) / 8;
+	slots = malloc(sizeof(lpmSlot_t) * LPM_SLOTS * (level + 1));
+	if (!slots) {
+		free(root);
+		return FALSE;
+	}
+	node = root->nodes[idx];
+	for (l = 0; l <= level; l++) {
+		old[l] = node;
+		if (node) {
+			count = l + 1;
+		}
+		expandNode(node, &slots[l * LPM_SLOTS]);
+		node = node ? nodeChild(node, key[2 + l]) : NULL;
+	}
+
+	recomputeSlots(&this->set, &slots[level * LPM_SLOTS], key, level);
+
+	/* compress copies bottom-up, nodes getting empty are pruned */
+	node = NULL;
+	for (l = level; l >= 0; l--) {
+		if (l < level) {
+			slots[l * LPM_SLOTS + key[2 + l]].child = node;
+		}
+		if (!compressNode(&slots[l * LPM_SLOTS], &copies[l])) {
+			while (++l <= level) {
+				free(copies[l]);
+			}
+			free(slots);
+			free(root);
+			return FALSE;
+		}
+		node = copies[l];
+	}
+	free(slots);
+
+	root->nodes[idx] = node;
+	publish(this, root, old, count);
+	return TRUE;
+}
+
+bool hostLpmAdd(hostLpm_t *this, host_t *net, int netbits, void *value)
+{
+	uint8_t key[LPM_KEY_LEN];
+	lpmPrefix_t *prefix;
+	void *old;
+	bool success;
+
+	if (!value || !makeKey(net, netbits, key)) {
+		return FALSE;
+	}
+	pthread_mutex_lock(&this->mutex);
+	prefix = setFind(&this->set, key, keyHash(key));
+	if (prefix) {
+		old = prefix->value;
+		prefix->value = value;
+		success = updatePath(this, key);
+		if (!success) {
+			prefix->value = old;
+		}
+	} else {
+		prefix = malloc(sizeof(*prefix));
+		success = prefix != NULL;
+		if (success) {
+			memcpy(prefix->key, key, LPM_KEY_LEN);
+			prefix->hash = keyHash(key);
+			prefix->value = value;
+			success = setInsert(&this->set, prefix);
+		}
+		if (success && !updatePath(this, key)) {
+			setRemove(&this->set, prefix);
+			success = FALSE;
+		}
+		if (!success) {
+			free(prefix);
+		}
+	}
+	pthread_mutex_unlock(&this->mutex);
+	return success;
+}
+
+void *hostLpmRemove(hostLpm_t *this, host_t *net, int netbits)
+{
+	uint8_t key[LPM_KEY_LEN];
+	lpmPrefix_t *prefix;
+	void *value = NULL;
+
+	if (!makeKey(net, netbits, key)) {
+		return NULL;
+	}
+	pthread_mutex_lock(&this->mutex);
+	prefix = setFind(&this->set, key, keyHash(key));
+	if (prefix) {
+		setRemove(&this->set, prefix);
+		if (updatePath(this, key)) {
+			value = prefix->value;
+			free(prefix);
+		} else {
+			/* can't fail, the buckets for it exist */
+			setInsert(&this->set, prefix);
+		}
+	}
+	pthread_mutex_unlock(&this->mutex);
+	return value;
+}
+
+/**
+ * Order prefixes by family and address, then by length
+ */
+static int comparePrefix(const void *a, const void *b)
+{
+	const lpmPrefix_t *pa = *(const lpmPrefix_t**)a;
+	const lpmPrefix_t *pb = *(const lpmPrefix_t**)b;
+	int diff;
+
+	diff = pa->key[0] - pb->key[0];
+	if (!diff) {
+		diff = memcmp(pa->key + 2, pb->key + 2, LPM_MAX_DEPTH);
+	}
+	if (!diff) {
+		diff = pa->key[1] - pb->key[1];
+	}
+	return diff;
+}
+
+/**
+ * Build a node from sorted prefixes sharing the address bytes above level,
+ * prefixes not reaching into the node are ignored.
+ *
+ * @param prefixes		sorted prefixes
+ * @param count			number of prefixes
+ * @param level			level of node
+ * @param slots			scratch slots for LPM_MAX_DEPTH levels
+ * @param node			receives the node, NULL if empty
+ * @return				FALSE if allocation failed
+ */
+static bool buildNode(lpmPrefix_t **prefixes, int count, int level,
+					  lpmSlot_t *slots, lpmNode_t **node)
+{
+	lpmSlot_t *current = &slots[level * LPM_SLOTS];
+	int i, j, byte, len;
+	bool deeper;
+
+	memset(current, 0, sizeof(lpmSlot_t) * LPM_SLOTS);
+	for (i = 0; i < count; i++) {
+		len = prefixes[i]->key[1];
+		if (len > level * 8 && len <= level * 8 + 8) {
+			expandPrefix(current, prefixes[i], level);
+		}
+	}
+	for (i = 0; i < count; i = j) {
+		byte = prefixes[i]->key[2 + level];
+		deeper = FALSE;
+		for (j = i; j < count && prefixes[j]->key[2 + level] == byte; j++) {
+			deeper |= prefixes[j]->key[1] > level * 8 + 8;
+		}
+		if (deeper &&
+			!buildNode(&prefixes[i], j - i, level + 1, slots,
+					   &current[byte].child)) {
+			for (byte = 0; byte < LPM_SLOTS; byte++) {
+				destroyNode(current[byte].child);
+			}
+			return FALSE;
+		}
+	}
+	if (!compressNode(current, node)) {
+		for (byte = 0; byte < LPM_SLOTS; byte++) {
+			destroyNode(current[byte].child);
+		}
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Build tries from a set of prefixes
+ */
+static bool buildRoot(lpmSet_t *set, lpmRoot_t *root)
+{
+	lpmPrefix_t **prefixes, *prefix;
+	lpmSlot_t *slots;
+	uint32_t bucket;
+	int count = 0, start, i;
+	bool success = TRUE;
+
+	prefixes = malloc(sizeof(*prefixes) * max(set->count, 1));
+	slots = malloc(sizeof(lpmSlot_t) * LPM_SLOTS * LPM_MAX_DEPTH);
+	if (!prefixes || !slots) {
+		free(prefixes);
+		free(slots);
+		return FALSE;
+	}
+	for (bucket = 0; set->buckets && bucket <= set->mask; bucket++) {
+		for (prefix = set->buckets[bucket]; prefix; prefix = prefix->next) {
+			prefixes[count++] = prefix;
+			if (prefix->key[1] == 0) {
+				root->defaults[prefix->key[0]] = prefix->value;
+			}
+		}
+	}
+	qsort(prefixes, count, sizeof(*prefixes), comparePrefix);
+
+	for (start = 0; success && start < count; start = i) {
+		for (i = start; i < count && prefixes[i]->key[0] == prefixes[start]->key[0];
+			 i++);
+		success = buildNode(&prefixes[start], i - start, 0, slots,
+							&root->nodes[prefixes[start]->key[0]]);
+	}
+	free(slots);
+	free(prefixes);
+	return success;
+}
+
+bool hostLpmBuild(hostLpm_t *this, hostLpmEntry_t *entries, int count)
+{
+	lpmSet_t set = {};
+	lpmPrefix_t *prefix;
+	lpmRoot_t *root, *old;
+	uint8_t key[LPM_KEY_LEN];
+	uint32_t hash;
+	bool success = TRUE;
+	int i;
+
+	for (i = 0; success && i < count; i++) {
+		if (!entries[i].value ||
+			!makeKey(entries[i].net, entries[i].netbits, key)) {
+			success = FALSE;
+			break;
+		}
+		hash = keyHash(key);
+		prefix = setFind(&set, key, hash);
+		if (prefix) {
+			prefix->value = entries[i].value;
+			continue;
+		}
+		prefix = malloc(sizeof(*prefix));
+		if (!prefix) {
+			success = FALSE;
+			break;
+		}
+		memcpy(prefix->key, key, LPM_KEY_LEN);
+		prefix->hash = hash;
+		prefix->value = entries[i].value;
+		if (!setInsert(&set, prefix)) {
+			free(prefix);
+			success = FALSE;
+		}
+	}
+
+	root = calloc(1, sizeof(*root));
+	if (!success || !root || !buildRoot(&set, root)) {
+		if (root) {
+			destroyNode(root->nodes[0]);
+			destroyNode(root->nodes[1]);
+			free(root);
+		}
+		setDestroy(&set);
+		return FALSE;
+	}
+
+	pthread_mutex_lock(&this->mutex);
+	old = __atomic_exchange_n(&this->root, root, __ATOMIC_ACQ_REL);
+	epochSynchronize(this->epoch);
+	setDestroy(&this->set);
+	this->set = set;
+	pthread_mutex_unlock(&this->mutex);
+
+	destroyNode(old->nodes[0]);
+	destroyNode(old->nodes[1]);
+	free(old);
+	return TRUE;
+}
+
+/**
+ * Look up an address of the given family index
+ */
+static void *lookup(hostLpm_t *this, int idx, const uint8_t *address)
+{
+	const lpmNode_t *node;
+	lpmRoot_t *root;
+	lpmLeaf_t *leaf;
+	void *value;
+	int i;
+
+	epochEnter(this->epoch);
+	root = __atomic_load_n(&this->root, __ATOMIC_ACQUIRE);
+	value = root->defaults[idx];
+	node = root->nodes[idx];
+	for (i = 0; node && i < addressLen[idx]; i++) {
+		leaf = nodeLeaf(node, address[i]);
+		if (leaf->value) {
+			value = leaf->value;
+		}
+		node = nodeChild(node, address[i]);
+	}
+	epochExit(this->epoch);
+	return value;
+}
+
+void *hostLpmLookup(hostLpm_t *this, host_t *host)
+{
+	chunk_t address = hostGetAddress(host);
+
+	switch (hostGetFamily(host)) {
+		case AF_INET:
+			return address.len == 4 ? lookup(this, 0, address.ptr) : NULL;
+		case AF_INET6:
+			return address.len == 16 ? lookup(this, 1, address.ptr) : NULL;
+		default:
+			return NULL;
+	}
+}
+
+void *hostLpmLookupAddr(hostLpm_t *this, const hostAddr_t *addr)
+{
+	switch (hostAddrGetFamily(addr)) {
+		case AF_INET:
+			return lookup(this, 0, (const uint8_t*)&addr->sin.sin_addr);
+		case AF_INET6:
+			return lookup(this, 1, (const uint8_t*)&addr->sin6.sin6_addr);
+		default:
+			return NULL;
+	}
+}
+
+int hostLpmCount(hostLpm_t *this)
+{
+	int count;
+
+	pthread_mutex_lock(&this->mutex);
+	count = this->set.count;
+	pthread_mutex_unlock(&this->mutex);
+	return count;
+}
+
+hostLpm_t *hostLpmCreate()
+{
+	hostLpm_t *this;
+
+	this = calloc(1, sizeof(*this));
+	if (!this) {
+		return NULL;
+	}
+	this->root = calloc(1, sizeof(*this->root));
+	this->epoch = epochCreate();
+	if (!this->root || !this->epoch) {
+		if (this->epoch) {
+			epochDestroy(this->epoch);
+		}
+		free(this->root);
+		free(this);
+		return NULL;
+	}
+	pthread_mutex_init(&this->mutex, NULL);
+	return this;
+}
+
+void hostLpmDestroy(hostLpm_t *this)
+{
+	destroyNode(this->root->nodes[0]);
+	destroyNode(this->root->nodes[1]);
+	free(this->root);
+	setDestroy(&this->set);
+	epochDestroy(this->epoch);
+	pthread_mutex_destroy(&this->mutex);
+	free(this);
+}
@@ -0,0 +1,117 @@
+#ifndef _CHELP_HOSTLPM_H
+#define _CHELP_HOSTLPM_H 1
+
+#include "host.h" /* host_t */
+#include "hostAddr.h" /* hostAddr_t */
+
+/**
+ * Longest prefix match table over IPv4 and IPv6 subnets.
+ *
+ * Subnets, e.g. as returned by hostCreateFromSubnet(), are associated with
+ * an opaque value. A lookup returns the value of the most specific subnet
+ * containing an address.
+ *
+ * Each family is stored in a multibit trie with a stride of 8 bits, shorter
+ * prefixes are expanded to all slots they cover. Nodes are compressed with
+ * bitmaps (as in Poptrie), children and runs of equal values are located
+ * with popcounts. A lookup therefore visits at most one node per address
+ * byte (4 for IPv4, 16 for IPv6) without any comparisons.
+ *
+ * Lookups are lock free and may run concurrently to updates. Updates copy
+ * the modified path of the trie, publish the new version atomically and
+ * free the old path once no reader can access it anymore (see epoch.h).
+ * Updates are serialized internally and comparatively expensive, use
+ * hostLpmBuild() to load many subnets at once.
+ *
+ * Values are not owned by the table. A value removed or replaced may still
+ * be returned by concurrent lookups until the update call returns.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct hostLpm_t hostLpm_t;
+typedef struct hostLpmEntry_t hostLpmEntry_t;
+
+/**
+ * A subnet for hostLpmBuild()
+ */
+struct hostLpmEntry_t {
+	host_t *net;		/**!< network address, host bits are ignored */
+	int netbits;		/**!< prefix length */
+	void *value;		/**!< value associated with subnet */
+};
+
+/**
+ * Create an empty table.
+ *
+ * @return				table instance
+ */
+hostLpm_t *hostLpmCreate();
+
+/**
+ * Add a subnet, replacing the value of an identical subnet.
+ *
+ * @param net			network address, host bits are ignored
+ * @param netbits		prefix length, 0 for a default route of the family
+ * @param value			value to associate, not NULL
+ * @return				FALSE if family or prefix length invalid
+ */
+bool hostLpmAdd(hostLpm_t *this, host_t *net, int netbits, void *value);
+
+/**
+ * Remove a subnet.
+ *
+ * @param net			network address, host bits are ignored
+ * @param netbits		prefix length
+ * @return				value of removed subnet, NULL if not found
+ */
+void *hostLpmRemove(hostLpm_t *this, host_t *net, int netbits);
+
+/**
+ * Replace the contents of the table by the given subnets.
+ *
+ * The new tries are built privately and published at once, which is
+ * much faster than adding the subnets one by one. If a subnet is contained
+ * more than once, the last value is used.
+ *
+ * @param entries		subnets to load
+ * @param count			number of entries
+ * @return				FALSE if an entry is invalid, table unchanged
+ */
+bool hostLpmBuild(hostLpm_t *this, hostLpmEntry_t *entries, int count);
+
+/**
+ * Find the value of the longest prefix containing an address.
+ *
+ * @param host			address to look up
+ * @return				value, NULL if no subnet matches
+ */
+void *hostLpmLookup(hostLpm_t *this, host_t *host);
+
+/**
+ * Find the value of the longest prefix containing an inline address.
+ *
+ * @param addr			address to look up
+ * @return				value, NULL if no subnet matches
+ */
+void *hostLpmLookupAddr(hostLpm_t *this, const hostAddr_t *addr);
+
+/**
+ * Get the number of subnets in the table.
+ *
+ * @return				number of subnets
+ */
+int hostLpmCount(hostLpm_t *this);
+
+/**
+ * Destroy a table, no lookups may be active.
+ */
+void hostLpmDestroy(hostLpm_t *this);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CHELP_HOSTLPM_H */
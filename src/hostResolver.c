@@ -0,0 +1,793 @@
+#include "hostResolver.h"
+
+#include <pthread.h> /* pthread_t, pthread_mutex_t, pthread_cond_t */
+#include <sys/types.h>
+#include <sys/socket.h> /* AF_UNSPEC */
+#include <netdb.h> /* getaddrinfo, freeaddrinfo */
+#include <time.h> /* clock_gettime, time_t */
+#include <errno.h> /* ETIMEDOUT */
+/* malloc, calloc, realloc, free, strdup */
+/* streq, TRUE, FALSE */
+/* chunkHashInc, chunkFromStr */
+/* hostCreateFromSockaddr, hostClone, hostDestroy */
+/* DBG1, DBG2 */
+
+typedef struct query_t query_t;
+typedef struct queryWaiter_t queryWaiter_t;
+typedef struct syncWaiter_t syncWaiter_t;
+typedef struct cacheEntry_t cacheEntry_t;
+typedef struct cacheShard_t cacheShard_t;
+
+/**
+ * A requester waiting for the result of a query
+ */
+struct queryWaiter_t {
+	hostResolverCb_t cb;	/**!< callback to invoke with the result */
+	void *data;				/**!< data to pass to cb */
+};
+
+/**
+ * A query in flight, shared by all requesters of the same (name, family)
+ */
+struct query_t {
+	char *name;					/**!< name to resolve */
+	int family;					/**!< requested address family */
+	uint32_t hash;				/**!< hash of name and family */
+	queryWaiter_t *waiters;		/**!< requesters of this query */
+	int count;					/**!< number of waiters */
+	int size;					/**!< allocated number of waiters */
+	query_t *next;				/**!< next query in flight */
+	query_t *queued;			/**!< next query in queue */
+};
+
+/**
+ * State of a blocking hostResolverResolve() call
+ */
+struct syncWaiter_t {
+	pthread_mutex_t mutex;		/**!< protects done/host */
+	pthread_cond_t cond;		/**!< signaled when done */
+	bool done;					/**!< TRUE if the result is available */
+	host_t *host;				/**!< resolved host */
+};
+
+/**
+ * A cached lookup result
+ */
+struct cacheEntry_t {
+	char *name;					/**!< resolved name */
+	int family;					/**!< requested address family */
+	uint32_t hash;				/**!< hash of name and family */
+	host_t *host;				/**!< resolved host, NULL if lookup failed */
+	time_t expires;				/**!< monotonic time the entry expires */
+	cacheEntry_t *chain;		/**!< next entry in hash bucket */
+	cacheEntry_t *prev;			/**!< more recently used entry */
+	cacheEntry_t *next;			/**!< less recently used entry */
+};
+
+/**
+ * A separately locked part of the cache
+ */
+struct cacheShard_t {
+	pthread_mutex_t mutex;		/**!< protects all fields */
+	cacheEntry_t **buckets;		/**!< hash table of entries */
+	uint32_t mask;				/**!< number of buckets - 1 */
+	cacheEntry_t *head;			/**!< most recently used entry */
+	cacheEntry_t *tail;			/**!< least recently used entry */
+	int count;					/**!< number of entries */
+	int size;					/**!< maximum number of entries */
+	int positiveTtl;			/**!< lifetime of successful lookups */
+	int negativeTtl;			/**!< lifetime of failed lookups */
+	uint64_t hits;				/**!< number of cache hits */
+	uint64_t misses;			/**!< number of cache misses */
+	uint64_t evictions;			/**!< number of evicted entries */
+};
+
+struct hostResolver_t {
+	pthread_mutex_t mutex;		/**!< protects all fields */
+	pthread_cond_t newQuery;	/**!< signaled when a query is queued */
+	pthread_cond_t threadDone;	/**!< signaled when a thread terminates */
+	query_t *queries;			/**!< queries in flight, queued or active */
+	query_t *head;				/**!< first queued query */
+	query_t *tail;				/**!< last queued query */
+	int queued;					/**!< number of queued queries */
+	int minThreads;				/**!< threads kept when idle */
+	int maxThreads;				/**!< maximum number of threads */
+	int threads;				/**!< number of running threads */
+	int busy;					/**!< number of threads resolving a query */
+	bool disabled;				/**!< TRUE if no new queries are accepted */
+	bool terminate;				/**!< TRUE if threads should exit */
+	cacheShard_t shards[HOST_RESOLVER_CACHE_SHARDS]; /**!< result cache */
+};
+
+/**
+ * Hash a (name, family) pair
+ */
+static uint32_t queryHash(char *name, int family)
+{
+	return chunkHashInc(chunkFromStr(name), family);
+}
+
+/**
+ * Find a query in flight, mutex must be held
+ */
+static query_t *findQuery(hostResolver_t *this, char *name, int family,
+						  uint32_t hash)
+{
+	query_t *query;
+
+	for (query = this->queries; query; query = query->next) {
+		if (query->hash == hash && query->family == family &&
+			streq(query->name, name)) {
+			return query;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Remove a query from the list of queries in flight, mutex must be held
+ */
+static void removeQuery(hostResolver_t *this, query_t *query)
+{
+	query_t **pos;
+
+	for (pos = &this->queries; *pos; pos = &(*pos)->next) {
+		if (*pos == query) {
+			*pos = query->next;
+			break;
+		}
+	}
+}
+
+/**
+ * Add a requester to a query, mutex must be held
+ */
+static bool addWaiter(query_t *query, hostResolverCb_t cb, void *data)
+{
+	queryWaiter_t *waiters;
+
+	if (query->count == query->size) {
+		waiters = realloc(query->waiters,
+						  sizeof(*waiters) * max(query->size * 2, 2));
+		if (!waiters) {
+			return FALSE;
+		}
+		query->waiters = waiters;
+		query->size = max(query->size * 2, 2);
+	}
+	query->waiters[query->count++] = (queryWaiter_t){
+		.cb = cb,
+		.data = data,
+	};
+	return TRUE;
+}
+
+/**
+ * Deliver the result of a query to all requesters and destroy it, mutex must
+ * not be held. Each requester gets its own copy of the result.
+ */
+static void completeQuery(query_t *query, host_t *host)
+{
+	int i;
+
+	for (i = 0; i < query->count; i++) {
+		if (i == query->count - 1) {
+			query->waiters[i].cb(query->waiters[i].data, host);
+			host = NULL;
+		} else {
+			query->waiters[i].cb(query->waiters[i].data,
+								 host ? hostClone(host) : NULL);
+		}
+	}
+	if (host) {
+		hostDestroy(host);
+	}
+	free(query->waiters);
+	free(query->name);
+	free(query);
+}
+
+/**
+ * Current monotonic time in seconds
+ */
+static time_t monotonicTime()
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec;
+}
+
+/**
+ * Get the cache shard of a hash
+ */
+static inline cacheShard_t *getShard(hostResolver_t *this, uint32_t hash)
+{
+	return &this->shards[hash % HOST_RESOLVER_CACHE_SHARDS];
+}
+
+/**
+ * Get the bucket of a hash in a shard
+ */
+static inline cacheEntry_t **getBucket(cacheShard_t *shard, uint32_t hash)
+{
+	return &shard->buckets[(hash / HOST_RESOLVER_CACHE_SHARDS) & shard->mask];
+}
+
+/**
+ * Unlink an entry from the LRU list, shard mutex must be held
+ */
+static void lruRemove(cacheShard_t *shard, cacheEntry_t *entry)
+{
+	if (entry->prev) {
+		entry->prev->next = entry->next;
+	} else {
+		shard->head = entry->next;
+	}
+	if (entry->next) {
+		entry->next->prev = entry->prev;
+	} else {
+		shard->tail = entry->prev;
+	}
+}
+
+/**
+ * Link an entry as most recently used, shard mutex must be held
+ */
+static void lruPush(cacheShard_t *shard, cacheEntry_t *entry)
+{
+	entry->prev = NULL;
+	entry->next = shard->head;
+	if (shard->head) {
+		shard->head->prev = entry;
+	} else {
+		shard->tail = entry;
+	}
+	shard->head = entry;
+}
+
+/**
+ * Remove an entry from the shard and destroy it, shard mutex must be held
+ */
+static void removeEntry(cacheShard_t *shard, cacheEntry_t *entry)
+{
+	cacheEntry_t **pos;
+
+	for (pos = getBucket(shard, entry->hash); *pos; pos = &(*pos)->chain) {
+		if (*pos == entry) {
+			*pos = entry->chain;
+			break;
+		}
+	}
+	lruRemove(shard, entry);
+	shard->count--;
+	if (entry->host) {
+		hostDestroy(entry->host);
+	}
+	free(entry->name);
+	free(entry);
+}
+
+/**
+ * Find a cached entry, shard mutex must be held
+ */
+static cacheEntry_t *findEntry(cacheShard_t *shard, char *name, int family,
+							   uint32_t hash)
+{
+	cacheEntry_t *entry;
+
+	if (!shard->buckets) {
+		return NULL;
+	}
+	for (entry = *getBucket(shard, hash); entry; entry = entry->chain) {
+		if (entry->hash == hash && entry->family == family &&
+			streq(entry->name, name)) {
+			return entry;
+		}
+	}
+	return NULL;
+}
+
+/**
+ * Look up a cached result, returns FALSE if none is cached. On success,
+ * host receives a copy of the cached host, or NULL for a failed lookup.
+ */
+static bool cacheLookup(hostResolver_t *this, char *name, int family,
+						uint32_t hash, host_t **host)
+{
+	cacheShard_t *shard = getShard(this, hash);
+	cacheEntry_t *entry;
+	bool found = FALSE;
+
+	pthread_mutex_lock(&shard->mutex);
+	entry = findEntry(shard, name, family, hash);
+	if (entry && entry->expires <= monotonicTime()) {
+		removeEntry(shard, entry);
+		entry = NULL;
+	}
+	if (entry) {
+		lruRemove(shard, entry);
+		lruPush(shard, entry);
+		*host = entry->host ? hostClone(entry->host) : NULL;
+		shard->hits++;
+		found = TRUE;
+	} else {
+		shard->misses++;
+	}
+	pthread_mutex_unlock(&shard->mutex);
+	return found;
+}
+
+/**
+ * Cache the result of a lookup, host is copied
+ */
+static void cacheStore(hostResolver_t *this, char *name, int family,
+					   uint32_t hash, host_t *host)
+{
+	cacheShard_t *shard = getShard(this, hash);
+	cacheEntry_t *entry, **bucket;
+	int ttl;
+
+	pthread_mutex_lock(&shard->mutex);
+	ttl = host ? shard->positiveTtl : shard->negativeTtl;
+	if (!shard->size || ttl <= 0) {
+		pthread_mutex_unlock(&shard->mutex);
+		return;
+	}
+	entry = findEntry(shard, name, family, hash);
+	if (entry) {
+		removeEntry(shard, entry);
+	}
+	entry = calloc(1, sizeof(*entry));
+	if (!entry || !(entry->name = strdup(name))) {
+		pthread_mutex_unlock(&shard->mutex);
+		free(entry);
+		return;
+	}
+	entry->family = family;
+	entry->hash = hash;
+	entry->host = host ? hostClone(host) : NULL;
+	entry->expires = monotonicTime() + ttl;
+
+	while (shard->count >= shard->size) {
+		removeEntry(shard, shard->tail);
+		shard->evictions++;
+	}
+	bucket = getBucket(shard, hash);
+	entry->chain = *bucket;
+	*bucket = entry;
+	lruPush(shard, entry);
+	shard->count++;
+	pthread_mutex_unlock(&shard->mutex);
+}
+
+/**
+ * Remove all cached entries of a shard, shard mutex must be held
+ */
+static void flushShard(cacheShard_t *shard)
+{
+	while (shard->tail) {
+		removeEntry(shard, shard->tail);
+	}
+}
+
+/**
+ * Resize a shard, shard mutex must be held
+ */
+static void resizeShard(cacheShard_t *shard, int size)
+{
+	cacheEntry_t **buckets, *entry, **bucket;
+	uint32_t count = 1;
+
+	while (shard->count > size) {
+		removeEntry(shard, shard->tail);
+		shard->evictions++;
+	}
+	shard->size = size;
+
+	while (count < size) {
+		count <<= 1;
+	}
+	if (shard->buckets && count == shard->mask + 1) {
+		return;
+	}
+	buckets = calloc(count, sizeof(*buckets));
+	if (!buckets) {
+		if (!shard->buckets) {
+			shard->size = 0;
+		}
+		return;
+	}
+	free(shard->buckets);
+	shard->buckets = buckets;
+	shard->mask = count - 1;
+	for (entry = shard->head; entry; entry = entry->next) {
+		bucket = getBucket(shard, entry->hash);
+		entry->chain = *bucket;
+		*bucket = entry;
+	}
+}
+
+/**
+ * Resolve a name with getaddrinfo(3), may block for a long time
+ */
+static host_t *resolveName(char *name, int family)
+{
+	struct addrinfo hints = {
+		.ai_family = family,
+	}, *result;
+	host_t *host = NULL;
+	int error;
+
+	error = getaddrinfo(name, NULL, &hints, &result);
+	if (error != 0) {
+		DBG1(DBG_LIB, "resolving '%s' failed: %s", name, gai_strerror(error));
+		return NULL;
+	}
+	/* result is a linked list, but we use only the first address */
+	host = hostCreateFromSockaddr(result->ai_addr);
+	freeaddrinfo(result);
+	return host;
+}
+
+/**
+ * Remove the first query from the queue, mutex must be held
+ */
+static query_t *dequeue(hostResolver_t *this)
+{
+	query_t *query = this->head;
+
+	if (query) {
+		this->head = query->queued;
+		if (!this->head) {
+			this->tail = NULL;
+		}
+		query->queued = NULL;
+		this->queued--;
+	}
+	return query;
+}
+
+/**
+ * Wait for a queued query, returns FALSE if the thread should terminate.
+ * Mutex must be held.
+ */
+static bool waitForQuery(hostResolver_t *this)
+{
+	struct timespec timeout;
+
+	while (!this->head) {
+		if (this->terminate || this->threads > this->maxThreads) {
+			return FALSE;
+		}
+		clock_gettime(CLOCK_REALTIME, &timeout);
+		timeout.tv_sec += HOST_RESOLVER_IDLE_TIMEOUT;
+		if (pthread_cond_timedwait(&this->newQuery, &this->mutex,
+								   &timeout) == ETIMEDOUT &&
+			!this->head && this->threads > this->minThreads) {
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+/**
+ * Resolver thread
+ */
+static void *resolveHosts(void *arg)
+{
+	hostResolver_t *this = arg;
+	query_t *query;
+	host_t *host;
+
+	pthread_mutex_lock(&this->mutex);
+	while (waitForQuery(this)) {
+		if (this->busy >= this->maxThreads) {
+			/* limit was lowered, leave the query to another thread */
+			break;
+		}
+		query = dequeue(this);
+		this->busy++;
+		pthread_mutex_unlock(&this->mutex);
+
+		host = resolveName(query->name, query->family);
+		cacheStore(this, query->name, query->family, query->hash, host);
+
+		pthread_mutex_lock(&this->mutex);
+		this->busy--;
+		/* requesters arriving from now on start a new query */
+		removeQuery(this, query);
+		pthread_mutex_unlock(&this->mutex);
+
+		completeQuery(query, host);
+
+		pthread_mutex_lock(&this->mutex);
+	}
+	this->threads--;
+	pthread_cond_broadcast(&this->threadDone);
+	pthread_mutex_unlock(&this->mutex);
+	return NULL;
+}
+
+/**
+ * Start a new resolver thread, mutex must be held
+ */
+static bool startThread(hostResolver_t *this)
+{
+	pthread_attr_t attr;
+	pthread_t thread;
+	bool success;
+
+	pthread_attr_init(&attr);
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	success = pthread_create(&thread, &attr, resolveHosts, this) == 0;
+	pthread_attr_destroy(&attr);
+	if (!success) {
+		DBG1(DBG_LIB, "failed to create host resolver thread");
+		return FALSE;
+	}
+	this->threads++;
+	return TRUE;
+}
+
+/**
+ * Start threads until there is an idle thread for each queued query or the
+ * limit is reached, mutex must be held
+ */
+static void spawnThreads(hostResolver_t *this)
+{
+	while (this->queued > this->threads - this->busy &&
+		   this->threads < this->maxThreads) {
+		if (!startThread(this)) {
+			break;
+		}
+	}
+}
+
+void hostResolverResolveAsync(hostResolver_t *this, char *name, int family,
+							  hostResolverCb_t cb, void *data)
+{
+	query_t *query;
+	host_t *host;
+	uint32_t hash;
+
+	if (__atomic_load_n(&this->disabled, __ATOMIC_RELAXED)) {
+		cb(data, NULL);
+		return;
+	}
+	hash = queryHash(name, family);
+	if (cacheLookup(this, name, family, hash, &host)) {
+		cb(data, host);
+		return;
+	}
+
+	pthread_mutex_lock(&this->mutex);
+	if (this->disabled) {
+		pthread_mutex_unlock(&this->mutex);
+		cb(data, NULL);
+		return;
+	}
+	query = findQuery(this, name, family, hash);
+	if (query) {
+		if (!addWaiter(query, cb, data)) {
+			pthread_mutex_unlock(&this->mutex);
+			cb(data, NULL);
+			return;
+		}
+		DBG2(DBG_LIB, "joining query for '%s' already in flight", name);
+		pthread_mutex_unlock(&this->mutex);
+		return;
+	}
+
+	query = calloc(1, sizeof(*query));
+	if (!query || !(query->name = strdup(name)) ||
+		!addWaiter(query, cb, data)) {
+		pthread_mutex_unlock(&this->mutex);
+		if (query) {
+			free(query->name);
+			free(query);
+		}
+		cb(data, NULL);
+		return;
+	}
+	query->family = family;
+	query->hash = hash;
+	query->next = this->queries;
+	this->queries = query;
+	if (this->tail) {
+		this->tail->queued = query;
+	} else {
+		this->head = query;
+	}
+	this->tail = query;
+	this->queued++;
+
+	spawnThreads(this);
+	if (!this->threads) {
+		/* no thread to resolve it, fail instead of waiting forever */
+		dequeue(this);
+		removeQuery(this, query);
+		pthread_mutex_unlock(&this->mutex);
+		completeQuery(query, NULL);
+		return;
+	}
+	pthread_cond_signal(&this->newQuery);
+	pthread_mutex_unlock(&this->mutex);
+}
+
+/**
+ * Callback of a blocking query
+ */
+static void syncDone(void *data, host_t *host)
+{
+	syncWaiter_t *waiter = data;
+
+	pthread_mutex_lock(&waiter->mutex);
+	waiter->host = host;
+	waiter->done = TRUE;
+	pthread_cond_signal(&waiter->cond);
+	pthread_mutex_unlock(&waiter->mutex);
+}
+
+host_t *hostResolverResolve(hostResolver_t *this, char *name, int family)
+{
+	syncWaiter_t waiter = {
+		.done = FALSE,
+	};
+	host_t *host;
+
+	pthread_mutex_init(&waiter.mutex, NULL);
+	pthread_cond_init(&waiter.cond, NULL);
+
+	hostResolverResolveAsync(this, name, family, syncDone, &waiter);
+
+	pthread_mutex_lock(&waiter.mutex);
+	while (!waiter.done) {
+		pthread_cond_wait(&waiter.cond, &waiter.mutex);
+	}
+	host = waiter.host;
+	pthread_mutex_unlock(&waiter.mutex);
+
+	pthread_cond_destroy(&waiter.cond);
+	pthread_mutex_destroy(&waiter.mutex);
+	return host;
+}
+
+void hostResolverSetMaxThreads(hostResolver_t *this, int maxThreads)
+{
+	pthread_mutex_lock(&this->mutex);
+	this->maxThreads = max(maxThreads, 1);
+	this->minThreads = min(this->minThreads, this->maxThreads);
+	spawnThreads(this);
+	/* wake up idle threads exceeding the limit, they terminate */
+	pthread_cond_broadcast(&this->newQuery);
+	pthread_mutex_unlock(&this->mutex);
+}
+
+void hostResolverSetCache(hostResolver_t *this, int size, int positiveTtl,
+						  int negativeTtl)
+{
+	cacheShard_t *shard;
+	int i;
+
+	size = max(size, 0);
+	for (i = 0; i < HOST_RESOLVER_CACHE_SHARDS; i++) {
+		shard = &this->shards[i];
+		pthread_mutex_lock(&shard->mutex);
+		/* distribute the size, rounded up to not disable small caches */
+		resizeShard(shard, (size + HOST_RESOLVER_CACHE_SHARDS - 1) /
+													HOST_RESOLVER_CACHE_SHARDS);
+		shard->positiveTtl = positiveTtl;
+		shard->negativeTtl = negativeTtl;
+		pthread_mutex_unlock(&shard->mutex);
+	}
+}
+
+void hostResolverGetStats(hostResolver_t *this, hostResolverStats_t *stats)
+{
+	cacheShard_t *shard;
+	int i;
+
+	*stats = (hostResolverStats_t){};
+	for (i = 0; i < HOST_RESOLVER_CACHE_SHARDS; i++) {
+		shard = &this->shards[i];
+		pthread_mutex_lock(&shard->mutex);
+		stats->hits += shard->hits;
+		stats->misses += shard->misses;
+		stats->evictions += shard->evictions;
+		stats->entries += shard->count;
+		pthread_mutex_unlock(&shard->mutex);
+	}
+}
+
+void hostResolverFlush(hostResolver_t *this)
+{
+	query_t *query, *canceled = NULL;
+	cacheShard_t *shard;
+	int i;
+
+	pthread_mutex_lock(&this->mutex);
+	while ((query = dequeue(this))) {
+		removeQuery(this, query);
+		query->queued = canceled;
+		canceled = query;
+	}
+	__atomic_store_n(&this->disabled, TRUE, __ATOMIC_RELAXED);
+	pthread_mutex_unlock(&this->mutex);
+
+	for (i = 0; i < HOST_RESOLVER_CACHE_SHARDS; i++) {
+		shard = &this->shards[i];
+		pthread_mutex_lock(&shard->mutex);
+		flushShard(shard);
+		pthread_mutex_unlock(&shard->mutex);
+	}
+
+	while (canceled) {
+		query = canceled;
+		canceled = query->queued;
+		completeQuery(query, NULL);
+	}
+}
+
+hostResolver_t *hostResolverCreateLimits(int minThreads, int maxThreads)
+{
+	hostResolver_t *this;
+	int i;
+
+	this = calloc(1, sizeof(*this));
+	if (!this) {
+		return NULL;
+	}
+	pthread_mutex_init(&this->mutex, NULL);
+	for (i = 0; i < HOST_RESOLVER_CACHE_SHARDS; i++) {
+		pthread_mutex_init(&this->shards[i].mutex, NULL);
+	}
+	hostResolverSetCache(this, HOST_RESOLVER_CACHE_SIZE,
+						 HOST_RESOLVER_POSITIVE_TTL, HOST_RESOLVER_NEGATIVE_TTL);
+	pthread_cond_init(&this->newQuery, NULL);
+	pthread_cond_init(&this->threadDone, NULL);
+	this->maxThreads = max(maxThreads, 1);
+	this->minThreads = min(max(minThreads, 0), this->maxThreads);
+
+	pthread_mutex_lock(&this->mutex);
+	while (this->threads < this->minThreads) {
+		if (!startThread(this)) {
+			break;
+		}
+	}
+	pthread_mutex_unlock(&this->mutex);
+	return this;
+}
+
+hostResolver_t *hostResolverCreate()
+{
+	return hostResolverCreateLimits(HOST_RESOLVER_MIN_THREADS,
+									HOST_RESOLVER_MAX_THREADS);
+}
+
+void hostResolverDestroy(hostResolver_t *this)
+{
+	int i;
+
+	hostResolverFlush(this);
+
+	pthread_mutex_lock(&this->mutex);
+	this->terminate = TRUE;
+	pthread_cond_broadcast(&this->newQuery);
+	/* active queries can't be interrupted, wait until they complete */
+	while (this->threads) {
+		pthread_cond_wait(&this->threadDone, &this->mutex);
+	}
+	pthread_mutex_unlock(&this->mutex);
+
+	for (i = 0; i < HOST_RESOLVER_CACHE_SHARDS; i++) {
+		/* entries stored by queries completing after the flush */
+		flushShard(&this->shards[i]);
+		free(this->shards[i].buckets);
+		pthread_mutex_destroy(&this->shards[i].mutex);
+	}
+	pthread_cond_destroy(&this->threadDone);
+	pthread_cond_destroy(&this->newQuery);
+	pthread_mutex_destroy(&this->mutex);
+	free(this);
+}
@@ -5,19 +5,99 @@
  * Resolve hosts by DNS name but do so in the separate thread
  * (calling getaddrinfo(3) directly might block indefinitely,
  * or at least a very long time if no DNS servers are reachable)
+ *
+ * Queries are resolved by a bounded number of resolver threads, created on
+ * demand and terminated when idle. Identical queries (same name and family)
+ * are coalesced while in flight, so all requesters get the result of a
+ * single lookup. Results are either delivered to a callback, or waited for
+ * by hostResolverResolve().
+ *
+ * Results are kept in an LRU cache keyed by (name, family), successful
+ * lookups for HOST_RESOLVER_POSITIVE_TTL, failed lookups for the shorter
+ * HOST_RESOLVER_NEGATIVE_TTL. The cache is split into shards with separate
+ * locks, so concurrent lookups of different names don't contend.
  */
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+/**
+ * Default maximum number of concurrent resolver threads
+ */
+#define HOST_RESOLVER_MAX_THREADS 3
+
+/**
+ * Default minimum number of resolver threads kept when idle
+ */
+#define HOST_RESOLVER_MIN_THREADS 0
+
+/**
+ * Time in seconds after which idle resolver threads terminate
+ */
+#define HOST_RESOLVER_IDLE_TIMEOUT 30
+
+/**
+ * Default maximum number of cached results
+ */
+#define HOST_RESOLVER_CACHE_SIZE 1024
+
+/**
+ * Number of independently locked cache shards
+ */
+#define HOST_RESOLVER_CACHE_SHARDS 16
+
+/**
+ * Default time in seconds a successful lookup is cached
+ */
+#define HOST_RESOLVER_POSITIVE_TTL 300
+
+/**
+ * Default time in seconds a failed lookup is cached
+ */
+#define HOST_RESOLVER_NEGATIVE_TTL 10
+
 typedef struct hostResolver_t hostResolver_t;
+typedef struct hostResolverStats_t hostResolverStats_t;
+
+/**
+ * Cache statistics of a host resolver
+ */
+struct hostResolverStats_t {
+	uint64_t hits;			/**!< lookups answered from the cache */
+	uint64_t misses;		/**!< lookups not found or expired in the cache */
+	uint64_t evictions;		/**!< entries removed to make room */
+	uint32_t entries;		/**!< number of currently cached entries */
+};
+
+/**
+ * Callback invoked with the result of an asynchronous query.
+ *
+ * The callback is invoked by a resolver thread, or by the thread calling
+ * hostResolverFlush() for canceled queries. It is invoked synchronously by
+ * the thread calling hostResolverResolveAsync() if the result is cached,
+ * the resolver has been flushed or the query could not be started. The
+ * caller must therefore not hold locks the callback acquires.
+ *
+ * @param data		data passed to hostResolverResolveAsync()
+ * @param host		resolved host (owned by callback), NULL if failed or
+ *					canceled
+ */
+typedef void (*hostResolverCb_t)(void *data, host_t *host);
 
 /**
  * Create host resolver
  */
 hostResolver_t *hostResolverCreate();
 
+/**
+ * Create host resolver with custom thread limits
+ *
+ * @param minThreads	number of threads kept when idle
+ * @param maxThreads	maximum number of concurrent queries
+ */
+hostResolver_t *hostResolverCreateLimits(int minThreads, int maxThreads);
+
 /**
  * Resolve host from the given DNS name
  *
@@ -28,7 +108,54 @@ hostResolver_t *hostResolverCreate();
 host_t *hostResolverResolve(hostResolver_t *this, char *name, int family);
 
 /**
- * Flush the queue of queries. No new queries will be accepted afterwards
+ * Resolve host from the given DNS name, without waiting for the result.
+ *
+ * If the result is cached, the callback is invoked immediately with it.
+ * If the resolver has been flushed or the query can't be started, the
+ * callback is invoked immediately with NULL.
+ *
+ * @param name		name to lookup
+ * @param family	requested address family
+ * @param cb		callback to invoke with the result
+ * @param data		data to pass to cb
+ */
+void hostResolverResolveAsync(hostResolver_t *this, char *name, int family,
+							  hostResolverCb_t cb, void *data);
+
+/**
+ * Set the maximum number of concurrent queries.
+ *
+ * @param maxThreads	maximum number of resolver threads
+ */
+void hostResolverSetMaxThreads(hostResolver_t *this, int maxThreads);
+
+/**
+ * Configure the result cache.
+ *
+ * Reducing the size evicts least recently used entries, the new TTLs apply
+ * to results cached afterwards.
+ *
+ * @param size			maximum number of cached results, 0 to disable
+ * @param positiveTtl	time in seconds successful lookups are cached
+ * @param negativeTtl	time in seconds failed lookups are cached, 0 to
+ *						not cache failures
+ */
+void hostResolverSetCache(hostResolver_t *this, int size, int positiveTtl,
+						  int negativeTtl);
+
+/**
+ * Get cache statistics.
+ *
+ * Counters are updated without synchronization between shards, the
+ * returned values are therefore only approximately consistent.
+ *
+ * @param stats			receives the statistics
+ */
+void hostResolverGetStats(hostResolver_t *this, hostResolverStats_t *stats);
+
+/**
+ * Flush the queue of queries and all cached results. No new queries will be
+ * accepted afterwards
  */
 void hostResolverFlush(hostResolver_t *this);
 
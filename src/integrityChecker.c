@@ -1,13 +1,32 @@
 #include "integrityChecker.h"
 #include "chunk.h"
 
+#include <fcntl.h> /* open, posix_fadvise */
+#include <unistd.h> /* read, close */
+#include <errno.h> /* errno, EINTR */
 /* streq, strerror */
+/* malloc, calloc, free */
 
 struct integrityChecker_t 
 {
 	integrityChecksum_t *checksums;	/**!< checksum array */
 	int32_t checksumCount;			/**!< number of checksums in array */
-}
+};
+
+/**
+ * Size of blocks read to hash a file
+ */
+#define READ_BLOCK_LEN 65536
+
+typedef struct checkJob_t checkJob_t;
+
+/**
+ * Job checking a single file
+ */
+struct checkJob_t {
+	integrityChecker_t *this;		/**!< checker instance */
+	integrityCheckerFile_t *file;	/**!< file to check */
+};
 
 integrityChecker_t *integrityCheckerCreate(char *checksum_library)
 {
@@ -21,22 +40,49 @@ void integrityCheckerDestroy(integrityChecker_t *this)
 	free(this);
 }
 
-uint32_t buildFile(integrityChecker_t *this, char *file, size_t *len)
+uint32_t integrityCheckerBuildFile(integrityChecker_t *this, char *file,
+								   size_t *len)
 {
-	uint32_t checksum;
-	chunk_t *contents;
+	chunkHash_t state;
+	uint8_t *buf;
+	ssize_t n;
+	size_t total = 0;
+	int fd;
 
-	contents = chunkMap(file, FALSE);
-	if (!contents) {
+	fd = open(file, O_RDONLY | O_CLOEXEC);
+	if (fd == -1) {
 		DBG1(DBG_LIB, "  opening '%s' failed: %s", file, strerror(errno));
 		return 0;
 	}
-	
-	*len = contents->len;
-	checksum = chunkHashStatic(*contents);
-	chunkUnmap(contents);
+	buf = malloc(READ_BLOCK_LEN);
+	if (!buf) {
+		close(fd);
+		return 0;
+	}
+#ifdef POSIX_FADV_SEQUENTIAL
+	/* let the kernel read ahead aggressively */
+	posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+#endif /* POSIX_FADV_SEQUENTIAL */
+
+	chunkHashInit(&state, NULL);
+	while ((n = read(fd, buf, READ_BLOCK_LEN)) != 0) {
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			DBG1(DBG_LIB, "  reading '%s' failed: %s", file, strerror(errno));
+			free(buf);
+			close(fd);
+			return 0;
+		}
+		chunkHashUpdate(&state, chunkCreate(buf, n));
+		total += n;
+	}
+	free(buf);
+	close(fd);
 
-	return checksum;
+	*len = total;
+	return chunkHashFinal(&state);
 }
 
 /**
@@ -66,7 +112,7 @@ bool integrityCheckerCheckFile(integrityChecker_t *this, char *name, char *file)
 		return FALSE;
 	}
 	
-	sum = buildFile(this, file, &len);
+	sum = integrityCheckerBuildFile(this, file, &len);
 	if (!sum) {
 		return FALSE;
 	}
@@ -86,3 +132,56 @@ bool integrityCheckerCheckFile(integrityChecker_t *this, char *name, char *file)
 	DBG2(DBG_LIB, "  valid '%s' file checksum: %08x", name, sum);
 	return TRUE;
 }
+
+/**
+ * Check a single file, run on the thread pool
+ */
+static void checkFileJob(void *data)
+{
+	checkJob_t *job = data;
+
+	job->file->valid = integrityCheckerCheckFile(job->this, job->file->name,
+												 job->file->file);
+}
+
+bool integrityCheckerCheckFiles(integrityChecker_t *this, threadPool_t *pool,
+								integrityCheckerFile_t *files, int count)
+{
+	checkJob_t *jobs;
+	void **data;
+	bool valid = TRUE;
+	int i;
+
+	for (i = 0; i < count; i++) {
+		files[i].valid = FALSE;
+	}
+	jobs = calloc(count, sizeof(*jobs));
+	data = calloc(count, sizeof(*data));
+	if (count && (!jobs || !data)) {
+		free(jobs);
+		free(data);
+		return FALSE;
+	}
+	for (i = 0; i < count; i++) {
+		jobs[i] = (checkJob_t){
+			.this = this,
+			.file = &files[i],
+		};
+		data[i] = &jobs[i];
+	}
+
+	if (pool) {
+		threadPoolRun(pool, checkFileJob, data, count);
+	} else {
+		for (i = 0; i < count; i++) {
+			checkFileJob(data[i]);
+		}
+	}
+
+	for (i = 0; i < count; i++) {
+		valid = valid && files[i].valid;
+	}
+	free(jobs);
+	free(data);
+	return valid;
+}
@@ -8,12 +8,15 @@
  * libchecksum.so to compare the checksums.
  */
 
+#include "threadPool.h" /* threadPool_t */
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 typedef struct integrityChecker_t integrityChecker_t;
 typedef struct integrityChecksum_t integrityChecksum_t;
+typedef struct integrityCheckerFile_t integrityCheckerFile_t;
 
 /**
  * Struct to hold a precalculated checksum, implemented in the checksum library.
@@ -36,7 +39,7 @@ integrityChecker_t *integrityCheckerCreate(char *checksum_library);
 /**
  * Destroy a integrityChecker_t.
  */
-void integrityCheckerDestroy(integrity_checker_t *this);
+void integrityCheckerDestroy(integrityChecker_t *this);
 
 /**
  * Check the integrity of a file on disk.
@@ -47,9 +50,35 @@ void integrityCheckerDestroy(integrity_checker_t *this);
  */
 bool integrityCheckerCheckFile(integrityChecker_t *this, char *name, char *file);
 
+/**
+ * A file to check with integrityCheckerCheckFiles()
+ */
+struct integrityCheckerFile_t {
+	char *name;			/**!< name to lookup checksum */
+	char *file;			/**!< path to file */
+	bool valid;			/**!< set to TRUE if integrity tested successfully */
+};
+
+/**
+ * Check the integrity of many files on disk in parallel.
+ *
+ * Each file is hashed by a job on the thread pool, so checking a set of
+ * libraries at startup is bound by I/O rather than a single CPU.
+ *
+ * @param pool		thread pool to check files on, NULL to check serially
+ * @param files		files to check, valid is set for each
+ * @param count		number of files
+ * @return			TRUE if the integrity of all files tested successfully
+ */
+bool integrityCheckerCheckFiles(integrityChecker_t *this, threadPool_t *pool,
+								integrityCheckerFile_t *files, int count);
+
 /**
  * Build the integrity checksum of a file on disk.
  *
+ * The file is read sequentially in blocks and hashed incrementally, the
+ * checksum equals chunkHashStatic() of the file contents.
+ *
  * @param file		path to file
  * @param len		return length in bytes of file
  * @return			checksum, 0 on error
@@ -0,0 +1,525 @@
+#include "chunk.h"
+#include "message.h"
+#include "messageBuilder.h"
+
+#include <stdarg.h> /* va_list, va_start, va_arg, va_copy, va_end */
+#include <sys/uio.h> /* struct iovec */
+#include <errno.h> /* errno */
+/* malloc, realloc, free */
+/* memcpy, strlen, strerror */
+/* vsnprintf */
+/* DBG1 */
+
+/**
+ * Initial size of the heap buffer
+ */
+#define BUILDER_INITIAL_SIZE 512
+
+/**
+ * Default size of the buffer of a streaming builder
+ */
+#define BUILDER_STREAM_SIZE 16384
+
+/**
+ * Values of at least this size get written without copying in stream mode
+ */
+#define BUILDER_DIRECT_SIZE 1024
+
+/**
+ * Destination of the encoding
+ */
+typedef enum {
+	BUILDER_HEAP,		/**!< growing heap buffer, finalized to msg_t */
+	BUILDER_MEASURE,	/**!< count bytes only */
+	BUILDER_IOV,		/**!< caller supplied iovec chain */
+	BUILDER_FD,			/**!< bounded buffer, flushed to a file descriptor */
+} builderMode_t;
+
+struct msgBuilder_t {
+	builderMode_t mode;		/**!< where the encoding is written to */
+	uint8_t *buf;			/**!< heap or stream buffer */
+	size_t size;			/**!< size of buf */
+	size_t used;			/**!< bytes used in buf */
+	struct iovec *iov;		/**!< caller supplied buffers */
+	int iovCount;			/**!< number of caller supplied buffers */
+	int iovCurrent;			/**!< buffer currently written to */
+	size_t iovUsed;			/**!< bytes used in current buffer */
+	int fd;					/**!< file descriptor to stream to */
+	size_t total;			/**!< bytes encoded */
+	uint32_t section;		/**!< current section nesting level */
+	bool list;				/**!< currently in a list */
+	bool error;				/**!< an error occurred */
+};
+
+/**
+ * Flush the stream buffer, followed by optional data written from its origin
+ */
+static bool flushWith(msgBuilder_t *this, chunk_t data)
+{
+	struct iovec iov[2];
+	int count = 0;
+
+	if (this->used) {
+		iov[count++] = (struct iovec) {
+			.iov_base = this->buf,
+			.iov_len = this->used,
+		};
+	}
+	if (data.len) {
+		iov[count++] = (struct iovec) {
+			.iov_base = data.ptr,
+			.iov_len = data.len,
+		};
+	}
+	this->used = 0;
+	if (!chunkWritev(this->fd, iov, count)) {
+		DBG1(DBG_LIB, "writing message failed: %s", strerror(errno));
+		this->error = TRUE;
+	}
+	return !this->error;
+}
+
+/**
+ * Get a pointer to len contiguous bytes in the destination, NULL if none
+ */
+static uint8_t *reserve(msgBuilder_t *this, size_t len)
+{
+	switch (this->mode) {
+		case BUILDER_HEAP:
+			if (this->size - this->used < len) {
+				while (this->size - this->used < len) {
+					this->size *= 2;
+				}
+				this->buf = realloc(this->buf, this->size);
+			}
+			return this->buf + this->used;
+		case BUILDER_FD:
+			if (this->size - this->used < len && len <= this->size) {
+				flushWith(this, ChunkEmpty);
+			}
+			if (this->size - this->used < len) {
+				return NULL;
+			}
+			return this->buf + this->used;
+		case BUILDER_IOV:
+			while (this->iovCurrent < this->iovCount &&
+				   this->iov[this->iovCurrent].iov_len == this->iovUsed) {
+				this->iovCurrent++;
+				this->iovUsed = 0;
+			}
+			if (this->iovCurrent == this->iovCount ||
+				this->iov[this->iovCurrent].iov_len - this->iovUsed < len) {
+				return NULL;
+			}
+			return (uint8_t*)this->iov[this->iovCurrent].iov_base +
+					this->iovUsed;
+		case BUILDER_MEASURE:
+		default:
+			return NULL;
+	}
+}
+
+/**
+ * Mark len bytes written to memory returned by reserve()
+ */
+static void commit(msgBuilder_t *this, size_t len)
+{
+	switch (this->mode) {
+		case BUILDER_HEAP:
+		case BUILDER_FD:
+			this->used += len;
+			break;
+		case BUILDER_IOV:
+			this->iovUsed += len;
+			break;
+		case BUILDER_MEASURE:
+		default:
+			break;
+	}
+	this->total += len;
+}
+
+/**
+ * Append data to the encoding
+ */
+static void put(msgBuilder_t *this, const void *data, size_t len)
+{
+	const uint8_t *pos = data;
+	uint8_t *dst;
+	size_t part;
+
+	if (this->error || !len) {
+		return;
+	}
+	if (this->mode == BUILDER_FD && len >= BUILDER_DIRECT_SIZE) {
+		/* write large values directly, without copying */
+		flushWith(this, chunkCreate((uint8_t*)data, len));
+		this->total += len;
+		return;
+	}
+	dst = reserve(this, len);
+	if (dst) {
+		memcpy(dst, data, len);
+		commit(this, len);
+		return;
+	}
+	switch (this->mode) {
+		case BUILDER_MEASURE:
+			this->total += len;
+			return;
+		case BUILDER_FD:
+			while (len && !this->error) {
+				if (this->used == this->size) {
+					flushWith(this, ChunkEmpty);
+				}
+				part = min(len, this->size - this->used);
+				memcpy(this->buf + this->used, pos, part);
+				commit(this, part);
+				pos += part;
+				len -= part;
+			}
+			return;
+		case BUILDER_IOV:
+			/* spread data over the remaining buffers */
+			while (len) {
+				if (!reserve(this, 1)) {
+					DBG1(DBG_LIB, "message exceeds supplied buffers");
+					this->error = TRUE;
+					return;
+				}
+				part = min(len, this->iov[this->iovCurrent].iov_len -
+								this->iovUsed);
+				memcpy((uint8_t*)this->iov[this->iovCurrent].iov_base +
+					   this->iovUsed, pos, part);
+				commit(this, part);
+				pos += part;
+				len -= part;
+			}
+			return;
+		case BUILDER_HEAP:
+		default:
+			return;
+	}
+}
+
+/**
+ * Append a single byte
+ */
+static inline void putByte(msgBuilder_t *this, uint8_t val)
+{
+	put(this, &val, 1);
+}
+
+/**
+ * Append a name, prefixed with its 8-bit length
+ */
+static void putName(msgBuilder_t *this, char *name)
+{
+	size_t len = strlen(name);
+
+	if (len > UINT8_MAX) {
+		DBG1(DBG_LIB, "message name '%s' too long", name);
+		this->error = TRUE;
+		return;
+	}
+	putByte(this, len);
+	put(this, name, len);
+}
+
+/**
+ * Append a value, prefixed with its 16-bit length
+ */
+static void putValue(msgBuilder_t *this, chunk_t value)
+{
+	uint8_t len[2];
+
+	if (value.len > UINT16_MAX) {
+		DBG1(DBG_LIB, "message value too long: %zu bytes", value.len);
+		this->error = TRUE;
+		return;
+	}
+	len[0] = value.len >> 8;
+	len[1] = value.len & 0xff;
+	put(this, len, sizeof(len));
+	put(this, value.ptr, value.len);
+}
+
+/**
+ * Check and track the nesting of the added element
+ */
+static bool verifyType(msgBuilder_t *this, msgType_t type)
+{
+	if (this->error) {
+		return FALSE;
+	}
+	if (!msgVerifyType(type, this->section, this->list)) {
+		this->error = TRUE;
+		return FALSE;
+	}
+	switch (type) {
+		case MSG_SECTION_START:
+			this->section++;
+			break;
+		case MSG_SECION_END:
+			this->section--;
+			break;
+		case MSG_LIST_START:
+			this->list = TRUE;
+			break;
+		case MSG_LIST_END:
+			this->list = FALSE;
+			break;
+		default:
+			break;
+	}
+	return TRUE;
+}
+
+void msgBuilderAdd(msgBuilder_t *this, msgType_t type, ...)
+{
+	va_list args;
+	char *name = NULL;
+	chunk_t value = ChunkEmpty;
+
+	va_start(args, type);
+	switch (type) {
+		case MSG_SECTION_START:
+		case MSG_LIST_START:
+			name = va_arg(args, char*);
+			break;
+		case MSG_KEY_VALUE:
+			name = va_arg(args, char*);
+			value = va_arg(args, chunk_t);
+			break;
+		case MSG_LIST_ITEM:
+			value = va_arg(args, chunk_t);
+			break;
+		case MSG_SECION_END:
+		case MSG_LIST_END:
+			break;
+		default:
+			this->error = TRUE;
+			break;
+	}
+	va_end(args);
+
+	if (!verifyType(this, type)) {
+		return;
+	}
+	putByte(this, type);
+	if (name) {
+		putName(this, name);
+	}
+	if (type == MSG_KEY_VALUE || type == MSG_LIST_ITEM) {
+		putValue(this, value);
+	}
+}
+
+/**
+ * Append a formatted value, printing directly to the destination if possible
+ */
+static void putFormatted(msgBuilder_t *this, char *fmt, va_list args)
+{
+	char stack[512], *heap = NULL;
+	uint8_t *dst;
+	size_t space;
+	va_list copy;
+	int len;
+
+	if (this->error) {
+		return;
+	}
+
+	/* try to print directly behind the length field */
+	dst = reserve(this, 2 + 1);
+	if (dst) {
+		space = this->mode == BUILDER_IOV
+					? this->iov[this->iovCurrent].iov_len - this->iovUsed
+					: this->size - this->used;
+		space = min(space, 2 + UINT16_MAX + 1);
+		va_copy(copy, args);
+		len = vsnprintf((char*)dst + 2, space - 2, fmt, copy);
+		va_end(copy);
+		if (len >= 0 && len < space - 2) {
+			dst[0] = len >> 8;
+			dst[1] = len & 0xff;
+			commit(this, 2 + len);
+			return;
+		}
+	}
+
+	/* doesn't fit, format to a temporary buffer */
+	va_copy(copy, args);
+	len = vsnprintf(stack, sizeof(stack), fmt, copy);
+	va_end(copy);
+	if (len < 0) {
+		this->error = TRUE;
+		return;
+	}
+	if (len >= sizeof(stack)) {
+		heap = malloc(len + 1);
+		len = vsnprintf(heap, len + 1, fmt, args);
+	}
+	putValue(this, chunkCreate((uint8_t*)(heap ?: stack), len));
+	free(heap);
+}
+
+void msgBuilderVaddKv(msgBuilder_t *this, char *key, char *fmt, va_list args)
+{
+	if (!verifyType(this, MSG_KEY_VALUE)) {
+		return;
+	}
+	putByte(this, MSG_KEY_VALUE);
+	putName(this, key);
+	putFormatted(this, fmt, args);
+}
+
+void msgBuilderAddKv(msgBuilder_t *this, char *key, char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	msgBuilderVaddKv(this, key, fmt, args);
+	va_end(args);
+}
+
+void msgBuilderVaddLi(msgBuilder_t *this, char *fmt, va_list args)
+{
+	if (!verifyType(this, MSG_LIST_ITEM)) {
+		return;
+	}
+	putByte(this, MSG_LIST_ITEM);
+	putFormatted(this, fmt, args);
+}
+
+void msgBuilderAddLi(msgBuilder_t *this, char *fmt, ...)
+{
+	va_list args;
+
+	va_start(args, fmt);
+	msgBuilderVaddLi(this, fmt, args);
+	va_end(args);
+}
+
+void msgBuilderBeginSection(msgBuilder_t *this, char *name)
+{
+	msgBuilderAdd(this, MSG_SECTION_START, name);
+}
+
+void msgBuilderEndSection(msgBuilder_t *this)
+{
+	msgBuilderAdd(this, MSG_SECION_END);
+}
+
+void msgBuilderBeginList(msgBuilder_t *this, char *name)
+{
+	msgBuilderAdd(this, MSG_LIST_START, name);
+}
+
+void msgBuilderEndList(msgBuilder_t *this)
+{
+	msgBuilderAdd(this, MSG_LIST_END);
+}
+
+size_t msgBuilderGetLength(msgBuilder_t *this)
+{
+	return this->total;
+}
+
+bool msgBuilderFlush(msgBuilder_t *this)
+{
+	if (this->mode != BUILDER_FD || this->error) {
+		return !this->error;
+	}
+	return flushWith(this, ChunkEmpty);
+}
+
+msg_t* msgBuilderFinalize(msgBuilder_t *this)
+{
+	msg_t *product = NULL;
+
+	if (this->mode != BUILDER_HEAP) {
+		DBG1(DBG_LIB, "streaming message builder can't be finalized to msg_t");
+	} else if (this->error || this->section || this->list) {
+		DBG1(DBG_LIB, "message builder error: %u errors (section: %u, list %u)",
+			 this->error, this->section, this->list);
+	} else {
+		product = msgCreateFromData(chunkCreate(this->buf, this->used), TRUE);
+		this->buf = NULL;
+	}
+	msgBuilderDestroy(this);
+	return product;
+}
+
+bool msgBuilderFinalizeStream(msgBuilder_t *this, size_t *len)
+{
+	bool success;
+
+	if (this->section || this->list) {
+		DBG1(DBG_LIB, "message builder error: unclosed section or list");
+		this->error = TRUE;
+	}
+	success = msgBuilderFlush(this);
+	if (len) {
+		*len = this->total;
+	}
+	msgBuilderDestroy(this);
+	return success;
+}
+
+/**
+ * Create a builder writing to the given destination
+ */
+static msgBuilder_t *createBuilder(builderMode_t mode, size_t size)
+{
+	msgBuilder_t *this = (msgBuilder_t *)calloc(1, sizeof(*this));
+
+	this->mode = mode;
+	this->fd = -1;
+	if (size) {
+		this->size = size;
+		this->buf = malloc(size);
+	}
+	return this;
+}
+
+msgBuilder_t *msgBuilderCreate()
+{
+	return createBuilder(BUILDER_HEAP, BUILDER_INITIAL_SIZE);
+}
+
+msgBuilder_t *msgBuilderCreateReserved(size_t len)
+{
+	return createBuilder(BUILDER_HEAP, max(len, 1));
+}
+
+msgBuilder_t *msgBuilderCreateMeasure()
+{
+	return createBuilder(BUILDER_MEASURE, 0);
+}
+
+msgBuilder_t *msgBuilderCreateIov(struct iovec *iov, int count)
+{
+	msgBuilder_t *this = createBuilder(BUILDER_IOV, 0);
+
+	this->iov = iov;
+	this->iovCount = count;
+	return this;
+}
+
+msgBuilder_t *msgBuilderCreateFd(int fd, size_t bufLen)
+{
+	msgBuilder_t *this;
+
+	/* a complete name element must fit to the buffer */
+	bufLen = max(bufLen ?: BUILDER_STREAM_SIZE, 2 + UINT8_MAX);
+	this = createBuilder(BUILDER_FD, bufLen);
+	this->fd = fd;
+	return this;
+}
+
+void msgBuilderDestroy(msgBuilder_t *this)
+{
+	free(this->buf);
+	free(this);
+}
@@ -1,6 +1,21 @@
 #ifndef _CHELP_MSGBUILDER_H
 #define _CHELP_MSGBUILDER_H 1
 
+#include <sys/uio.h> /* struct iovec */
+
+/**
+ * Builds a message by appending elements one by one.
+ *
+ * By default the encoding is collected in a heap buffer and turned into a
+ * msg_t by msgBuilderFinalize(). For large messages the builder can instead
+ * write the encoding directly to a caller supplied buffer or iovec chain
+ * (msgBuilderCreateIov()), or stream it to a socket in bounded pieces
+ * (msgBuilderCreateFd()), finishing with msgBuilderFinalizeStream(). As the
+ * length of the encoding must usually be sent before streaming it, the size
+ * can be determined upfront by running the same builder calls against
+ * msgBuilderCreateMeasure().
+ */
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -97,11 +112,77 @@ void msgBuilderEndList(msgBuilder_t *this);
  */
 msg_t* msgBuilderFinalize(msgBuilder_t *this);
 
+/**
+ * Finalize a streaming or measuring builder, destroy builder.
+ *
+ * For a builder created by msgBuilderCreateFd() all remaining data gets
+ * written to the file descriptor.
+ *
+ * @param len	receives the length of the complete encoding, or NULL
+ * @return		TRUE if the message was encoded completely
+ */
+bool msgBuilderFinalizeStream(msgBuilder_t *this, size_t *len);
+
+/**
+ * Write already encoded data of a streaming builder to its file descriptor.
+ *
+ * This happens automatically when the internal buffer is full, but may be
+ * called to push partially built messages out early.
+ *
+ * @return		TRUE if data written successfully
+ */
+bool msgBuilderFlush(msgBuilder_t *this);
+
+/**
+ * Get the number of bytes encoded so far.
+ *
+ * @return		length of encoding
+ */
+size_t msgBuilderGetLength(msgBuilder_t *this);
+
 /**
  * Create a msgBuilder_t instance.
  */
 msgBuilder_t *msgBuilderCreate();
 
+/**
+ * Create a msgBuilder_t instance with preallocated buffer.
+ *
+ * @param len	expected length of the encoding, e.g. from a measure builder
+ */
+msgBuilder_t *msgBuilderCreateReserved(size_t len);
+
+/**
+ * Create a msgBuilder_t instance which only counts the encoded bytes.
+ *
+ * Use msgBuilderFinalizeStream() to get the length of the encoding.
+ */
+msgBuilder_t *msgBuilderCreateMeasure();
+
+/**
+ * Create a msgBuilder_t instance writing to caller supplied memory.
+ *
+ * The encoding is written to the iovec buffers in order, filling each of
+ * them completely before continuing with the next. If the space is
+ * exhausted, the builder fails. Use a single iovec to write to a flat buffer.
+ *
+ * @param iov	buffers to write the encoding to, must outlive the builder
+ * @param count	number of elements in iov
+ */
+msgBuilder_t *msgBuilderCreateIov(struct iovec *iov, int count);
+
+/**
+ * Create a msgBuilder_t instance streaming to a file descriptor.
+ *
+ * Encoded elements are collected in a buffer of bufLen bytes, which is
+ * written with writev() whenever it is full. Large values are written
+ * directly from the caller's memory, without copying them to the buffer.
+ *
+ * @param fd		file descriptor (e.g. a socket) to write to
+ * @param bufLen	size of the internal buffer, 0 for a default
+ */
+msgBuilder_t *msgBuilderCreateFd(int fd, size_t bufLen);
+
 /**
  * Destroy a vici builder without finalization.
  *
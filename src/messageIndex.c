@@ -0,0 +1,385 @@
+#include "messageIndex.h"
+
+#include <stdarg.h> /* va_list, va_start, va_end */
+/* malloc, realloc, calloc, free, strtol */
+/* memcpy, strncasecmp */
+/* vsnprintf */
+/* TRUE, FALSE */
+
+typedef struct indexEntry_t indexEntry_t;
+
+/**
+ * A single element of the message, referencing the encoding by offsets
+ */
+struct indexEntry_t {
+	uint32_t parent;	/**!< handle of parent section/list */
+	uint32_t child;		/**!< handle of first child, 0 if none */
+	uint32_t next;		/**!< handle of next sibling, 0 if none */
+	uint32_t name;		/**!< offset of name in encoding */
+	uint32_t value;		/**!< offset of value in encoding */
+	uint16_t valueLen;	/**!< length of value */
+	uint8_t nameLen;	/**!< length of name */
+	uint8_t type;		/**!< msgType_t of the entry */
+};
+
+struct msgIndex_t {
+	chunk_t data;			/**!< encoding the index refers to */
+	indexEntry_t *entries;	/**!< entries, entries[0] is the root */
+	uint32_t count;			/**!< number of entries */
+	uint32_t *table;		/**!< hash table of named entries, 0 is empty */
+	uint32_t mask;			/**!< size of table - 1 */
+};
+
+/**
+ * Combine the hash of a name with its parent, so name hashes can be
+ * precomputed independently of where they are looked up
+ */
+static inline uint32_t hashParent(uint32_t parent, uint32_t hash)
+{
+	return hash ^ (parent * 0x9e3779b1);
+}
+
+/**
+ * Get the name of an entry as chunk
+ */
+static inline chunk_t entryName(msgIndex_t *this, indexEntry_t *entry)
+{
+	return chunkCreate(this->data.ptr + entry->name, entry->nameLen);
+}
+
+/**
+ * Add an entry to the hash table, keeping the first one on duplicates
+ */
+static void hashEntry(msgIndex_t *this, uint32_t handle)
+{
+	indexEntry_t *entry = &this->entries[handle];
+	uint32_t i, other;
+	chunk_t name;
+
+	name = entryName(this, entry);
+	for (i = hashParent(entry->parent, chunkHash(name)) & this->mask;
+		 (other = this->table[i]) != 0; i = (i + 1) & this->mask) {
+		if (this->entries[other].parent == entry->parent &&
+			chunkEquals(entryName(this, &this->entries[other]), name)) {
+			return;
+		}
+	}
+	this->table[i] = handle;
+}
+
+/**
+ * Allocate a new entry as last child of parent
+ */
+static indexEntry_t *addEntry(msgIndex_t *this, uint32_t *size,
+							  uint32_t parent, uint32_t *tail, uint8_t type)
+{
+	indexEntry_t *entry;
+
+	if (this->count == *size) {
+		*size *= 2;
+		this->entries = realloc(this->entries, *size * sizeof(indexEntry_t));
+	}
+	if (*tail) {
+		this->entries[*tail].next = this->count;
+	} else {
+		this->entries[parent].child = this->count;
+	}
+	*tail = this->count;
+
+	entry = &this->entries[this->count++];
+	*entry = (indexEntry_t) {
+		.parent = parent,
+		.type = type,
+	};
+	return entry;
+}
+
+/**
+ * Parse the encoding in a single pass, building the entries
+ */
+static bool parseEncoding(msgIndex_t *this)
+{
+	uint32_t tails[MSG_INDEX_MAX_DEPTH + 1] = { 0 };
+	uint32_t size, parent = MSG_INDEX_ROOT, depth = 0;
+	uint8_t *pos = this->data.ptr, *end = this->data.ptr + this->data.len;
+	indexEntry_t *entry;
+	bool list = FALSE;
+	uint8_t type;
+
+	/* the smallest named element takes 4 bytes, avoid most reallocs */
+	size = this->data.len / 8 + 8;
+	this->entries = malloc(size * sizeof(indexEntry_t));
+	this->entries[0] = (indexEntry_t) { .type = MSG_START };
+	this->count = 1;
+
+	while (pos < end) {
+		type = *pos++;
+		switch (type) {
+			case MSG_SECTION_START:
+			case MSG_LIST_START:
+			case MSG_KEY_VALUE:
+				if (list) {
+					return FALSE;
+				}
+				if (type != MSG_KEY_VALUE && depth == MSG_INDEX_MAX_DEPTH) {
+					return FALSE;
+				}
+				if (pos >= end || end - pos - 1 < *pos) {
+					return FALSE;
+				}
+				entry = addEntry(this, &size, parent, &tails[depth], type);
+				entry->nameLen = *pos++;
+				entry->name = pos - this->data.ptr;
+				pos += entry->nameLen;
+				if (type != MSG_KEY_VALUE) {
+					parent = this->count - 1;
+					tails[++depth] = 0;
+					list = type == MSG_LIST_START;
+					continue;
+				}
+				/* FALL */
+			case MSG_LIST_ITEM:
+				if (type == MSG_LIST_ITEM) {
+					if (!list) {
+						return FALSE;
+					}
+					entry = addEntry(this, &size, parent, &tails[depth], type);
+				}
+				if (end - pos < 2) {
+					return FALSE;
+				}
+				entry->valueLen = (pos[0] << 8) | pos[1];
+				pos += 2;
+				if (end - pos < entry->valueLen) {
+					return FALSE;
+				}
+				entry->value = pos - this->data.ptr;
+				pos += entry->valueLen;
+				continue;
+			case MSG_SECION_END:
+			case MSG_LIST_END:
+				if (depth == 0 || list != (type == MSG_LIST_END)) {
+					return FALSE;
+				}
+				parent = this->entries[parent].parent;
+				depth--;
+				list = FALSE;
+				continue;
+			default:
+				return FALSE;
+		}
+	}
+	return depth == 0;
+}
+
+msgIndex_t *msgIndexCreate(chunk_t data)
+{
+	msgIndex_t *this;
+	uint32_t i, size = 16;
+
+	if (data.len > UINT32_MAX) {
+		return NULL;
+	}
+
+	this = (msgIndex_t *)calloc(1, sizeof(*this));
+	this->data = data;
+
+	if (!parseEncoding(this)) {
+		msgIndexDestroy(this);
+		return NULL;
+	}
+
+	/* keep the load factor below 50% */
+	while (size < this->count * 2) {
+		size *= 2;
+	}
+	this->mask = size - 1;
+	this->table = calloc(size, sizeof(uint32_t));
+	for (i = 1; i < this->count; ++i) {
+		if (this->entries[i].type != MSG_LIST_ITEM) {
+			hashEntry(this, i);
+		}
+	}
+	return this;
+}
+
+uint32_t msgIndexCount(msgIndex_t *this)
+{
+	return this->count;
+}
+
+uint32_t msgIndexFind(msgIndex_t *this, uint32_t parent, chunk_t name)
+{
+	return msgIndexFindHashed(this, parent, name, chunkHash(name));
+}
+
+uint32_t msgIndexFindHashed(msgIndex_t *this, uint32_t parent, chunk_t name,
+							uint32_t hash)
+{
+	uint32_t i, handle;
+
+	for (i = hashParent(parent, hash) & this->mask;
+		 (handle = this->table[i]) != 0; i = (i + 1) & this->mask) {
+		if (this->entries[handle].parent == parent &&
+			chunkEquals(entryName(this, &this->entries[handle]), name)) {
+			return handle;
+		}
+	}
+	return MSG_INDEX_NONE;
+}
+
+msgType_t msgIndexGetType(msgIndex_t *this, uint32_t entry)
+{
+	return this->entries[entry].type;
+}
+
+chunk_t msgIndexGetName(msgIndex_t *this, uint32_t entry)
+{
+	return entryName(this, &this->entries[entry]);
+}
+
+chunk_t msgIndexGetEntryValue(msgIndex_t *this, uint32_t entry)
+{
+	return chunkCreate(this->data.ptr + this->entries[entry].value,
+					   this->entries[entry].valueLen);
+}
+
+uint32_t msgIndexFirstChild(msgIndex_t *this, uint32_t entry)
+{
+	return this->entries[entry].child;
+}
+
+uint32_t msgIndexNextSibling(msgIndex_t *this, uint32_t entry)
+{
+	return this->entries[entry].next;
+}
+
+/**
+ * Resolve a formatted path to a key/value entry
+ */
+static uint32_t vfindKey(msgIndex_t *this, char *fmt, va_list args)
+{
+	char buf[512], *pos, *dot;
+	uint32_t entry = MSG_INDEX_ROOT;
+	int len;
+
+	len = vsnprintf(buf, sizeof(buf), fmt, args);
+	if (len < 0 || len >= sizeof(buf)) {
+		return MSG_INDEX_NONE;
+	}
+
+	/* the root and "not found" share the same handle, so descend explicitly */
+	for (pos = buf; (dot = strchr(pos, '.')) != NULL; pos = dot + 1) {
+		entry = msgIndexFind(this, entry, chunkCreate((uint8_t*)pos, dot - pos));
+		if (entry == MSG_INDEX_NONE ||
+			this->entries[entry].type != MSG_SECTION_START) {
+			return MSG_INDEX_NONE;
+		}
+	}
+	entry = msgIndexFind(this, entry, chunkFromStr(pos));
+	if (entry == MSG_INDEX_NONE || this->entries[entry].type != MSG_KEY_VALUE) {
+		return MSG_INDEX_NONE;
+	}
+	return entry;
+}
+
+chunk_t msgIndexVgetValue(msgIndex_t *this, chunk_t def, char *fmt, va_list args)
+{
+	uint32_t entry;
+
+	entry = vfindKey(this, fmt, args);
+	if (entry == MSG_INDEX_NONE) {
+		return def;
+	}
+	return msgIndexGetEntryValue(this, entry);
+}
+
+chunk_t msgIndexGetValue(msgIndex_t *this, chunk_t def, char *fmt, ...)
+{
+	va_list args;
+	chunk_t value;
+
+	va_start(args, fmt);
+	value = msgIndexVgetValue(this, def, fmt, args);
+	va_end(args);
+
+	return value;
+}
+
+int msgIndexGetEntryInt(msgIndex_t *this, uint32_t entry, int def)
+{
+	char buf[32], *end;
+	chunk_t value;
+	long val;
+
+	if (entry == MSG_INDEX_NONE) {
+		return def;
+	}
+	value = msgIndexGetEntryValue(this, entry);
+	if (!value.len || value.len >= sizeof(buf)) {
+		return def;
+	}
+	memcpy(buf, value.ptr, value.len);
+	buf[value.len] = '\0';
+
+	errno = 0;
+	val = strtol(buf, &end, 0);
+	if (errno || *end || val < INT_MIN || val > INT_MAX) {
+		return def;
+	}
+	return val;
+}
+
+bool msgIndexGetEntryBool(msgIndex_t *this, uint32_t entry, bool def)
+{
+	chunk_t value;
+
+	if (entry == MSG_INDEX_NONE) {
+		return def;
+	}
+	value = msgIndexGetEntryValue(this, entry);
+
+#define VALUE_IS(str) (value.len == strlen(str) && \
+					   strncasecmp((char*)value.ptr, str, value.len) == 0)
+	if (VALUE_IS("yes") || VALUE_IS("true") ||
+		VALUE_IS("enabled") || VALUE_IS("1")) {
+		return TRUE;
+	}
+	if (VALUE_IS("no") || VALUE_IS("false") ||
+		VALUE_IS("disabled") || VALUE_IS("0")) {
+		return FALSE;
+	}
+#undef VALUE_IS
+	return def;
+}
+
+int msgIndexGetInt(msgIndex_t *this, int def, char *fmt, ...)
+{
+	va_list args;
+	uint32_t entry;
+
+	va_start(args, fmt);
+	entry = vfindKey(this, fmt, args);
+	va_end(args);
+
+	return msgIndexGetEntryInt(this, entry, def);
+}
+
+bool msgIndexGetBool(msgIndex_t *this, bool def, char *fmt, ...)
+{
+	va_list args;
+	uint32_t entry;
+
+	va_start(args, fmt);
+	entry = vfindKey(this, fmt, args);
+	va_end(args);
+
+	return msgIndexGetEntryBool(this, entry, def);
+}
+
+void msgIndexDestroy(msgIndex_t *this)
+{
+	free(this->entries);
+	free(this->table);
+	free(this);
+}
@@ -0,0 +1,194 @@
+#ifndef _CHELP_MESSAGEINDEX_H
+#define _CHELP_MESSAGEINDEX_H 1
+
+#include "chunk.h" /* chunk_t */
+#include "message.h" /* msgType_t */
+
+/**
+ * Indexed, zero-copy view of an encoded message.
+ *
+ * The message encoding is parsed once, building a compact table of offsets
+ * into the original buffer. Neither keys nor values get copied, so the
+ * encoding (e.g. a mmap()ed file or a socket receive buffer) must stay valid
+ * for the lifetime of the index.
+ *
+ * Sections, key/values, lists and list items are entries referenced by an
+ * integer handle. The message itself is the root entry MSG_INDEX_ROOT, and
+ * named entries are hashed by their parent, so looking up a key takes
+ * constant time per path segment instead of re-parsing the encoding.
+ *
+ * @note The hash table uses chunkHash(), chunkHashSeed() must be called
+ * before creating an index.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Handle of the root entry, the message itself.
+ */
+#define MSG_INDEX_ROOT 0
+
+/**
+ * Handle returned if no entry is found, never a valid child.
+ */
+#define MSG_INDEX_NONE 0
+
+/**
+ * Maximum nesting of sections and lists supported by the index.
+ */
+#define MSG_INDEX_MAX_DEPTH 64
+
+typedef struct msgIndex_t msgIndex_t;
+
+/**
+ * Create an index over an encoded message.
+ *
+ * @param data		message encoding, must outlive the index
+ * @return			index, NULL if the encoding is invalid
+ */
+msgIndex_t *msgIndexCreate(chunk_t data);
+
+/**
+ * Get the number of entries in the index, including the root.
+ *
+ * @return			number of entries
+ */
+uint32_t msgIndexCount(msgIndex_t *this);
+
+/**
+ * Find a named entry in a section.
+ *
+ * If a section contains multiple entries with the same name, the first one
+ * is returned.
+ *
+ * @param parent	handle of the section to look in
+ * @param name		name of the section, key/value or list to find
+ * @return			entry handle, MSG_INDEX_NONE if not found
+ */
+uint32_t msgIndexFind(msgIndex_t *this, uint32_t parent, chunk_t name);
+
+/**
+ * Find a named entry in a section, using a precomputed name hash.
+ *
+ * Same as msgIndexFind(), but avoids hashing the name if it is looked up
+ * repeatedly, e.g. in different sections.
+ *
+ * @param parent	handle of the section to look in
+ * @param name		name of the section, key/value or list to find
+ * @param hash		chunkHash() of name
+ * @return			entry handle, MSG_INDEX_NONE if not found
+ */
+uint32_t msgIndexFindHashed(msgIndex_t *this, uint32_t parent, chunk_t name,
+							uint32_t hash);
+
+/**
+ * Get the type of an entry.
+ *
+ * @param entry		entry handle
+ * @return			MSG_SECTION_START, MSG_KEY_VALUE, MSG_LIST_START,
+ *					MSG_LIST_ITEM or MSG_START for the root
+ */
+msgType_t msgIndexGetType(msgIndex_t *this, uint32_t entry);
+
+/**
+ * Get the name of an entry.
+ *
+ * @param entry		entry handle
+ * @return			name, pointing into the encoding, empty for list items
+ */
+chunk_t msgIndexGetName(msgIndex_t *this, uint32_t entry);
+
+/**
+ * Get the value of a key/value or list item entry.
+ *
+ * @param entry		entry handle
+ * @return			value, pointing into the encoding
+ */
+chunk_t msgIndexGetEntryValue(msgIndex_t *this, uint32_t entry);
+
+/**
+ * Get the value of a key/value or list item entry as integer.
+ *
+ * @param entry		entry handle, may be MSG_INDEX_NONE
+ * @param def		default value if entry not found or not an integer
+ * @return			value
+ */
+int msgIndexGetEntryInt(msgIndex_t *this, uint32_t entry, int def);
+
+/**
+ * Get the value of a key/value or list item entry as boolean.
+ *
+ * @param entry		entry handle, may be MSG_INDEX_NONE
+ * @param def		default value if entry not found or not a boolean
+ * @return			value
+ */
+bool msgIndexGetEntryBool(msgIndex_t *this, uint32_t entry, bool def);
+
+/**
+ * Get the first child of a section or list, in encoding order.
+ *
+ * @param entry		entry handle
+ * @return			handle of first child, MSG_INDEX_NONE if empty
+ */
+uint32_t msgIndexFirstChild(msgIndex_t *this, uint32_t entry);
+
+/**
+ * Get the next sibling of an entry, in encoding order.
+ *
+ * @param entry		entry handle
+ * @return			handle of next sibling, MSG_INDEX_NONE if last
+ */
+uint32_t msgIndexNextSibling(msgIndex_t *this, uint32_t entry);
+
+/**
+ * Get the raw value of a key/value pair.
+ *
+ * @param def	default value if not found
+ * @param fmt	printf style format string for key, with sections
+ * @param ...	arguments to fmt string
+ * @return		value, pointing into the encoding
+ */
+chunk_t msgIndexGetValue(msgIndex_t *this, chunk_t def, char *fmt, ...);
+
+/**
+ * Get the raw value of a key/value pair, va_list variant.
+ *
+ * @param def	default value if not found
+ * @param fmt	printf style format string for key, with sections
+ * @param args	arguments to fmt string
+ * @return		value, pointing into the encoding
+ */
+chunk_t msgIndexVgetValue(msgIndex_t *this, chunk_t def, char *fmt, va_list args);
+
+/**
+ * Get the value of a key/value pair as integer.
+ *
+ * @param def	default value if not found or not an integer
+ * @param fmt	printf style format string for key, with sections
+ * @param ...	arguments to fmt string
+ * @return		value
+ */
+int msgIndexGetInt(msgIndex_t *this, int def, char *fmt, ...);
+
+/**
+ * Get the value of a key/value pair as boolean.
+ *
+ * @param def	default value if not found
+ * @param fmt	printf style format string for key, with sections
+ * @param ...	arguments to fmt string
+ * @return		value
+ */
+bool msgIndexGetBool(msgIndex_t *this, bool def, char *fmt, ...);
+
+/**
+ * Destroy a msgIndex_t, the encoding is not touched.
+ */
+void msgIndexDestroy(msgIndex_t *this);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CHELP_MESSAGEINDEX_H */
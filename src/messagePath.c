@@ -0,0 +1,205 @@
+#include "messagePath.h"
+
+#include <stdarg.h> /* va_list, va_start, va_arg, va_end */
+/* malloc, free */
+/* memcpy, strlen, strchr */
+/* TRUE, FALSE */
+
+typedef struct pathSegment_t pathSegment_t;
+
+/**
+ * Kind of a path segment
+ */
+typedef enum {
+	SEGMENT_FIXED,		/**!< fixed name */
+	SEGMENT_STR,		/**!< %s placeholder */
+	SEGMENT_INT,		/**!< %d placeholder */
+	SEGMENT_UINT,		/**!< %u placeholder */
+} segmentType_t;
+
+/**
+ * A single section or key name of the path
+ */
+struct pathSegment_t {
+	segmentType_t type;	/**!< kind of segment */
+	chunk_t name;		/**!< name of a fixed segment */
+	uint32_t hash;		/**!< precomputed chunkHash() of a fixed segment */
+};
+
+struct msgPath_t {
+	int count;					/**!< number of segments */
+	char *names;				/**!< copy of the path, fixed names point here */
+	pathSegment_t segments[];	/**!< segments of the path */
+};
+
+msgPath_t *msgPathCreate(char *fmt)
+{
+	msgPath_t *this;
+	char *pos, *dot;
+	int count = 1;
+	size_t len;
+
+	len = strlen(fmt);
+	for (pos = fmt; (pos = strchr(pos, '.')) != NULL; ++pos) {
+		count++;
+	}
+
+	this = (msgPath_t *)malloc(sizeof(*this) + count * sizeof(pathSegment_t) +
+							   len + 1);
+	this->count = count;
+	this->names = (char*)&this->segments[count];
+	memcpy(this->names, fmt, len + 1);
+
+	count = 0;
+	for (pos = this->names; pos; pos = dot ? dot + 1 : NULL) {
+		pathSegment_t *segment = &this->segments[count++];
+
+		dot = strchr(pos, '.');
+		segment->name = chunkCreate((uint8_t*)pos,
+									dot ? dot - pos : strlen(pos));
+		segment->type = SEGMENT_FIXED;
+
+		if (segment->name.len == 2 && pos[0] == '%') {
+			switch (pos[1]) {
+				case 's':
+					segment->type = SEGMENT_STR;
+					continue;
+				case 'd':
+				case 'i':
+					segment->type = SEGMENT_INT;
+					continue;
+				case 'u':
+					segment->type = SEGMENT_UINT;
+					continue;
+				default:
+					break;
+			}
+		}
+		if (!segment->name.len || memchr(pos, '%', segment->name.len)) {
+			/* empty segment, or a placeholder we can't handle */
+			free(this);
+			return NULL;
+		}
+		segment->hash = chunkHash(segment->name);
+	}
+	return this;
+}
+
+/**
+ * Print an unsigned decimal number to the end of buf, return the start
+ */
+static char *printDecimal(char *end, unsigned int value)
+{
+	do {
+		*--end = '0' + value % 10;
+		value /= 10;
+	} while (value);
+	return end;
+}
+
+uint32_t msgPathVresolve(msgPath_t *this, msgIndex_t *index, va_list args)
+{
+	uint32_t entry = MSG_INDEX_ROOT, hash;
+	char buf[16], *end = buf + sizeof(buf);
+	pathSegment_t *segment;
+	msgType_t type;
+	chunk_t name;
+	int i, val;
+
+	for (i = 0; i < this->count; ++i) {
+		segment = &this->segments[i];
+		switch (segment->type) {
+			case SEGMENT_FIXED:
+				name = segment->name;
+				hash = segment->hash;
+				break;
+			case SEGMENT_STR:
+				name = chunkFromStr(va_arg(args, char*));
+				hash = chunkHash(name);
+				break;
+			case SEGMENT_INT:
+				val = va_arg(args, int);
+				if (val < 0) {
+					name.ptr = (uint8_t*)printDecimal(end, -(unsigned int)val);
+					*--name.ptr = '-';
+				} else {
+					name.ptr = (uint8_t*)printDecimal(end, val);
+				}
+				name.len = end - (char*)name.ptr;
+				hash = chunkHash(name);
+				break;
+			case SEGMENT_UINT:
+			default:
+				name.ptr = (uint8_t*)printDecimal(end, va_arg(args, unsigned int));
+				name.len = end - (char*)name.ptr;
+				hash = chunkHash(name);
+				break;
+		}
+		entry = msgIndexFindHashed(index, entry, name, hash);
+		if (entry == MSG_INDEX_NONE) {
+			return MSG_INDEX_NONE;
+		}
+		type = msgIndexGetType(index, entry);
+		if (i < this->count - 1 ? type != MSG_SECTION_START
+								: type != MSG_KEY_VALUE) {
+			return MSG_INDEX_NONE;
+		}
+	}
+	return entry;
+}
+
+uint32_t msgPathResolve(msgPath_t *this, msgIndex_t *index, ...)
+{
+	va_list args;
+	uint32_t entry;
+
+	va_start(args, index);
+	entry = msgPathVresolve(this, index, args);
+	va_end(args);
+
+	return entry;
+}
+
+chunk_t msgPathGetValue(msgPath_t *this, msgIndex_t *index, chunk_t def, ...)
+{
+	va_list args;
+	uint32_t entry;
+
+	va_start(args, def);
+	entry = msgPathVresolve(this, index, args);
+	va_end(args);
+
+	if (entry == MSG_INDEX_NONE) {
+		return def;
+	}
+	return msgIndexGetEntryValue(index, entry);
+}
+
+int msgPathGetInt(msgPath_t *this, msgIndex_t *index, int def, ...)
+{
+	va_list args;
+	uint32_t entry;
+
+	va_start(args, def);
+	entry = msgPathVresolve(this, index, args);
+	va_end(args);
+
+	return msgIndexGetEntryInt(index, entry, def);
+}
+
+bool msgPathGetBool(msgPath_t *this, msgIndex_t *index, int def, ...)
+{
+	va_list args;
+	uint32_t entry;
+
+	va_start(args, def);
+	entry = msgPathVresolve(this, index, args);
+	va_end(args);
+
+	return msgIndexGetEntryBool(index, entry, def);
+}
+
+void msgPathDestroy(msgPath_t *this)
+{
+	free(this);
+}
@@ -0,0 +1,99 @@
+#ifndef _CHELP_MESSAGEPATH_H
+#define _CHELP_MESSAGEPATH_H 1
+
+#include "messageIndex.h" /* msgIndex_t */
+
+/**
+ * Precompiled key path for repeated message lookups.
+ *
+ * A path like "child-sas.%s.bytes-in" is split into its sections once by
+ * msgPathCreate(), and the hashes of all fixed segments are precomputed.
+ * Lookups then only hash the segments filled in by arguments, without
+ * formatting or tokenizing the path again, e.g.:
+ *
+ * @code
+ * msgPath_t *path = msgPathCreate("child-sas.%s.bytes-in");
+ *
+ * for (...) {
+ *		bytes = msgPathGetInt(path, index, 0, name);
+ * }
+ * msgPathDestroy(path);
+ * @endcode
+ *
+ * Placeholders must form a complete path segment, supported are %s (char*),
+ * %d (int) and %u (unsigned int).
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct msgPath_t msgPath_t;
+
+/**
+ * Compile a key path.
+ *
+ * @param fmt		dotted key path, with optional placeholder segments
+ * @return			compiled path, NULL if fmt is invalid
+ */
+msgPath_t *msgPathCreate(char *fmt);
+
+/**
+ * Resolve the path to a key/value entry of an index.
+ *
+ * @param index		message index to look up the path in
+ * @param ...		arguments for the placeholder segments
+ * @return			entry handle, MSG_INDEX_NONE if not found
+ */
+uint32_t msgPathResolve(msgPath_t *this, msgIndex_t *index, ...);
+
+/**
+ * Resolve the path to a key/value entry of an index, va_list variant.
+ *
+ * @param index		message index to look up the path in
+ * @param args		arguments for the placeholder segments
+ * @return			entry handle, MSG_INDEX_NONE if not found
+ */
+uint32_t msgPathVresolve(msgPath_t *this, msgIndex_t *index, va_list args);
+
+/**
+ * Get the raw value of the key/value pair the path refers to.
+ *
+ * @param index		message index to look up the path in
+ * @param def		default value if not found
+ * @param ...		arguments for the placeholder segments
+ * @return			value, pointing into the encoding
+ */
+chunk_t msgPathGetValue(msgPath_t *this, msgIndex_t *index, chunk_t def, ...);
+
+/**
+ * Get the value of the key/value pair the path refers to as integer.
+ *
+ * @param index		message index to look up the path in
+ * @param def		default value if not found or not an integer
+ * @param ...		arguments for the placeholder segments
+ * @return			value
+ */
+int msgPathGetInt(msgPath_t *this, msgIndex_t *index, int def, ...);
+
+/**
+ * Get the value of the key/value pair the path refers to as boolean.
+ *
+ * @param index		message index to look up the path in
+ * @param def		default value if not found, as int as va_start() can't
+ *					follow a promoted bool
+ * @param ...		arguments for the placeholder segments
+ * @return			value
+ */
+bool msgPathGetBool(msgPath_t *this, msgIndex_t *index, int def, ...);
+
+/**
+ * Destroy a msgPath_t.
+ */
+void msgPathDestroy(msgPath_t *this);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CHELP_MESSAGEPATH_H */
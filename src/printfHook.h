@@ -48,16 +48,24 @@ struct printfHookSpec_t {
 
 /**
  * Create a printfHook instance.
+ *
+ * Handlers are dispatched through a process wide table indexed by the
+ * format character. Formatting reads the table lock free from any thread,
+ * handlers may be registered concurrently but usually are at startup.
  */
 printfHook_t *printfHookCreate();
 
 /**
- * Destroy a printfHook instance.
+ * Destroy a printfHook instance, unregistering all handlers.
+ *
+ * No formatting may be active while destroying.
  */
 void printfHookDestroy(printfHook_t *this);
 
 /**
- * Register a printf handler.
+ * Register a printf handler, replacing a handler of the same specifier.
+ *
+ * Up to three arguments are supported.
  *
  * @param spec		printf hook format character
  * @param hook		hook function
@@ -79,6 +87,26 @@ void printfHookAddHandler(printfHook_t *this, char spec, printfHookFunc_t hook,
  */
 size_t printInHook(printfHookData_t *data, char *fmt, ...);
 
+/**
+ * Get the remaining output buffer of a printf hook, to write to directly.
+ *
+ * Output written this way does not need to be 0-terminated.
+ *
+ * @param data		hook data, as passed to printf hook
+ * @param len		receives the number of bytes writable
+ * @return			pointer to write output to
+ */
+char *printInHookBuffer(printfHookData_t *data, size_t *len);
+
+/**
+ * Advance the output buffer of a printf hook after writing to it directly.
+ *
+ * @param data		hook data, as passed to printf hook
+ * @param written	number of characters of the complete output, may exceed
+ *					the writable length if the output was truncated
+ */
+void printInHookAdvance(printfHookData_t *data, size_t written);
+
 #ifdef __cplusplus
 }
 #endif
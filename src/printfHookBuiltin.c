@@ -1,8 +1,15 @@
 #include "printfHookBuiltin.h"
+#include "printfHook.h"
+#include "epoch.h"
+
+#include <pthread.h> /* pthread_once, pthread_key_create, pthread_mutex_t */
 
 /* CHAR_BIT */
 /* uintmax_t, uintptr_t */
-/* strlen, strnlen, strerror */
+/* strlen, strnlen, strerror, strchr, strchrnul, memcpy, memset */
+/* malloc, calloc, realloc, free */
+/* DBG1 */
+/* min, max, countof, streq, TRUE, FALSE */
 
 /**
  * Printf format modifier flags
@@ -37,445 +44,1042 @@ typedef enum {
 } bpf_rank_t;
 
 /**
- * Printf specifier Parser state
+ * Maximum number of arguments of a printf hook
  */
-typedef enum {
-	ST_NORMAL,		/**!< Ground state */
-	ST_FLAGS,		/**!< Special flags */
-	ST_WIDTH,		/**!< Field width */
-	ST_PREC,		/**!< Field precision */
-	ST_MODIFIERS,	/**!< Length or conversion modifiers */
-} bpf_state_t;
+#define ARGS_MAX 3
 
-#define EMIT(x) ({ if (o<n){*q++ = (x);} ++o; })
+/**
+ * A registered printf hook handler
+ */
+typedef struct printfHookHandler_t printfHookHandler_t;
 
-int builtin_vsnprintf(char *buffer, size_t n, const char *format, va_list ap)
+struct printfHookHandler_t {
+	printfHookFunc_t hook;			/**!< hook function */
+	int numargs;					/**!< number of arguments */
+	uint32_t pointers;				/**!< bit i set if argument i is a pointer */
+	unsigned char spec;				/**!< format character handled */
+	printfHookHandler_t *next;		/**!< next handler registered */
+};
+
+/**
+ * Output buffer of a printf hook
+ */
+struct printfHookData_t {
+	char *q;	/**!< current position in buffer */
+	size_t n;	/**!< remaining bytes in buffer */
+};
+
+/**
+ * Handlers by format character, read lock free while formatting
+ */
+static printfHookHandler_t *hooks[256];
+
+struct printfHook_t {
+	printfHookHandler_t *handlers;	/**!< all handlers ever registered */
+};
+
+/**
+ * A parsed conversion specification
+ */
+typedef struct {
+	bpf_flag_t flags;	/**!< modifier flags */
+	int width;			/**!< field width */
+	int prec;			/**!< precision, -1 if not given */
+	int rank;			/**!< size of argument, bpf_rank_t */
+	bool widthArg;		/**!< TRUE if width is taken from arguments ('*') */
+	bool precArg;		/**!< TRUE if precision is taken from arguments */
+	char ch;			/**!< conversion character, '\0' if incomplete */
+} bpf_spec_t;
+
+/**
+ * A literal run followed by a conversion, of a compiled format
+ */
+typedef struct {
+	const char *literal;	/**!< literal text to copy */
+	size_t len;				/**!< length of literal text */
+	bool conv;				/**!< TRUE if followed by spec */
+	bpf_spec_t spec;		/**!< conversion after literal text */
+} bpf_segment_t;
+
+/**
+ * A compiled format string
+ */
+typedef struct bpf_compiled_t bpf_compiled_t;
+
+struct bpf_compiled_t {
+	const char *format;			/**!< format string pointer compiled */
+	char *copy;					/**!< copy of format, literals point here */
+	size_t len;					/**!< length of format */
+	uint64_t token;				/**!< epochDefer() token, once replaced */
+	bpf_compiled_t *next;		/**!< next replaced format to free */
+	int count;					/**!< number of segments */
+	bpf_segment_t segments[];	/**!< segments, in order */
+};
+
+/**
+ * Number of cached compiled formats, a power of two
+ */
+#define FORMAT_CACHE_SIZE 256
+
+/**
+ * Compiled formats, indexed by a hash of the format pointer. Colliding or
+ * changed formats replace entries after FORMAT_CACHE_MISSES misses, read
+ * within formatEpoch.
+ */
+static bpf_compiled_t *formatCache[FORMAT_CACHE_SIZE];
+
+/**
+ * Number of misses without a hit in between after which an entry of
+ * formatCache gets replaced. Formats colliding with a hot entry are
+ * interpreted instead of replacing it back and forth.
+ */
+#define FORMAT_CACHE_MISSES 32
+
+/**
+ * Misses of formatCache entries since their last hit
+ */
+static uint8_t formatMisses[FORMAT_CACHE_SIZE];
+
+/**
+ * Protects cached formats while in use, NULL if caching is unavailable
+ */
+static epoch_t *formatEpoch;
+
+/**
+ * Create formatEpoch once
+ */
+static pthread_once_t formatOnce = PTHREAD_ONCE_INIT;
+
+/**
+ * Maximum number of replaced formats not freed yet, no further entries get
+ * replaced until some are
+ */
+#define FORMAT_RETIRED_MAX 256
+
+/**
+ * Replaced formats, freed once no reader can use them anymore
+ */
+static bpf_compiled_t *formatRetired;
+
+/**
+ * Number of entries in formatRetired
+ */
+static int formatRetiredCount;
+
+/**
+ * Protects formatRetired
+ */
+static pthread_mutex_t formatMutex = PTHREAD_MUTEX_INITIALIZER;
+
+/**
+ * Pairs of decimal digits, for two digits per division
+ */
+static const char decimalPairs[] =
+	"0001020304050607080910111213141516171819"
+	"2021222324252627282930313233343536373839"
+	"4041424344454647484950515253545556575859"
+	"6061626364656667686970717273747576777879"
+	"8081828384858687888990919293949596979899";
+
+static const char lowerDigits[] = "0123456789abcdef";
+static const char upperDigits[] = "0123456789ABCDEF";
+
+#define EMIT(x) ({ if (o < n) { buffer[o] = (x); } ++o; })
+
+/**
+ * Copy bytes to the output, as far as it fits, returns new output offset
+ */
+static inline size_t emitBytes(char *buffer, size_t n, size_t o,
+							   const char *src, size_t len)
+{
+	if (o < n) {
+		memcpy(buffer + o, src, min(len, n - o));
+	}
+	return o + len;
+}
+
+/**
+ * Fill the output with a character, as far as it fits, returns new output
+ * offset
+ */
+static inline size_t emitFill(char *buffer, size_t n, size_t o, char ch,
+							  size_t len)
+{
+	if (o < n) {
+		memset(buffer + o, ch, min(len, n - o));
+	}
+	return o + len;
+}
+
+/**
+ * Convert a value to digits, right aligned before end, returns the first
+ * digit. Zero results in no digits.
+ */
+static inline char *convertDigits(char *end, uintmax_t val, int base,
+								  const char *digits)
+{
+	switch (base) {
+		case 10:
+			while (val >= 100) {
+				end -= 2;
+				memcpy(end, &decimalPairs[(val % 100) * 2], 2);
+				val /= 100;
+			}
+			if (val >= 10) {
+				end -= 2;
+				memcpy(end, &decimalPairs[val * 2], 2);
+			} else if (val) {
+				*--end = '0' + val;
+			}
+			break;
+		case 16:
+			for (; val; val >>= 4) {
+				*--end = digits[val & 0xf];
+			}
+			break;
+		case 8:
+			for (; val; val >>= 3) {
+				*--end = '0' + (val & 0x7);
+			}
+			break;
+	}
+	return end;
+}
+
+/**
+ * Format an integer, returns new output offset
+ */
+static size_t formatInt(char *buffer, size_t n, size_t o, uintmax_t val,
+						bpf_flag_t flags, int base, int width, int prec)
 {
-	const char *p = format;
-	char ch;
-	char *q = buffer;
+	char buf[CHAR_BIT * sizeof(uintmax_t) / 3 + 1], *digits, sign = '\0';
+	int ndigits, nzeros = 0, nticks = 0, nchars, prefix = 0, tickskip, i;
+
+	/* If signed, separate out the minus */
+	if ((flags & FL_SIGNED) && (intmax_t)val < 0) {
+		sign = '-';
+		val = -val;
+	} else if (flags & FL_PLUS) {
+		sign = '+';
+	} else if (flags & FL_SPACE) {
+		sign = ' ';
+	}
+
+	digits = convertDigits(buf + sizeof(buf), val, base,
+						   (flags & FL_UPPER) ? upperDigits : lowerDigits);
+	ndigits = buf + sizeof(buf) - digits;
+
+	if ((flags & FL_HASH) && base == 8 && prec < ndigits + 1) {
+		prec = ndigits + 1;
+	}
+	if (ndigits < prec) {
+		/* Mandatory number padding */
+		nzeros = prec - ndigits;
+	} else if (ndigits == 0) {
+		/* Zero still requires space */
+		nzeros = 1;
+	}
+	tickskip = (base == 16) ? 4 : 3;
+	if (flags & FL_TICK) {
+		/* Tick marks aren't digits, but generated by the number converter */
+		nticks = (ndigits + nzeros - 1) / tickskip;
+	}
+	if ((flags & FL_HASH) && base == 16) {
+		/* Add 0x for hex */
+		prefix = 2;
+	}
+	nchars = ndigits + nzeros + nticks + prefix + (sign ? 1 : 0);
+
+	/* Emit early space padding */
+	if (!(flags & (FL_MINUS|FL_ZERO)) && width > nchars) {
+		o = emitFill(buffer, n, o, ' ', width - nchars);
+	}
+	if (sign) {
+		EMIT(sign);
+	}
+	if (prefix) {
+		EMIT('0');
+		EMIT((flags & FL_UPPER) ? 'X' : 'x');
+	}
+	/* Emit zero padding */
+	if ((flags & (FL_MINUS|FL_ZERO)) == FL_ZERO && width > nchars) {
+		o = emitFill(buffer, n, o, '0', width - nchars);
+	}
+
+	if (nticks) {
+		for (i = 0; i < ndigits + nzeros; i++) {
+			if (i && (ndigits + nzeros - i) % tickskip == 0) {
+				EMIT('_');
+			}
+			EMIT(i < nzeros ? '0' : digits[i - nzeros]);
+		}
+	} else {
+		o = emitFill(buffer, n, o, '0', nzeros);
+		o = emitBytes(buffer, n, o, digits, ndigits);
+	}
+
+	/* Emit late space padding */
+	if ((flags & FL_MINUS) && width > nchars) {
+		o = emitFill(buffer, n, o, ' ', width - nchars);
+	}
+	return o;
+}
+
+/**
+ * Parse a conversion specification following a '%'
+ *
+ * @param p			format, after the '%'
+ * @param spec		receives the parsed specification
+ * @return			format after the conversion character
+ */
+static const char *parseSpec(const char *p, bpf_spec_t *spec)
+{
+	*spec = (bpf_spec_t){
+		.rank = RNK_INT,
+		.prec = -1,
+	};
+
+	/* Special flags */
+	for (;; p++) {
+		switch (*p) {
+			case '-':
+				spec->flags |= FL_MINUS;
+				continue;
+			case '+':
+				spec->flags |= FL_PLUS;
+				continue;
+			case '\'':
+				spec->flags |= FL_TICK;
+				continue;
+			case ' ':
+				spec->flags |= FL_SPACE;
+				continue;
+			case '#':
+				spec->flags |= FL_HASH;
+				continue;
+			case '0':
+				spec->flags |= FL_ZERO;
+				continue;
+			default:
+				break;
+		}
+		break;
+	}
+
+	/* Field width */
+	for (;; p++) {
+		if (*p >= '0' && *p <= '9') {
+			spec->width = spec->width * 10 + (*p - '0');
+		} else if (*p == '*') {
+			spec->widthArg = TRUE;
+		} else {
+			break;
+		}
+	}
+
+	/* Field precision */
+	if (*p == '.') {
+		spec->prec = 0;
+		for (p++;; p++) {
+			if (*p >= '0' && *p <= '9') {
+				spec->prec = spec->prec * 10 + (*p - '0');
+			} else if (*p == '*') {
+				spec->precArg = TRUE;
+			} else {
+				break;
+			}
+		}
+	}
+
+	/* Length modifiers - nonterminal sequences */
+	for (;; p++) {
+		switch (*p) {
+			case 'h':
+				spec->rank--;
+				continue;
+			case 'l':
+				spec->rank++;
+				continue;
+			case 'j':
+				spec->rank = RNK_INTMAX;
+				continue;
+			case 'z':
+				spec->rank = RNK_SIZE_T;
+				continue;
+			case 't':
+				spec->rank = RNK_PTRDIFF_T;
+				continue;
+			case 'L':
+			case 'q':
+				spec->rank += 2;
+				continue;
+			default:
+				break;
+		}
+		break;
+	}
+
+	/* Canonicalize rank */
+	if (spec->rank < RNK_MIN) {
+		spec->rank = RNK_MIN;
+	} else if (spec->rank > RNK_MAX) {
+		spec->rank = RNK_MAX;
+	}
+
+	/* Output modifiers - terminal sequences */
+	spec->ch = *p;
+	return *p ? p + 1 : p;
+}
+
+/**
+ * Format a conversion, returns new output offset
+ *
+ * @param buffer	output buffer
+ * @param n			size of output buffer
+ * @param o			number of characters output so far
+ * @param conv		parsed conversion specification
+ * @param ap		arguments
+ * @return			number of characters output
+ */
+static size_t formatSpec(char *buffer, size_t n, size_t o, bpf_spec_t *conv,
+						 va_list *ap)
+{
+	bpf_flag_t flags = conv->flags;
+	int width = conv->width;
+	int prec = conv->prec;
+	int rank = conv->rank;
+	char ch = conv->ch;
+	uintmax_t val = 0;
 	size_t sz;
-	size_t o = 0;	/* Number of characters output */
 	int base;
-	int rank = RNK_INT;
-	int width = 0;
-	int prec = -1;
-	uintmax_t val = 0;
-	bpf_flag_t flag = 0;
-	bpf_state_t state = ST_NORMAL;
 	const char *sarg;	/* %s string argument */
 	char carg;			/* %c char argument */
 	int slen;			/* String length */
-	
-	while ((ch = *p++)) {
-		switch(state) {
-			case ST_NORMAL:
+
+	if (conv->widthArg) {
+		width = va_arg(*ap, int32_t);
+		if (width < 0) {
+			width = -width;
+			flags |= FL_MINUS;
+		}
+	}
+	if (conv->precArg) {
+		prec = va_arg(*ap, int);
+		if (prec < 0) {
+			prec = -1;
+		}
+	}
+	if (!ch) {
+		/* format ends within the specification */
+		return o;
+	}
+
+	switch (ch)
+	{
+		case 'p':
+		{
+			/* Pointer */
+			base = 16;
+			prec = (CHAR_BIT*sizeof(void *)+3)/4;
+			flags |= FL_HASH;
+			val = (uintmax_t)(uintptr_t)va_arg(*ap, void *);
+			goto is_integer;
+		}
+		case 'd':
+		case 'i':
+		{
+			/* Signed decimal output */
+			base = 10;
+			flags |= FL_SIGNED;
+			switch (rank)
 			{
-				if (ch == '%') {
-					state = ST_FLAGS;
-					flags = 0;
-					rank = RNK_INT;
-					width = 0;
-					prec = -1;
-				} else {
-					EMIT(ch);
-				}
-				break;
-			} /* case ST_NORMAL */
-			case ST_FLAGS:
+				case RNK_CHAR:
+					/* Yes, all these casts are needed... */
+					val = (uintmax_t)(intmax_t)(signed char)
+							va_arg(*ap, signed int);
+					break;
+				case RNK_SHORT:
+					val = (uintmax_t)(intmax_t)(signed short)
+							va_arg(*ap, signed int);
+					break;
+				case RNK_INT:
+					val = (uintmax_t)(intmax_t)
+							va_arg(*ap, signed int);
+					break;
+				case RNK_LONG:
+					val = (uintmax_t)(intmax_t)
+							va_arg(*ap, signed long);
+					break;
+				case RNK_LONGLONG:
+					val = (uintmax_t)(intmax_t)
+							va_arg(*ap, signed long long);
+					break;
+			}
+			goto is_integer;
+		} /* case 'd': case 'i': */
+		case 'o':
+		{
+			/* Octal */
+			base = 8;
+			goto is_unsigned;
+		}
+		case 'u':
+		{
+			/* Unsigned decimal */
+			base = 10;
+			goto is_unsigned;
+		}
+		case 'X':
+		{
+			/* Upper case hexadecimal */
+			flags |= FL_UPPER;
+			/* fall through */
+		}
+		case 'x':
+		{
+			/* Hexadecimal */
+			base = 16;
+			goto is_unsigned;
+		}
+		is_unsigned:
+		{
+			switch (rank) {
+				case RNK_CHAR:
+					val = (uintmax_t)(unsigned char)
+							va_arg(*ap, unsigned int);
+					break;
+				case RNK_SHORT:
+					val = (uintmax_t)(unsigned short)
+							va_arg(*ap, unsigned int);
+					break;
+				case RNK_INT:
+					val = (uintmax_t)
+							va_arg(*ap, unsigned int);
+					break;
+				case RNK_LONG:
+					val = (uintmax_t)
+							va_arg(*ap, unsigned long);
+					break;
+				case RNK_LONGLONG:
+					val = (uintmax_t)
+							va_arg(*ap, unsigned long long);
+					break;
+			}
+			goto is_integer;
+		} /* is_unsigned */
+		is_integer:
+		{
+			return formatInt(buffer, n, o, val, flags, base, width, prec);
+		} /* is_integer */
+		case 'c':
+		{
+			/* Character */
+			carg = (char)va_arg(*ap, int32_t);
+			sarg = &carg;
+			slen = 1;
+			goto is_string;
+		}
+		case 's':
+		{
+			/* String */
+			sarg = va_arg(*ap, const char *);
+			sarg = sarg ? sarg : "(null)";
+			slen = prec != -1 ? strnlen(sarg, prec)
+							  : strlen(sarg);
+			goto is_string;
+		}
+		case 'm':
+		{
+			/* glibc error string */
+			sarg = strerror(errno);
+			slen = strlen(sarg);
+			goto is_string;
+		}
+		is_string:
+		{
+			if (prec != -1 && slen > prec) {
+				slen = prec;
+			}
+			if (width > slen && !(flags & FL_MINUS)) {
+				o = emitFill(buffer, n, o, (flags & FL_ZERO) ? '0' : ' ',
+							 width - slen);
+			}
+			o = emitBytes(buffer, n, o, sarg, slen);
+			if (width > slen && (flags & FL_MINUS)) {
+				o = emitFill(buffer, n, o, ' ', width - slen);
+			}
+			return o;
+		} /* is_string */
+		case 'A':
+		{
+			base = 16;
+			flags |= FL_UPPER;
+			goto is_double;
+		}
+		case 'E':
+		case 'G':
+		{
+			/* currently not supported, fall */
+		}
+		case 'F':
+		{
+			base = 10;
+			flags |= FL_UPPER;
+			goto is_double;
+		}
+		case 'a':
+		{
+			base = 16;
+			goto is_double;
+		}
+		case 'e':
+		case 'g':
+		{
+			/* currently not supported, fall */
+		}
+		case 'f':
+		{
+			base = 10;
+			goto is_double;
+		}
+		is_double:
+		{
+			double dval;
+
+			dval = va_arg(*ap, double);
+			if (isinf(dval))
 			{
-				switch (ch)
+				if (isgreater(dval, 0.0))
 				{
-					case '-':
-						flags |= FL_MINUS;
-						break;
-					case '+':
-						flags |= FL_PLUS;
-						break;
-					case '\'':
-						flags |= FL_TICK;
-						break;
-					case ' ':
-						flags |= FL_SPACE;
-						break;
-					case '#':
-						flags |= FL_HASH;
-						break;
-					case '0':
-						flags |= FL_ZERO;
-						break;
-					default:
-						state = ST_WIDTH;
-						/* Process this character again */
-						p--;
-						break;
+					sarg = flags & FL_UPPER ? "INF" : "inf";
 				}
-				break;
-			} /* case ST_FLAGS */
-			case ST_WIDTH:
-			{
-				if (ch >= '0' && ch <= '9')	{
-					width = width * 10 + (ch - '0');
-				} else if (ch == '*') {
-					width = va_arg(ap, int32_t);
-					if (width < 0) {
-						width = -width;
-						flags |= FL_MINUS;
-					}
-				} else if (ch == '.') {
-					/* Precision given */
-					prec = 0;
-					state = ST_PREC;
-				} else {
-					state = ST_MODIFIERS;
-					/* Process this character again */
-					p--;
+				else
+				{
+					sarg = flags & FL_UPPER ? "-INF" : "-inf";
 				}
-				break;
-			} /* case ST_WIDTH */
-			case ST_PREC:
+				slen = strlen(sarg);
+				goto is_string;
+			}
+			if (isnan(dval))
 			{
-				if (ch >= '0' && ch <= '9') {
-					prec = prec * 10 + (ch - '0');
-				} else if (ch == '*') {
-					prec = va_arg(ap, int);
-					if (prec < 0) {
-						prec = -1;
+				sarg = flags & FL_UPPER ? "NAN" : "nan";
+				slen = strlen(sarg);
+				goto is_string;
+			}
+			sz = format_double(buffer + min(o, n), (o < n) ? n - o : 0,
+							dval, flags, base, width, prec);
+			return o + sz;
+		} /* is_double */
+		case 'n':
+		{
+			/* Output the number of characters written */
+			switch (rank)
+			{
+				case RNK_CHAR:
+					*va_arg(*ap, signed char *) = o;
+					break;
+				case RNK_SHORT:
+					*va_arg(*ap, signed short *) = o;
+					break;
+				case RNK_INT:
+					*va_arg(*ap, signed int *) = o;
+					break;
+				case RNK_LONG:
+					*va_arg(*ap, signed long *) = o;
+					break;
+				case RNK_LONGLONG:
+					*va_arg(*ap, signed long long *) = o;
+					break;
+			}
+			break;
+		} /* case 'n' */
+		default:
+		{
+			printfHookHandler_t *handler;
+
+			handler = __atomic_load_n(&hooks[(unsigned char)ch],
+									  __ATOMIC_ACQUIRE);
+			if (handler) {
+				const void *args[ARGS_MAX];
+				int i, iargs[ARGS_MAX];
+				void *pargs[ARGS_MAX];
+
+				printfHookSpec_t spec = {
+					.hash = flags & FL_HASH,
+					.plus = flags & FL_PLUS,
+					.minus = flags & FL_MINUS,
+					.width = width,
+				};
+
+				printfHookData_t data = {
+					.q = buffer + min(o, n),
+					.n = (o < n) ? n - o : 0,
+				};
+
+				for (i = 0; i < handler->numargs; i++) {
+					if (handler->pointers & (1 << i)) {
+						pargs[i] = va_arg(*ap, void*);
+						args[i] = &pargs[i];
+					} else {
+						iargs[i] = va_arg(*ap, int32_t);
+						args[i] = &iargs[i];
 					}
-				} else {
-					state = ST_MODIFIERS;
-					/* Process this character again */
-					p--;
 				}
+				sz = handler->hook(&data, &spec, args);
+				o += sz;
+			} else {
+				EMIT(ch); /* Anything else, including % */
+			}
+			break;
+		}
+	} /* switch (ch) */
+	return o;
+}
+
+/**
+ * Compile a format string to a list of segments
+ */
+static bpf_compiled_t *compileFormat(const char *format)
+{
+	bpf_compiled_t *this;
+	const char *p, *end;
+	size_t len = strlen(format);
+	int count = 1;
+
+	for (p = format; (p = strchr(p, '%')); p++) {
+		count++;
+	}
+	this = malloc(sizeof(*this) + sizeof(bpf_segment_t) * count + len + 1);
+	if (!this) {
+		return NULL;
+	}
+	this->format = format;
+	this->copy = (char*)&this->segments[count];
+	memcpy(this->copy, format, len + 1);
+	this->len = len;
+	this->count = 0;
+
+	for (p = this->copy; *p; ) {
+		bpf_segment_t *segment = &this->segments[this->count++];
+
+		end = strchrnul(p, '%');
+		segment->literal = p;
+		segment->len = end - p;
+		segment->conv = *end == '%';
+		if (!segment->conv) {
+			break;
+		}
+		p = parseSpec(end + 1, &segment->spec);
+	}
+	return this;
+}
+
+static void createFormatEpoch()
+{
+	formatEpoch = epochCreate();
+}
+
+/**
+ * Free replaced formats no reader can use anymore, formatMutex must be held
+ */
+static void reclaimFormats()
+{
+	bpf_compiled_t **prev = &formatRetired, *compiled;
+
+	while ((compiled = *prev)) {
+		if (epochPassed(formatEpoch, compiled->token)) {
+			*prev = compiled->next;
+			formatRetiredCount--;
+			free(compiled);
+		} else {
+			prev = &compiled->next;
+		}
+	}
+}
+
+/**
+ * Replace a cached format, returns FALSE if too many replaced formats are
+ * still pending
+ */
+static bool replaceFormat(int hash, bpf_compiled_t *current,
+						  bpf_compiled_t *compiled)
+{
+	bool replaced = FALSE;
+
+	pthread_mutex_lock(&formatMutex);
+	if (current && formatRetiredCount >= FORMAT_RETIRED_MAX) {
+		reclaimFormats();
+	}
+	if (!current || formatRetiredCount < FORMAT_RETIRED_MAX) {
+		replaced = __atomic_compare_exchange_n(&formatCache[hash], &current,
+											   compiled, FALSE, __ATOMIC_ACQ_REL,
+											   __ATOMIC_ACQUIRE);
+	}
+	if (replaced && current) {
+		/* readers might still use it, free it once they are done */
+		current->token = epochDefer(formatEpoch);
+		current->next = formatRetired;
+		formatRetired = current;
+		formatRetiredCount++;
+		reclaimFormats();
+	}
+	pthread_mutex_unlock(&formatMutex);
+	return replaced;
+}
+
+/**
+ * Get the compiled version of a format string, NULL if not cacheable. Must
+ * be called within formatEpoch, the result is valid until leaving it.
+ */
+static bpf_compiled_t *getCompiled(const char *format)
+{
+	bpf_compiled_t *compiled, *current;
+	uintptr_t hash = (uintptr_t)format;
+
+	hash = (hash ^ (hash >> 8) ^ (hash >> 16)) & (FORMAT_CACHE_SIZE - 1);
+	current = __atomic_load_n(&formatCache[hash], __ATOMIC_ACQUIRE);
+	/* the format pointer might be a buffer having a different content now,
+	 * strnlen() makes sure memcmp() doesn't read past a shorter one */
+	if (current && current->format == format &&
+		strnlen(format, current->len + 1) == current->len &&
+		memcmp(current->copy, format, current->len) == 0) {
+		/* avoid writing the shared counter on every hit */
+		if (__atomic_load_n(&formatMisses[hash], __ATOMIC_RELAXED)) {
+			__atomic_store_n(&formatMisses[hash], 0, __ATOMIC_RELAXED);
+		}
+		return current;
+	}
+	if (current && __atomic_add_fetch(&formatMisses[hash], 1,
+									  __ATOMIC_RELAXED) < FORMAT_CACHE_MISSES) {
+		return NULL;
+	}
+	__atomic_store_n(&formatMisses[hash], 0, __ATOMIC_RELAXED);
+	compiled = compileFormat(format);
+	if (!compiled) {
+		return NULL;
+	}
+	if (!replaceFormat(hash, current, compiled)) {
+		/* changed in the meantime or too many pending, interpret this one */
+		free(compiled);
+		return NULL;
+	}
+	return compiled;
+}
+
+int builtin_vsnprintf(char *buffer, size_t n, const char *format, va_list ap)
+{
+	bpf_compiled_t *compiled;
+	bpf_segment_t *segment;
+	bpf_spec_t spec;
+	const char *p = format, *end;
+	size_t o = 0;	/* Number of characters output */
+	va_list args;
+	int i;
+
+	va_copy(args, ap);
+	pthread_once(&formatOnce, createFormatEpoch);
+	if (formatEpoch) {
+		epochEnter(formatEpoch);
+		compiled = getCompiled(format);
+	} else {
+		compiled = NULL;
+	}
+	if (compiled) {
+		for (i = 0; i < compiled->count; i++) {
+			segment = &compiled->segments[i];
+			o = emitBytes(buffer, n, o, segment->literal, segment->len);
+			if (segment->conv) {
+				o = formatSpec(buffer, n, o, &segment->spec, &args);
+			}
+		}
+	} else {
+		while (*p) {
+			end = strchrnul(p, '%');
+			o = emitBytes(buffer, n, o, p, end - p);
+			if (!*end) {
 				break;
-			} /* case ST_PREC */
-			case ST_MODIFIERS:
-			{
-				switch (ch)
-				{
-					/* Length modifiers - nonterminal sequences */
-					case 'h':
-						rank--;
-						break;
-					case 'l':
-						rank++;
-						break;
-					case 'j':
-						rank = RNK_INTMAX;
-						break;
-					case 'z':
-						rank = RNK_SIZE_T;
-						break;
-					case 't':
-						rank = RNK_PTRDIFF_T;
-						break;
-					case 'L':
-					case 'q':
-						rank += 2;
-						break;
-					default:
-					{
-						/* Output modifiers - terminal sequences */
-
-						/* Next state will be normal */
-						state = ST_NORMAL;
-
-						/* Canonicalize rank */
-						if (rank < RNK_MIN)	{
-							rank = RNK_MIN;
-						} else if (rank > RNK_MAX) {
-							rank = RNK_MAX;
-						}
-						
-						switch (ch)
-						{
-							case 'p':
-							{
-								/* Pointer */
-								base = 16;
-								prec = (CHAR_BIT*sizeof(void *)+3)/4;
-								flags |= FL_HASH;
-								val = (uintmax_t)(uintptr_t)va_arg(ap, void *);
-								goto is_integer;
-							}
-							case 'd':
-							case 'i':
-							{
-								/* Signed decimal output */
-								base = 10;
-								flags |= FL_SIGNED;
-								switch (rank)
-								{
-									case RNK_CHAR:
-										/* Yes, all these casts are needed... */
-										val = (uintmax_t)(intmax_t)(signed char)
-												va_arg(ap, signed int);
-										break;
-									case RNK_SHORT:
-										val = (uintmax_t)(intmax_t)(signed short)
-												va_arg(ap, signed int);
-										break;
-									case RNK_INT:
-										val = (uintmax_t)(intmax_t)
-												va_arg(ap, signed int);
-										break;
-									case RNK_LONG:
-										val = (uintmax_t)(intmax_t)
-												va_arg(ap, signed long);
-										break;
-									case RNK_LONGLONG:
-										val = (uintmax_t)(intmax_t)
-												va_arg(ap, signed long long);
-										break;
-								}
-								goto is_integer;
-							} /* case 'd': case 'i': */
-							case 'o':
-							{
-								/* Octal */
-								base = 8;
-								goto is_unsigned;
-							}
-							case 'u':
-							{
-								/* Unsigned decimal */
-								base = 10;
-								goto is_unsigned;
-							}
-							case 'X':
-							{
-								/* Upper case hexadecimal */
-								flags |= FL_UPPER;
-								/* fall through */
-							}
-							case 'x':
-							{
-								/* Hexadecimal */
-								base = 16;
-								goto is_unsigned;
-							}
-							is_unsigned:
-							{
-								switch (rank) {
-									case RNK_CHAR:
-										val = (uintmax_t)(unsigned char)
-												va_arg(ap, unsigned int);
-										break;
-									case RNK_SHORT:
-										val = (uintmax_t)(unsigned short)
-												va_arg(ap, unsigned int);
-										break;
-									case RNK_INT:
-										val = (uintmax_t)
-												va_arg(ap, unsigned int);
-										break;
-									case RNK_LONG:
-										val = (uintmax_t)
-												va_arg(ap, unsigned long);
-										break;
-									case RNK_LONGLONG:
-										val = (uintmax_t)
-												va_arg(ap, unsigned long long);
-										break;
-								}
-								goto is_integer;
-							} /* is_unsigned */
-							is_integer:
-							{
-								sz = formatInt(q, (o < n) ? n - o : 0,
-												val, flags, base, width, prec);
-								q += sz;
-								o += sz;
-								break;
-							} /* is_integer */
-							case 'c':
-							{
-								/* Character */
-								carg = (char)va_arg(ap, int32_t);
-								sarg = &carg;
-								slen = 1;
-								goto is_string;
-							}
-							case 's':
-							{
-								/* String */
-								sarg = va_arg(ap, const char *);
-								sarg = sarg ? sarg : "(null)";
-								slen = prec != -1 ? strnlen(sarg, prec)
-												  : strlen(sarg);
-								goto is_string;
-							}
-							case 'm':
-							{
-								/* glibc error string */
-								sarg = strerror(errno);
-								slen = strlen(sarg);
-								goto is_string;
-							}
-							is_string:
-							{
-								char sch;
-								int i;
-
-								if (prec != -1 && slen > prec) {
-									slen = prec;
-								}
-
-								if (width > slen && !(flags & FL_MINUS)) {
-									char pad = (flags & FL_ZERO) ? '0' : ' ';
-									while (width > slen) {
-										EMIT(pad);
-										width--;
-									}
-								}
-								
-								for (i = slen; i; i--) {
-									sch = *sarg++;
-									EMIT(sch);
-								}
-								
-								if (width > slen && (flags & FL_MINUS)) {
-									while (width > slen) {
-										EMIT(' ');
-										width--;
-									}
-								}
-								break;
-							} /* is_string */
-							case 'A':
-							{
-								base = 16;
-								flags |= FL_UPPER;
-								goto is_double;
-							}
-							case 'E':
-							case 'G':
-							{
-								/* currently not supported, fall */
-							}
-							case 'F':
-							{
-								base = 10;
-								flags |= FL_UPPER;
-								goto is_double;
-							}
-							case 'a':
-							{
-								base = 16;
-								goto is_double;
-							}
-							case 'e':
-							case 'g':
-							{
-								/* currently not supported, fall */
-							}
-							case 'f':
-							{
-								base = 10;
-								goto is_double;
-							}
-							is_double:
-							{
-								double dval;
-
-								dval = va_arg(ap, double);
-								if (isinf(dval))
-								{
-									if (isgreater(dval, 0.0))
-									{
-										sarg = flags & FL_UPPER ? "INF" : "inf";
-									}
-									else
-									{
-										sarg = flags & FL_UPPER ? "-INF" : "-inf";
-									}
-									slen = strlen(sarg);
-									goto is_string;
-								}
-								if (isnan(dval))
-								{
-									sarg = flags & FL_UPPER ? "NAN" : "nan";
-									slen = strlen(sarg);
-									goto is_string;
-								}
-								sz = format_double(q, (o < n) ? n - o : 0,
-												dval, flags, base, width, prec);
-								q += sz;
-								o += sz;
-								break;
-							} /* is_double */
-							case 'n':
-							{
-								/* Output the number of characters written */
-								switch (rank)
-								{
-									case RNK_CHAR:
-										*va_arg(ap, signed char *) = o;
-										break;
-									case RNK_SHORT:
-										*va_arg(ap, signed short *) = o;
-										break;
-									case RNK_INT:
-										*va_arg(ap, signed int *) = o;
-										break;
-									case RNK_LONG:
-										*va_arg(ap, signed long *) = o;
-										break;
-									case RNK_LONGLONG:
-										*va_arg(ap, signed long long *) = o;
-										break;
-								}
-								break;
-							} /* case 'n' */
-							default:
-							{
-								printfHookHandler_t *handler;
-
-								handler = hooks->get(hooks, (void*)(uintptr_t)ch);
-								if (handler) {
-									const void *args[ARGS_MAX];
-									int i, iargs[ARGS_MAX];
-									void *pargs[ARGS_MAX];
-									
-									printfHookSpec_t spec =  {
-										.hash = flags & FL_HASH,
-										.plus = flags & FL_PLUS,
-										.minus = flags & FL_MINUS,
-										.width = width,
-									};
-									
-									printfHookData_t data = {
-										.q = q,
-										.n = (o < n) ? n - o : 0,
-									};
-									
-									for (i = 0; i < handler->numargs; i++) {
-										switch (handler->argtypes[i])
-										{
-											case PRINTF_HOOK_ARGTYPE_INT:
-												iargs[i] = va_arg(ap, int32_t);
-												args[i] = &iargs[i];
-												break;
-											case PRINTF_HOOK_ARGTYPE_POINTER:
-												pargs[i] = va_arg(ap, void*);
-												args[i] = &pargs[i];
-												break;
-										}
-									}
-									sz = handler->hook(&data, &spec, args);
-									q += sz;
-									o += sz;
-								} else {
-									EMIT(ch); /* Anything else, including % */
-								}
-								break;
-							}
-						} /* switch (ch) */
-					} /* default: Output modifiers - terminal sequences */
-				} /* case ST_MODIFIERS: switch (ch) */
-			} /* case ST_MODIFIERS */
-		} /* switch(state) */
+			}
+			p = parseSpec(end + 1, &spec);
+			o = formatSpec(buffer, n, o, &spec, &args);
+		}
+	}
+	if (formatEpoch) {
+		epochExit(formatEpoch);
+	}
+	va_end(args);
+
+	if (n) {
+		buffer[min(o, n - 1)] = '\0';
+	}
+	return o;
+}
+
+/**
+ * Initial size of thread local buffers
+ */
+#define TLS_BUF_LEN 256
+
+/**
+ * Thread local format buffer
+ */
+static __thread struct {
+	char *buf;		/**!< buffer, freed on thread exit */
+	size_t size;	/**!< allocated size of buffer */
+	int depth;		/**!< nesting level of calls formatting into buf */
+	char *nested;	/**!< last string formatted while nested, on the heap */
+} tls;
+
+/**
+ * Key to free the thread local buffer on thread exit
+ */
+static pthread_key_t tlsKey;
+
+/**
+ * Create tlsKey once
+ */
+static pthread_once_t tlsOnce = PTHREAD_ONCE_INIT;
+
+/**
+ * Free the thread local buffers, reset so they get reallocated if used
+ * by a later destructor
+ */
+static void tlsFree(void *value)
+{
+	free(tls.buf);
+	free(tls.nested);
+	memset(&tls, 0, sizeof(tls));
+}
+
+static void tlsKeyCreate()
+{
+	pthread_key_create(&tlsKey, tlsFree);
+}
+
+/**
+ * Make sure the thread local buffer has at least the given size
+ */
+static bool tlsReserve(size_t size)
+{
+	char *buf;
+
+	if (size <= tls.size) {
+		return TRUE;
+	}
+	size = max(size, max(tls.size * 2, TLS_BUF_LEN));
+	buf = realloc(tls.buf, size);
+	if (!buf) {
+		return FALSE;
+	}
+	if (!tls.buf) {
+		pthread_once(&tlsOnce, tlsKeyCreate);
+		pthread_setspecific(tlsKey, &tls);
 	}
+	tls.buf = buf;
+	tls.size = size;
+	return TRUE;
+}
+
+/**
+ * Format into a newly allocated buffer of exact size
+ */
+static char *heapPrintf(size_t *len, const char *format, va_list ap)
+{
+	char *buf;
+	int written;
+
+	written = builtin_vsnprintf(NULL, 0, format, ap);
+	buf = malloc(written + 1);
+	if (!buf) {
+		return NULL;
+	}
+	written = min(builtin_vsnprintf(buf, written + 1, format, ap), written);
+	if (len) {
+		*len = written;
+	}
+	return buf;
+}
+
+char *builtin_vtlsprintf(size_t *len, const char *format, va_list ap)
+{
+	int written;
+	char *buf;
+
+	if (tls.depth) {
+		/* called from a printf hook while formatting into tls.buf, keep
+		 * the string until the next nested call or the thread exits */
+		buf = heapPrintf(len, format, ap);
+		if (buf) {
+			free(tls.nested);
+			tls.nested = buf;
+		}
+		return buf;
+	}
+	if (!tlsReserve(TLS_BUF_LEN)) {
+		return NULL;
+	}
+	tls.depth++;
+	/* builtin_vsnprintf() does not consume ap, retry after growing */
+	written = builtin_vsnprintf(tls.buf, tls.size, format, ap);
+	if (written >= tls.size) {
+		if (!tlsReserve(written + 1)) {
+			tls.depth--;
+			return NULL;
+		}
+		written = builtin_vsnprintf(tls.buf, tls.size, format, ap);
+	}
+	tls.depth--;
+	if (len) {
+		*len = written;
+	}
+	return tls.buf;
+}
+
+char *builtin_tlsprintf(size_t *len, const char *format, ...)
+{
+	va_list args;
+	char *str;
+
+	va_start(args, format);
+	str = builtin_vtlsprintf(len, format, args);
+	va_end(args);
+
+	return str;
+}
+
+int builtin_vasprintf(char **str, const char *format, va_list ap)
+{
+	size_t len;
+	char *buf;
+
+	if (tls.depth) {
+		/* tls.buf is in use by a caller of the printf hook calling us */
+		*str = heapPrintf(&len, format, ap);
+		return *str ? len : -1;
+	}
+	/* format once into the thread local buffer, then copy at exact size */
+	buf = builtin_vtlsprintf(&len, format, ap);
+	if (!buf) {
+		*str = NULL;
+		return -1;
+	}
+	*str = malloc(len + 1);
+	if (!*str) {
+		return -1;
+	}
+	memcpy(*str, buf, len + 1);
+	return len;
+}
+
+int builtin_asprintf(char **str, const char *format, ...)
+{
+	va_list args;
+	int len;
+
+	va_start(args, format);
+	len = builtin_vasprintf(str, format, args);
+	va_end(args);
+
+	return len;
 }
 
 /**
@@ -501,3 +1105,81 @@ size_t printInHook(printfHookData_t *data, char *fmt, ...)
 	return written;
 }
 
+char *printInHookBuffer(printfHookData_t *data, size_t *len)
+{
+	*len = data->n;
+	return data->q;
+}
+
+void printInHookAdvance(printfHookData_t *data, size_t written)
+{
+	written = min(written, data->n);
+	data->q += written;
+	data->n -= written;
+}
+
+printfHook_t *printfHookCreate()
+{
+	printfHook_t *this;
+
+	this = calloc(1, sizeof(*this));
+	return this;
+}
+
+void printfHookAddHandler(printfHook_t *this, char spec, printfHookFunc_t hook,
+						  ...)
+{
+	printfHookHandler_t *handler;
+	printfHookArgType_t argtype;
+	va_list args;
+
+	handler = calloc(1, sizeof(*handler));
+	if (!handler) {
+		return;
+	}
+	handler->hook = hook;
+	handler->spec = spec;
+
+	va_start(args, hook);
+	while ((argtype = va_arg(args, printfHookArgType_t)) !=
+			PRINTF_HOOK_ARGTYPE_END) {
+		if (handler->numargs >= ARGS_MAX) {
+			DBG1(DBG_LIB, "Too many arguments for printf hook with "
+				 "specifier '%c', not registered!", spec);
+			va_end(args);
+			free(handler);
+			return;
+		}
+		if (argtype == PRINTF_HOOK_ARGTYPE_POINTER) {
+			handler->pointers |= 1 << handler->numargs;
+		}
+		handler->numargs++;
+	}
+	va_end(args);
+
+	/* a replaced handler might still be in use, keep it until destroyed */
+	handler->next = this->handlers;
+	while (!__atomic_compare_exchange_n(&this->handlers, &handler->next,
+										handler, TRUE, __ATOMIC_RELEASE,
+										__ATOMIC_RELAXED)) {
+	}
+	__atomic_store_n(&hooks[(unsigned char)spec], handler, __ATOMIC_RELEASE);
+}
+
+void printfHookDestroy(printfHook_t *this)
+{
+	printfHookHandler_t *handler, *current;
+
+	/* unregister only our own handlers, not those of other instances */
+	for (handler = this->handlers; handler; handler = handler->next) {
+		current = handler;
+		__atomic_compare_exchange_n(&hooks[handler->spec], &current, NULL,
+									FALSE, __ATOMIC_RELEASE, __ATOMIC_RELAXED);
+	}
+	while (this->handlers) {
+		handler = this->handlers;
+		this->handlers = handler->next;
+		free(handler);
+	}
+	free(this);
+}
@@ -20,6 +20,32 @@ int builtin_vsprintf(char *str, const char *format, va_list ap);
 int builtin_vsnprintf(char *str, size_t size, const char *format, va_list ap);
 int builtin_vasprintf(char **str, const char *format, va_list ap);
 
+/**
+ * Format into a buffer owned by the calling thread.
+ *
+ * The buffer grows to the longest string formatted by the thread and is
+ * reused, so formatting usually requires no allocation. It is freed when
+ * the thread exits. Calls from printf hooks invoked while formatting into
+ * the buffer don't touch it, they return a separately allocated string.
+ *
+ * @param len		receives the length of the string, if not NULL
+ * @param format	printf format string
+ * @return			formatted string, valid until the next call of the thread,
+ *					NULL if out of memory
+ */
+char *builtin_tlsprintf(size_t *len, const char *format, ...);
+
+/**
+ * Format into a buffer owned by the calling thread, see builtin_tlsprintf().
+ *
+ * @param len		receives the length of the string, if not NULL
+ * @param format	printf format string
+ * @param ap		arguments to format string
+ * @return			formatted string, valid until the next call of the thread,
+ *					NULL if out of memory
+ */
+char *builtin_vtlsprintf(size_t *len, const char *format, va_list ap);
+
 #ifdef printf
 #undef printf
 #endif
@@ -28,6 +28,20 @@
  * Currently only a limited set of printf format specifiers are supported
  * (namely %s, %d and %N, see implementation for details).
  *
+ * Getters are served from a settingsIndex_t of all fully-qualified keys,
+ * including those resolved through fallbacks, so they take constant time.
+ * Files are parsed by settingsParser.h from mmap()ed memory, to trees
+ * allocated from an arena with interned section names and keys.
+ * Parsed trees may be saved to a binary cache (settingsCache.h), loaded on
+ * startup without parsing as long as none of the files changed.
+ *
+ * The tree and its index are kept as immutable snapshots in a
+ * settingsStore_t. Loading, setting values or adding a fallback publish a
+ * new snapshot, so getters never block on a reload.
+ *
+ * Hot code should use settingsHandle.h, which caches values converted to
+ * their type until new settings are published.
+ *
  * \section includes Including other files
  * Other files can be included, using the include statement e.g.
  * @code
@@ -0,0 +1,581 @@
+#include "settingsCache.h"
+#include "settingsParser.h"
+
+#include <stdio.h> /* FILE, fopen, fwrite, fclose, rename, remove */
+#include <errno.h> /* errno */
+#include <limits.h> /* PATH_MAX */
+/* malloc, realloc, calloc, free */
+/* memcpy, memcmp, strlen, strerror */
+/* snprintf */
+/* arrayCount, arrayGet */
+/* DBG1, DBG2, DBG_CFG */
+/* TRUE, FALSE, max, streq */
+
+/**
+ * Magic and version at the start of a cache file
+ */
+#define CACHE_MAGIC "CSET"
+#define CACHE_VERSION 2
+
+/**
+ * String offset of absent names and values
+ */
+#define CACHE_NONE UINT32_MAX
+
+typedef struct cacheHeader_t cacheHeader_t;
+typedef struct cacheSource_t cacheSource_t;
+typedef struct cacheSection_t cacheSection_t;
+typedef struct cacheKv_t cacheKv_t;
+typedef struct buffer_t buffer_t;
+typedef struct strtab_t strtab_t;
+typedef struct sectionMap_t sectionMap_t;
+
+/**
+ * Header of a cache file, followed by the arrays in the same order
+ */
+struct cacheHeader_t {
+	char magic[4];			/**!< CACHE_MAGIC */
+	uint32_t version;		/**!< CACHE_VERSION */
+	uint32_t sources;		/**!< number of cacheSource_t */
+	uint32_t sections;		/**!< number of cacheSection_t */
+	uint32_t kvs;			/**!< number of cacheKv_t */
+	uint32_t fallbacks;		/**!< number of fallback section indices */
+	uint32_t strings;		/**!< length of string table */
+	uint32_t pattern;		/**!< string offset of pattern, or CACHE_NONE */
+};
+
+/**
+ * A recorded source
+ */
+struct cacheSource_t {
+	uint64_t mtime;			/**!< modification time in ns */
+	uint64_t size;			/**!< file size */
+	uint32_t hash;			/**!< chunkHashStatic() of file contents */
+	uint32_t path;			/**!< string offset of path */
+	uint32_t type;			/**!< settingsSourceType_t */
+	uint32_t reserved;		/**!< padding */
+};
+
+/**
+ * A section, in pre-order so parents come first
+ */
+struct cacheSection_t {
+	uint32_t name;			/**!< string offset of name, CACHE_NONE for root */
+	uint32_t parent;		/**!< index of parent, CACHE_NONE for root */
+	uint32_t kvs;			/**!< number of key/values, in order */
+	uint32_t fallbacks;		/**!< number of fallbacks, in order */
+};
+
+/**
+ * A key/value pair
+ */
+struct cacheKv_t {
+	uint32_t key;			/**!< string offset of key */
+	uint32_t value;			/**!< string offset of value, or CACHE_NONE */
+};
+
+/**
+ * Growable buffer
+ */
+struct buffer_t {
+	uint8_t *ptr;			/**!< data */
+	size_t len;				/**!< used bytes */
+	size_t size;			/**!< allocated bytes */
+};
+
+/**
+ * String table with deduplication
+ */
+struct strtab_t {
+	buffer_t data;			/**!< 0-terminated strings */
+	uint32_t *table;		/**!< hash table, offset + 1, 0 is empty */
+	uint32_t mask;			/**!< size of table - 1 */
+	uint32_t count;			/**!< number of strings */
+};
+
+/**
+ * Index of sections by pointer
+ */
+struct sectionMap_t {
+	section_t **sections;	/**!< sections in pre-order */
+	uint32_t *parents;		/**!< index of parent of each section */
+	uint32_t count;			/**!< number of sections */
+	uint32_t size;			/**!< allocated sections */
+	uint32_t *table;		/**!< hash table, index + 1, 0 is empty */
+	uint32_t mask;			/**!< size of table - 1 */
+};
+
+/**
+ * Append data to a buffer
+ */
+static void bufferAppend(buffer_t *this, const void *data, size_t len)
+{
+	if (this->len + len > this->size) {
+		this->size = max(this->size * 2, this->len + len);
+		this->ptr = realloc(this->ptr, this->size);
+	}
+	memcpy(this->ptr + this->len, data, len);
+	this->len += len;
+}
+
+/**
+ * Write the contents of a buffer to a file
+ */
+static bool bufferWrite(buffer_t *this, FILE *file)
+{
+	return !this->len || fwrite(this->ptr, 1, this->len, file) == this->len;
+}
+
+/**
+ * Add a string to the table, returns its offset
+ */
+static uint32_t strtabAdd(strtab_t *this, char *str)
+{
+	uint32_t i, j, offset, size, *old;
+	size_t len = strlen(str);
+
+	for (i = chunkHash(chunkCreate((uint8_t*)str, len)) & this->mask;
+		 (offset = this->table[i]) != 0; i = (i + 1) & this->mask) {
+		if (streq((char*)this->data.ptr + offset - 1, str)) {
+			return offset - 1;
+		}
+	}
+	offset = this->data.len;
+	bufferAppend(&this->data, str, len + 1);
+	this->table[i] = offset + 1;
+
+	if (++this->count * 2 > this->mask + 1) {
+		old = this->table;
+		size = (this->mask + 1) * 2;
+		this->table = calloc(size, sizeof(uint32_t));
+		this->mask = size - 1;
+		for (j = 0; j < size / 2; ++j) {
+			if (!old[j]) {
+				continue;
+			}
+			str = (char*)this->data.ptr + old[j] - 1;
+			for (i = chunkHash(chunkFromStr(str)) & this->mask; this->table[i];
+				 i = (i + 1) & this->mask) {
+				/* probe */
+			}
+			this->table[i] = old[j];
+		}
+		free(old);
+	}
+	return offset;
+}
+
+/**
+ * Hash a section pointer
+ */
+static inline uint32_t hashSection(section_t *section)
+{
+	uintptr_t hash = (uintptr_t)section * 0x9e3779b1;
+
+	return hash ^ (hash >> 16);
+}
+
+/**
+ * Find the index of a section, CACHE_NONE if unknown
+ */
+static uint32_t sectionIndex(sectionMap_t *this, section_t *section)
+{
+	uint32_t i, idx;
+
+	for (i = hashSection(section) & this->mask; (idx = this->table[i]) != 0;
+		 i = (i + 1) & this->mask) {
+		if (this->sections[idx - 1] == section) {
+			return idx - 1;
+		}
+	}
+	return CACHE_NONE;
+}
+
+/**
+ * Collect a section and its subsections in pre-order
+ */
+static void collectSections(sectionMap_t *this, section_t *section,
+							uint32_t parent)
+{
+	section_t *sub;
+	uint32_t idx = this->count;
+	int i;
+
+	if (this->count == this->size) {
+		this->size *= 2;
+		this->sections = realloc(this->sections,
+								 this->size * sizeof(section_t*));
+		this->parents = realloc(this->parents, this->size * sizeof(uint32_t));
+	}
+	this->sections[idx] = section;
+	this->parents[idx] = parent;
+	this->count++;
+
+	for (i = 0; i < arrayCount(section->sections_order); ++i) {
+		arrayGet(section->sections_order, i, &sub);
+		collectSections(this, sub, idx);
+	}
+}
+
+/**
+ * Build the hash table of collected sections
+ */
+static void indexSections(sectionMap_t *this)
+{
+	uint32_t i, j;
+
+	this->mask = 15;
+	while (this->mask + 1 < this->count * 2) {
+		this->mask = this->mask * 2 + 1;
+	}
+	this->table = calloc(this->mask + 1, sizeof(uint32_t));
+	for (j = 0; j < this->count; ++j) {
+		for (i = hashSection(this->sections[j]) & this->mask; this->table[i];
+			 i = (i + 1) & this->mask) {
+			/* probe */
+		}
+		this->table[i] = j + 1;
+	}
+}
+
+/**
+ * Check if a recorded source is unchanged
+ */
+static bool checkSource(cacheSource_t *source, char *path)
+{
+	settingsSource_t current;
+	chunk_t *map;
+
+	settingsSourceStat(&current, path);
+	if (current.type != source->type) {
+		return FALSE;
+	}
+	switch (current.type) {
+		case SETTINGS_SOURCE_MISSING:
+			return TRUE;
+		case SETTINGS_SOURCE_DIR:
+			return current.mtime == source->mtime;
+		default:
+			if (current.size != source->size) {
+				return FALSE;
+			}
+			if (current.mtime == source->mtime) {
+				return TRUE;
+			}
+			/* the hash catches files touched without changes */
+			map = chunkMap(path, FALSE);
+			if (!map) {
+				return FALSE;
+			}
+			current.hash = chunkHashStatic(*map);
+			chunkUnmap(map);
+			return current.hash == source->hash;
+	}
+}
+
+/**
+ * Save a tree to a cache file, recording the pattern it was parsed from
+ */
+static bool saveCache(settingsTree_t *tree, char *path, char *pattern)
+{
+	cacheHeader_t header = {
+		.magic = CACHE_MAGIC,
+		.version = CACHE_VERSION,
+		.pattern = CACHE_NONE,
+	};
+	sectionMap_t map = { .size = 64 };
+	strtab_t strtab = { .mask = 255 };
+	buffer_t sources = {}, sections = {}, kvs = {}, fallbacks = {};
+	settingsSource_t *recorded;
+	cacheSource_t source;
+	cacheSection_t entry;
+	cacheKv_t kventry;
+	section_t *section, *fallback;
+	char tmp[PATH_MAX];
+	kv_t *kv;
+	uint32_t idx;
+	bool success = FALSE;
+	FILE *file;
+	int i;
+
+	if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= sizeof(tmp)) {
+		return FALSE;
+	}
+	strtab.table = calloc(strtab.mask + 1, sizeof(uint32_t));
+	map.sections = malloc(map.size * sizeof(section_t*));
+	map.parents = malloc(map.size * sizeof(uint32_t));
+	collectSections(&map, settingsTreeGetRoot(tree), CACHE_NONE);
+	indexSections(&map);
+
+	if (pattern) {
+		header.pattern = strtabAdd(&strtab, pattern);
+	}
+
+	/* the state of each source when it was read, not the current one */
+	for (i = 0; i < settingsTreeGetSourceCount(tree); ++i) {
+		recorded = settingsTreeGetSource(tree, i);
+		source = (cacheSource_t) {
+			.path = strtabAdd(&strtab, recorded->path),
+			.type = recorded->type,
+			.mtime = recorded->mtime,
+			.size = recorded->size,
+			.hash = recorded->hash,
+		};
+		bufferAppend(&sources, &source, sizeof(source));
+	}
+	for (idx = 0; idx < map.count; ++idx) {
+		section = map.sections[idx];
+		entry = (cacheSection_t) {
+			.name = section->name ? strtabAdd(&strtab, section->name)
+								  : CACHE_NONE,
+			.parent = map.parents[idx],
+		};
+		for (i = 0; i < arrayCount(section->kv_order); ++i) {
+			arrayGet(section->kv_order, i, &kv);
+			kventry = (cacheKv_t) {
+				.key = strtabAdd(&strtab, kv->key),
+				.value = kv->value ? strtabAdd(&strtab, kv->value) : CACHE_NONE,
+			};
+			bufferAppend(&kvs, &kventry, sizeof(kventry));
+			entry.kvs++;
+		}
+		for (i = 0; i < arrayCount(section->fallbacks); ++i) {
+			arrayGet(section->fallbacks, i, &fallback);
+			kventry.key = sectionIndex(&map, fallback);
+			if (kventry.key != CACHE_NONE) {
+				bufferAppend(&fallbacks, &kventry.key, sizeof(uint32_t));
+				entry.fallbacks++;
+			}
+		}
+		bufferAppend(&sections, &entry, sizeof(entry));
+	}
+	header.sources = sources.len / sizeof(cacheSource_t);
+	header.sections = sections.len / sizeof(cacheSection_t);
+	header.kvs = kvs.len / sizeof(cacheKv_t);
+	header.fallbacks = fallbacks.len / sizeof(uint32_t);
+	header.strings = strtab.data.len;
+
+	file = fopen(tmp, "w");
+	if (!file) {
+		DBG1(DBG_CFG, "writing settings cache '%s' failed: %s", tmp,
+			 strerror(errno));
+	} else {
+		success = fwrite(&header, sizeof(header), 1, file) == 1 &&
+				  bufferWrite(&sources, file) && bufferWrite(&sections, file) &&
+				  bufferWrite(&kvs, file) && bufferWrite(&fallbacks, file) &&
+				  bufferWrite(&strtab.data, file);
+		success = fclose(file) == 0 && success;
+		if (success && rename(tmp, path) == -1) {
+			success = FALSE;
+		}
+		if (!success) {
+			DBG1(DBG_CFG, "writing settings cache '%s' failed: %s", path,
+				 strerror(errno));
+			remove(tmp);
+		}
+	}
+
+	free(sources.ptr);
+	free(sections.ptr);
+	free(kvs.ptr);
+	free(fallbacks.ptr);
+	free(strtab.data.ptr);
+	free(strtab.table);
+	free(map.sections);
+	free(map.parents);
+	free(map.table);
+	return success;
+}
+
+bool settingsCacheSave(settingsTree_t *tree, char *path)
+{
+	return saveCache(tree, path, NULL);
+}
+
+/**
+ * Get a string from the string table, NULL if invalid
+ */
+static inline char *getString(chunk_t strings, uint32_t offset)
+{
+	if (offset >= strings.len) {
+		return NULL;
+	}
+	return (char*)strings.ptr + offset;
+}
+
+/**
+ * Build a tree from the validated cache file, NULL if invalid
+ */
+static settingsTree_t *buildTree(cacheHeader_t *header, cacheSource_t *sources,
+								 cacheSection_t *sections, cacheKv_t *kvs,
+								 uint32_t *fallbacks, chunk_t strings)
+{
+	settingsTree_t *tree;
+	settingsSource_t source;
+	section_t **nodes;
+	char *name, *key, *value;
+	uint32_t i, j, kv = 0, fallback = 0;
+	bool valid = TRUE;
+
+	if (!header->sections || sections[0].parent != CACHE_NONE) {
+		return NULL;
+	}
+	tree = settingsTreeCreate();
+	nodes = malloc(header->sections * sizeof(section_t*));
+	nodes[0] = settingsTreeGetRoot(tree);
+
+	for (i = 0; i < header->sources && valid; ++i) {
+		name = getString(strings, sources[i].path);
+		valid = name != NULL;
+		if (valid) {
+			source = (settingsSource_t) {
+				.path = name,
+				.type = sources[i].type,
+				.mtime = sources[i].mtime,
+				.size = sources[i].size,
+				.hash = sources[i].hash,
+			};
+			settingsTreeAddSource(tree, &source);
+		}
+	}
+	for (i = 1; i < header->sections && valid; ++i) {
+		name = getString(strings, sections[i].name);
+		valid = name && sections[i].parent < i;
+		if (valid) {
+			nodes[i] = settingsTreeGetSection(tree, nodes[sections[i].parent],
+											  chunkFromStr(name), TRUE);
+		}
+	}
+	for (i = 0; i < header->sections && valid; ++i) {
+		valid = sections[i].kvs <= header->kvs - kv &&
+				sections[i].fallbacks <= header->fallbacks - fallback;
+		for (j = 0; j < sections[i].kvs && valid; ++j, ++kv) {
+			key = getString(strings, kvs[kv].key);
+			value = NULL;
+			if (kvs[kv].value != CACHE_NONE) {
+				value = getString(strings, kvs[kv].value);
+				valid = value != NULL;
+			}
+			valid = valid && key;
+			if (valid) {
+				/* values point into the mapped cache */
+				settingsTreeSet(tree, nodes[i], chunkFromStr(key), value);
+			}
+		}
+		for (j = 0; j < sections[i].fallbacks && valid; ++j, ++fallback) {
+			valid = fallbacks[fallback] < header->sections;
+			if (valid) {
+				settingsTreeAddFallback(tree, nodes[i],
+										nodes[fallbacks[fallback]]);
+			}
+		}
+	}
+	free(nodes);
+	if (!valid) {
+		settingsTreeDestroy(tree);
+		return NULL;
+	}
+	return tree;
+}
+
+/**
+ * Load a tree from a cache file, if pattern is given it must match the
+ * pattern recorded in the cache
+ */
+static settingsTree_t *loadCache(char *path, char *pattern)
+{
+	settingsTree_t *tree = NULL;
+	cacheHeader_t *header;
+	cacheSource_t *sources;
+	cacheSection_t *sections;
+	cacheKv_t *kvs;
+	uint32_t *fallbacks, i;
+	chunk_t *map, strings;
+	uint64_t len;
+
+	map = chunkMap(path, FALSE);
+	if (!map) {
+		DBG2(DBG_CFG, "no settings cache '%s': %s", path, strerror(errno));
+		return NULL;
+	}
+	header = (cacheHeader_t*)map->ptr;
+	if (map->len < sizeof(*header) ||
+		memcmp(header->magic, CACHE_MAGIC, sizeof(header->magic)) ||
+		header->version != CACHE_VERSION) {
+		DBG1(DBG_CFG, "ignoring settings cache '%s' of unknown format", path);
+		chunkUnmap(map);
+		return NULL;
+	}
+	len = sizeof(*header) + (uint64_t)header->sources * sizeof(cacheSource_t) +
+		  (uint64_t)header->sections * sizeof(cacheSection_t) +
+		  (uint64_t)header->kvs * sizeof(cacheKv_t) +
+		  (uint64_t)header->fallbacks * sizeof(uint32_t) + header->strings;
+	if (len != map->len || !header->strings ||
+		map->ptr[map->len - 1] != '\0') {
+		DBG1(DBG_CFG, "ignoring invalid settings cache '%s'", path);
+		chunkUnmap(map);
+		return NULL;
+	}
+	sources = (cacheSource_t*)(header + 1);
+	sections = (cacheSection_t*)(sources + header->sources);
+	kvs = (cacheKv_t*)(sections + header->sections);
+	fallbacks = (uint32_t*)(kvs + header->kvs);
+	strings = chunkCreate((uint8_t*)(fallbacks + header->fallbacks),
+						  header->strings);
+
+	if (pattern && (header->pattern == CACHE_NONE ||
+					!streq(getString(strings, header->pattern) ?: "", pattern))) {
+		DBG1(DBG_CFG, "settings cache '%s' was created for a different pattern",
+			 path);
+		chunkUnmap(map);
+		return NULL;
+	}
+	for (i = 0; i < header->sources; ++i) {
+		if (sources[i].path >= strings.len ||
+			!checkSource(&sources[i], getString(strings, sources[i].path))) {
+			DBG1(DBG_CFG, "settings cache '%s' is outdated", path);
+			chunkUnmap(map);
+			return NULL;
+		}
+	}
+
+	tree = buildTree(header, sources, sections, kvs, fallbacks, strings);
+	if (!tree) {
+		DBG1(DBG_CFG, "ignoring invalid settings cache '%s'", path);
+		chunkUnmap(map);
+		return NULL;
+	}
+	settingsTreeAttach(tree, map);
+	DBG2(DBG_CFG, "loaded settings from cache '%s'", path);
+	return tree;
+}
+
+settingsTree_t *settingsCacheLoad(char *path)
+{
+	return loadCache(path, NULL);
+}
+
+settingsTree_t *settingsCacheLoadFiles(char *path, char *pattern,
+									   threadPool_t *pool)
+{
+	settingsTree_t *tree;
+	bool success;
+
+	tree = loadCache(path, pattern);
+	if (tree) {
+		return tree;
+	}
+	tree = settingsTreeCreate();
+	if (pool) {
+		success = settingsParseFilesParallel(tree, settingsTreeGetRoot(tree),
+											 pattern, pool);
+	} else {
+		success = settingsParseFiles(tree, settingsTreeGetRoot(tree), pattern);
+	}
+	if (!success) {
+		settingsTreeDestroy(tree);
+		return NULL;
+	}
+	saveCache(tree, path, pattern);
+	return tree;
+}
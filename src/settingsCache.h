@@ -0,0 +1,66 @@
+#ifndef _CHELP_SETTINGSCACHE_H
+#define _CHELP_SETTINGSCACHE_H 1
+
+#include "settingsTree.h" /* settingsTree_t */
+#include "threadPool.h" /* threadPool_t */
+
+/**
+ * Binary cache of parsed settings.
+ *
+ * A settingsTree_t is saved to a compact binary file containing its
+ * sections, key/values, fallbacks and a string table. Loading the cache
+ * mmap()s the file, values point directly into the mapping and only section
+ * names and keys get interned, so no text has to be parsed on startup.
+ *
+ * The cache records the sources of the tree (see settingsTreeAddSource())
+ * with their modification time, size and a hash of their contents as they
+ * were read by the parser, and the directories searched for include
+ * patterns. It is considered stale if any of them changed. The file format
+ * is versioned and uses the byte order of the host, a cache of a different
+ * version or architecture is ignored.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Save a settings tree to a cache file.
+ *
+ * The file is written to a temporary file first and then renamed, so a
+ * concurrent reader never sees a partial cache.
+ *
+ * @param tree		tree to save, with the sources it was parsed from
+ * @param path		path of the cache file
+ * @return			TRUE if the cache was written
+ */
+bool settingsCacheSave(settingsTree_t *tree, char *path);
+
+/**
+ * Load a settings tree from a cache file.
+ *
+ * @param path		path of the cache file
+ * @return			tree, NULL if the cache is missing, invalid or stale
+ */
+settingsTree_t *settingsCacheLoad(char *path);
+
+/**
+ * Load settings from a cache file, or parse them if the cache is stale.
+ *
+ * The cache records the pattern, a cache created for a different pattern
+ * or by settingsCacheSave() is not used. If the cache can't be used, the
+ * files matching the pattern are parsed and the cache is updated.
+ *
+ * @param path		path of the cache file
+ * @param pattern	file pattern to parse if the cache is stale
+ * @param pool		thread pool to parse files on, NULL to parse serially
+ * @return			tree, NULL if parsing failed
+ */
+settingsTree_t *settingsCacheLoadFiles(char *path, char *pattern,
+									   threadPool_t *pool);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CHELP_SETTINGSCACHE_H */
@@ -0,0 +1,308 @@
+#include "settingsHandle.h"
+
+#include <stdarg.h> /* va_list, va_start, va_end */
+#include <pthread.h> /* pthread_mutex_t */
+/* calloc, free, strdup, vasprintf */
+/* TRUE, FALSE, streq */
+
+/**
+ * Types of values
+ */
+typedef enum {
+	HANDLE_STR,
+	HANDLE_BOOL,
+	HANDLE_INT,
+	HANDLE_DOUBLE,
+	HANDLE_TIME,
+} handleType_t;
+
+/**
+ * A converted value, with all bits of the union defined
+ */
+typedef union {
+	char *str;
+	bool b;
+	int i;
+	double d;
+	uint32_t t;
+	uint64_t bits;
+} handleValue_t;
+
+struct settingsHandle_t {
+	settingsStore_t *store;		/**!< store to read value from */
+	handleType_t type;			/**!< type of the value */
+	char *key;					/**!< fully-qualified key */
+	handleValue_t def;			/**!< default value */
+	uint64_t value;				/**!< cached handleValue_t bits, atomic */
+	uint64_t generation;		/**!< generation of value, atomic */
+	pthread_mutex_t mutex;		/**!< serializes updates of the value */
+	settingsHandleCb_t cb;		/**!< change callback, or NULL */
+	void *data;					/**!< argument to cb */
+	bool hooked;				/**!< TRUE if registered with the store */
+	uint64_t changes;			/**!< number of changes of the value */
+	uint64_t notified;			/**!< changes reported to cb */
+};
+
+/**
+ * Convert a string value, returns TRUE if it differs from the cached value
+ */
+static bool convert(settingsHandle_t *this, char *str, handleValue_t *value)
+{
+	handleValue_t current = { .bits = this->value };
+
+	value->bits = 0;
+	switch (this->type) {
+		case HANDLE_STR:
+			str = str ?: this->def.str;
+			if (current.str && str && streq(current.str, str)) {
+				value->str = current.str;
+				return FALSE;
+			}
+			if (current.str == str) {
+				value->str = str;
+				return FALSE;
+			}
+			/* the old value might still be in use by readers */
+			if (current.str) {
+				settingsStoreRetire(this->store, current.str);
+			}
+			value->str = str ? strdup(str) : NULL;
+			return TRUE;
+		case HANDLE_BOOL:
+			value->b = settingsValueAsBool(str, this->def.b);
+			break;
+		case HANDLE_INT:
+			value->i = settingsValueAsInt(str, this->def.i);
+			break;
+		case HANDLE_DOUBLE:
+			value->d = settingsValueAsDouble(str, this->def.d);
+			break;
+		case HANDLE_TIME:
+			value->t = settingsValueAsTime(str, this->def.t);
+			break;
+	}
+	return value->bits != current.bits;
+}
+
+/**
+ * Update the cached value from a snapshot
+ */
+static void refresh(settingsHandle_t *this, settingsSnapshot_t *snapshot)
+{
+	uint64_t generation = settingsSnapshotGetGeneration(snapshot);
+	handleValue_t value;
+
+	pthread_mutex_lock(&this->mutex);
+	if (this->generation < generation) {
+		if (convert(this, settingsIndexGet(
+						settingsSnapshotGetIndex(snapshot), this->key), &value)) {
+			this->changes++;
+		}
+		__atomic_store_n(&this->value, value.bits, __ATOMIC_RELEASE);
+		__atomic_store_n(&this->generation, generation, __ATOMIC_RELEASE);
+	}
+	pthread_mutex_unlock(&this->mutex);
+}
+
+/**
+ * Get the cached value, updating it if it is outdated
+ */
+static handleValue_t get(settingsHandle_t *this)
+{
+	handleValue_t value;
+
+	if (__atomic_load_n(&this->generation, __ATOMIC_ACQUIRE) <
+		settingsStoreGetGeneration(this->store)) {
+		refresh(this, settingsStorePin(this->store));
+		settingsStoreUnpin(this->store);
+	}
+	value.bits = __atomic_load_n(&this->value, __ATOMIC_ACQUIRE);
+	return value;
+}
+
+/**
+ * Hook registered with the store if a callback is set
+ *
+ * A getter may have refreshed the value since the snapshot got published,
+ * so compare with the changes reported so far, not with the cached value.
+ */
+static void changed(void *data, settingsSnapshot_t *snapshot)
+{
+	settingsHandle_t *this = data;
+	settingsHandleCb_t cb = NULL;
+	void *cbData;
+
+	refresh(this, snapshot);
+
+	pthread_mutex_lock(&this->mutex);
+	if (this->notified != this->changes) {
+		this->notified = this->changes;
+		cb = this->cb;
+		cbData = this->data;
+	}
+	pthread_mutex_unlock(&this->mutex);
+	if (cb) {
+		cb(this, cbData);
+	}
+}
+
+/**
+ * Create a handle of the given type
+ */
+static settingsHandle_t *create(settingsStore_t *store, handleType_t type,
+								handleValue_t def, char *key, va_list args)
+{
+	settingsHandle_t *this = (settingsHandle_t *)calloc(1, sizeof(*this));
+
+	this->store = store;
+	this->type = type;
+	this->def = def;
+	if (vasprintf(&this->key, key, args) < 0) {
+		this->key = strdup("");
+	}
+	pthread_mutex_init(&this->mutex, NULL);
+
+	refresh(this, settingsStorePin(store));
+	settingsStoreUnpin(store);
+
+	return this;
+}
+
+settingsHandle_t *settingsHandleCreateStr(settingsStore_t *store, char *def,
+										  char *key, ...)
+{
+	handleValue_t value = { .bits = 0 };
+	settingsHandle_t *this;
+	va_list args;
+
+	value.str = def ? strdup(def) : NULL;
+	va_start(args, key);
+	this = create(store, HANDLE_STR, value, key, args);
+	va_end(args);
+
+	return this;
+}
+
+settingsHandle_t *settingsHandleCreateBool(settingsStore_t *store, bool def,
+										   char *key, ...)
+{
+	handleValue_t value = { .bits = 0 };
+	settingsHandle_t *this;
+	va_list args;
+
+	value.b = def;
+	va_start(args, key);
+	this = create(store, HANDLE_BOOL, value, key, args);
+	va_end(args);
+
+	return this;
+}
+
+settingsHandle_t *settingsHandleCreateInt(settingsStore_t *store, int def,
+										  char *key, ...)
+{
+	handleValue_t value = { .bits = 0 };
+	settingsHandle_t *this;
+	va_list args;
+
+	value.i = def;
+	va_start(args, key);
+	this = create(store, HANDLE_INT, value, key, args);
+	va_end(args);
+
+	return this;
+}
+
+settingsHandle_t *settingsHandleCreateDouble(settingsStore_t *store, double def,
+											 char *key, ...)
+{
+	handleValue_t value = { .bits = 0 };
+	settingsHandle_t *this;
+	va_list args;
+
+	value.d = def;
+	va_start(args, key);
+	this = create(store, HANDLE_DOUBLE, value, key, args);
+	va_end(args);
+
+	return this;
+}
+
+settingsHandle_t *settingsHandleCreateTime(settingsStore_t *store, uint32_t def,
+										   char *key, ...)
+{
+	handleValue_t value = { .bits = 0 };
+	settingsHandle_t *this;
+	va_list args;
+
+	value.t = def;
+	va_start(args, key);
+	this = create(store, HANDLE_TIME, value, key, args);
+	va_end(args);
+
+	return this;
+}
+
+char *settingsHandleGetStr(settingsHandle_t *this)
+{
+	return get(this).str;
+}
+
+bool settingsHandleGetBool(settingsHandle_t *this)
+{
+	return get(this).b;
+}
+
+int settingsHandleGetInt(settingsHandle_t *this)
+{
+	return get(this).i;
+}
+
+double settingsHandleGetDouble(settingsHandle_t *this)
+{
+	return get(this).d;
+}
+
+uint32_t settingsHandleGetTime(settingsHandle_t *this)
+{
+	return get(this).t;
+}
+
+char *settingsHandleGetKey(settingsHandle_t *this)
+{
+	return this->key;
+}
+
+void settingsHandleOnChange(settingsHandle_t *this, settingsHandleCb_t cb,
+							void *data)
+{
+	pthread_mutex_lock(&this->mutex);
+	this->cb = cb;
+	this->data = data;
+	this->notified = this->changes;
+	pthread_mutex_unlock(&this->mutex);
+
+	if (cb && !this->hooked) {
+		settingsStoreAddHook(this->store, changed, this);
+		this->hooked = TRUE;
+	} else if (!cb && this->hooked) {
+		settingsStoreRemoveHook(this->store, changed, this);
+		this->hooked = FALSE;
+	}
+}
+
+void settingsHandleDestroy(settingsHandle_t *this)
+{
+	handleValue_t value = { .bits = this->value };
+
+	if (this->hooked) {
+		settingsStoreRemoveHook(this->store, changed, this);
+	}
+	if (this->type == HANDLE_STR) {
+		free(value.str);
+		free(this->def.str);
+	}
+	free(this->key);
+	pthread_mutex_destroy(&this->mutex);
+	free(this);
+}
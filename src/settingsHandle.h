@@ -0,0 +1,164 @@
+#ifndef _CHELP_SETTINGSHANDLE_H
+#define _CHELP_SETTINGSHANDLE_H 1
+
+#include "settingsSnapshot.h" /* settingsStore_t */
+
+/**
+ * Typed handles to settings values.
+ *
+ * A handle binds a key of a settingsStore_t to a type and caches the
+ * converted value. Getting the value only compares the generation of the
+ * cached value with that of the store, the string value is looked up and
+ * converted again only after new settings have been loaded or set.
+ *
+ * @code
+ * timeout = settingsHandleCreateTime(store, 30, "%s.timeout", name);
+ * ...
+ * sleep(settingsHandleGetTime(timeout));
+ * @endcode
+ *
+ * Optionally, a callback is invoked whenever the converted value changes.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct settingsHandle_t settingsHandle_t;
+
+/**
+ * Callback invoked when the value of a handle changed.
+ *
+ * The callback is called while updates of the store are serialized, it
+ * must not update the store.
+ *
+ * @param handle	handle whose value changed
+ * @param data		data passed to settingsHandleOnChange()
+ */
+typedef void (*settingsHandleCb_t)(settingsHandle_t *handle, void *data);
+
+/**
+ * Create a handle to a string value.
+ *
+ * @param store		store to read value from
+ * @param def		value if key not found (gets cloned)
+ * @param key		key including sections, printf style format
+ * @param ...		argument list for key
+ * @return			handle
+ */
+settingsHandle_t *settingsHandleCreateStr(settingsStore_t *store, char *def,
+										  char *key, ...);
+
+/**
+ * Create a handle to a boolean value.
+ *
+ * @param store		store to read value from
+ * @param def		value if key not found or invalid
+ * @param key		key including sections, printf style format
+ * @param ...		argument list for key
+ * @return			handle
+ */
+settingsHandle_t *settingsHandleCreateBool(settingsStore_t *store, bool def,
+										   char *key, ...);
+
+/**
+ * Create a handle to an integer value.
+ *
+ * @param store		store to read value from
+ * @param def		value if key not found or invalid
+ * @param key		key including sections, printf style format
+ * @param ...		argument list for key
+ * @return			handle
+ */
+settingsHandle_t *settingsHandleCreateInt(settingsStore_t *store, int def,
+										  char *key, ...);
+
+/**
+ * Create a handle to a double value.
+ *
+ * @param store		store to read value from
+ * @param def		value if key not found or invalid
+ * @param key		key including sections, printf style format
+ * @param ...		argument list for key
+ * @return			handle
+ */
+settingsHandle_t *settingsHandleCreateDouble(settingsStore_t *store, double def,
+											 char *key, ...);
+
+/**
+ * Create a handle to a time value.
+ *
+ * @param store		store to read value from
+ * @param def		value if key not found or invalid
+ * @param key		key including sections, printf style format
+ * @param ...		argument list for key
+ * @return			handle
+ */
+settingsHandle_t *settingsHandleCreateTime(settingsStore_t *store, uint32_t def,
+										   char *key, ...);
+
+/**
+ * Get the value of a string handle.
+ *
+ * After the value changed, the previous value is freed once the next
+ * update of the store is published. To use the value across updates,
+ * keep the store pinned while using it.
+ *
+ * @return			value
+ */
+char *settingsHandleGetStr(settingsHandle_t *this);
+
+/**
+ * Get the value of a boolean handle.
+ *
+ * @return			value
+ */
+bool settingsHandleGetBool(settingsHandle_t *this);
+
+/**
+ * Get the value of an integer handle.
+ *
+ * @return			value
+ */
+int settingsHandleGetInt(settingsHandle_t *this);
+
+/**
+ * Get the value of a double handle.
+ *
+ * @return			value
+ */
+double settingsHandleGetDouble(settingsHandle_t *this);
+
+/**
+ * Get the value of a time handle.
+ *
+ * @return			value in seconds
+ */
+uint32_t settingsHandleGetTime(settingsHandle_t *this);
+
+/**
+ * Get the fully-qualified key of a handle.
+ *
+ * @return			key
+ */
+char *settingsHandleGetKey(settingsHandle_t *this);
+
+/**
+ * Set a callback invoked when the value changes.
+ *
+ * @param cb		callback, NULL to unset
+ * @param data		argument passed to cb
+ */
+void settingsHandleOnChange(settingsHandle_t *this, settingsHandleCb_t cb,
+							void *data);
+
+/**
+ * Destroy a settingsHandle_t.
+ */
+void settingsHandleDestroy(settingsHandle_t *this);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CHELP_SETTINGSHANDLE_H */
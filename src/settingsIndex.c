@@ -0,0 +1,379 @@
+#include "settingsIndex.h"
+#include "chunk.h"
+#include "chunkArena.h"
+
+#include <stdarg.h> /* va_list, va_start, va_end */
+#include <errno.h> /* errno */
+#include <limits.h> /* INT_MIN, INT_MAX */
+/* malloc, calloc, realloc, free, strtol, strtod, strtoul */
+/* memcpy, strlen, strcmp, strcasecmp */
+/* vsnprintf */
+/* arrayCount, arrayGet */
+/* TRUE, FALSE, min, streq */
+
+/**
+ * Maximum nesting of sections and fallbacks followed while flattening
+ */
+#define SETTINGS_INDEX_MAX_DEPTH 64
+
+typedef struct indexKv_t indexKv_t;
+typedef struct flatten_t flatten_t;
+
+/**
+ * A fully-qualified key and its value
+ */
+struct indexKv_t {
+	char *key;			/**!< fully-qualified key, allocated from arena */
+	char *value;		/**!< value, pointing to the tree */
+	uint32_t hash;		/**!< chunkHash() of key */
+};
+
+struct settingsIndex_t {
+	chunkArena_t *arena;	/**!< storage of fully-qualified keys */
+	indexKv_t *entries;		/**!< keys in order of resolution */
+	uint32_t count;			/**!< number of entries */
+	uint32_t size;			/**!< allocated entries */
+	uint32_t *table;		/**!< hash table, entry + 1, 0 is empty */
+	uint32_t mask;			/**!< size of table - 1 */
+};
+
+/**
+ * State while flattening the tree
+ */
+struct flatten_t {
+	char key[SETTINGS_INDEX_MAX_KEY];		/**!< current key prefix */
+	struct {
+		section_t *section;					/**!< section being visited */
+		bool fallback;						/**!< TRUE if entered as fallback */
+	} stack[SETTINGS_INDEX_MAX_DEPTH];		/**!< sections being visited */
+	int depth;								/**!< number of sections on stack */
+};
+
+/**
+ * Find an entry by key and hash, returns the table slot
+ */
+static uint32_t findSlot(settingsIndex_t *this, const char *key, uint32_t hash)
+{
+	uint32_t i, entry;
+
+	for (i = hash & this->mask; (entry = this->table[i]) != 0;
+		 i = (i + 1) & this->mask) {
+		if (this->entries[entry - 1].hash == hash &&
+			streq(this->entries[entry - 1].key, key)) {
+			break;
+		}
+	}
+	return i;
+}
+
+/**
+ * Double the size of the hash table
+ */
+static void grow(settingsIndex_t *this)
+{
+	uint32_t i, j, size = (this->mask + 1) * 2;
+
+	free(this->table);
+	this->table = calloc(size, sizeof(uint32_t));
+	this->mask = size - 1;
+	for (i = 0; i < this->count; ++i) {
+		for (j = this->entries[i].hash & this->mask; this->table[j];
+			 j = (j + 1) & this->mask) {
+			/* probe */
+		}
+		this->table[j] = i + 1;
+	}
+}
+
+/**
+ * Add a key if it is not yet known, keys added first take precedence
+ */
+static void addKey(settingsIndex_t *this, char *key, size_t len, char *value)
+{
+	uint32_t slot, hash;
+	indexKv_t *entry;
+
+	hash = chunkHash(chunkCreate((uint8_t*)key, len));
+	slot = findSlot(this, key, hash);
+	if (this->table[slot]) {
+		return;
+	}
+	if (this->count == this->size) {
+		this->size *= 2;
+		this->entries = realloc(this->entries, this->size * sizeof(indexKv_t));
+	}
+	entry = &this->entries[this->count++];
+	*entry = (indexKv_t) {
+		.key = (char*)chunkArenaClone(this->arena,
+									  chunkCreate((uint8_t*)key, len + 1)).ptr,
+		.value = value,
+		.hash = hash,
+	};
+	this->table[slot] = this->count;
+
+	if (this->count * 2 > this->mask + 1) {
+		grow(this);
+	}
+}
+
+/**
+ * Add all keys of a section, its subsections and fallbacks below the
+ * prefix of len bytes in state->key
+ *
+ * A fallback may refer to a section currently visited, e.g. a parent. Its
+ * keys are added, but none of its subsections are entered. Otherwise each
+ * subsection falling back to its parent would index all of its siblings,
+ * growing the index quadratically. A section is never entered twice as
+ * fallback, which would loop forever.
+ */
+static void flatten(settingsIndex_t *this, flatten_t *state, section_t *section,
+					size_t len, bool fallback)
+{
+	section_t *sub;
+	kv_t *kv;
+	size_t nameLen;
+	bool visiting = FALSE;
+	int i;
+
+	for (i = 0; i < state->depth; ++i) {
+		if (state->stack[i].section == section) {
+			if (!fallback || state->stack[i].fallback) {
+				return;
+			}
+			visiting = TRUE;
+		}
+	}
+	if (state->depth == SETTINGS_INDEX_MAX_DEPTH) {
+		return;
+	}
+	state->stack[state->depth].section = section;
+	state->stack[state->depth++].fallback = fallback;
+
+	for (i = 0; i < arrayCount(section->kv); ++i) {
+		arrayGet(section->kv, i, &kv);
+		nameLen = strlen(kv->key);
+		if (!kv->value || len + nameLen >= sizeof(state->key)) {
+			continue;
+		}
+		memcpy(state->key + len, kv->key, nameLen + 1);
+		addKey(this, state->key, len + nameLen, kv->value);
+	}
+	for (i = 0; !visiting && i < arrayCount(section->section); ++i) {
+		arrayGet(section->section, i, &sub);
+		nameLen = strlen(sub->name);
+		if (len + nameLen + 1 >= sizeof(state->key)) {
+			continue;
+		}
+		memcpy(state->key + len, sub->name, nameLen);
+		state->key[len + nameLen] = '.';
+		flatten(this, state, sub, len + nameLen + 1, FALSE);
+	}
+	for (i = 0; i < arrayCount(section->fallbacks); ++i) {
+		arrayGet(section->fallbacks, i, &sub);
+		flatten(this, state, sub, len, TRUE);
+	}
+	state->depth--;
+}
+
+settingsIndex_t *settingsIndexCreate(section_t *root)
+{
+	settingsIndex_t *this;
+	flatten_t state;
+
+	this = (settingsIndex_t *)calloc(1, sizeof(*this));
+	this->arena = chunkArenaCreate(0, FALSE);
+	this->size = 64;
+	this->entries = malloc(this->size * sizeof(indexKv_t));
+	this->mask = 127;
+	this->table = calloc(this->mask + 1, sizeof(uint32_t));
+
+	state.depth = 0;
+	flatten(this, &state, root, 0, FALSE);
+
+	return this;
+}
+
+uint32_t settingsIndexCount(settingsIndex_t *this)
+{
+	return this->count;
+}
+
+char *settingsIndexGet(settingsIndex_t *this, const char *key)
+{
+	uint32_t slot, hash;
+
+	hash = chunkHash(chunkCreate((uint8_t*)key, strlen(key)));
+	slot = findSlot(this, key, hash);
+	if (!this->table[slot]) {
+		return NULL;
+	}
+	return this->entries[this->table[slot] - 1].value;
+}
+
+char *settingsIndexVget(settingsIndex_t *this, const char *key, va_list args)
+{
+	char buf[SETTINGS_INDEX_MAX_KEY];
+	int len;
+
+	len = vsnprintf(buf, sizeof(buf), key, args);
+	if (len < 0 || len >= sizeof(buf)) {
+		return NULL;
+	}
+	return settingsIndexGet(this, buf);
+}
+
+char *settingsIndexGetStr(settingsIndex_t *this, char *key, char *def, ...)
+{
+	va_list args;
+	char *value;
+
+	va_start(args, def);
+	value = settingsIndexVget(this, key, args);
+	va_end(args);
+
+	return value ?: def;
+}
+
+bool settingsIndexGetBool(settingsIndex_t *this, char *key, int def, ...)
+{
+	va_list args;
+	char *value;
+
+	va_start(args, def);
+	value = settingsIndexVget(this, key, args);
+	va_end(args);
+
+	return settingsValueAsBool(value, def);
+}
+
+int settingsIndexGetInt(settingsIndex_t *this, char *key, int def, ...)
+{
+	va_list args;
+	char *value;
+
+	va_start(args, def);
+	value = settingsIndexVget(this, key, args);
+	va_end(args);
+
+	return settingsValueAsInt(value, def);
+}
+
+double settingsIndexGetDouble(settingsIndex_t *this, char *key, double def, ...)
+{
+	va_list args;
+	char *value;
+
+	va_start(args, def);
+	value = settingsIndexVget(this, key, args);
+	va_end(args);
+
+	return settingsValueAsDouble(value, def);
+}
+
+uint32_t settingsIndexGetTime(settingsIndex_t *this, char *key, uint32_t def, ...)
+{
+	va_list args;
+	char *value;
+
+	va_start(args, def);
+	value = settingsIndexVget(this, key, args);
+	va_end(args);
+
+	return settingsValueAsTime(value, def);
+}
+
+bool settingsValueAsBool(char *value, bool def)
+{
+	if (!value) {
+		return def;
+	}
+#define VALUE_IS(str) (strcasecmp(value, str) == 0)
+	if (VALUE_IS("yes") || VALUE_IS("true") ||
+		VALUE_IS("enabled") || VALUE_IS("1")) {
+		return TRUE;
+	}
+	if (VALUE_IS("no") || VALUE_IS("false") ||
+		VALUE_IS("disabled") || VALUE_IS("0")) {
+		return FALSE;
+	}
+#undef VALUE_IS
+	return def;
+}
+
+int settingsValueAsInt(char *value, int def)
+{
+	char *end;
+	long val;
+
+	if (!value || !*value) {
+		return def;
+	}
+	errno = 0;
+	val = strtol(value, &end, 10);
+	if (errno || *end || val < INT_MIN || val > INT_MAX) {
+		return def;
+	}
+	return val;
+}
+
+double settingsValueAsDouble(char *value, double def)
+{
+	char *end;
+	double val;
+
+	if (!value || !*value) {
+		return def;
+	}
+	errno = 0;
+	val = strtod(value, &end);
+	if (errno || *end) {
+		return def;
+	}
+	return val;
+}
+
+uint32_t settingsValueAsTime(char *value, uint32_t def)
+{
+	unsigned long val;
+	char *end;
+
+	if (!value || !*value) {
+		return def;
+	}
+	errno = 0;
+	val = strtoul(value, &end, 10);
+	if (errno || val > UINT32_MAX) {
+		return def;
+	}
+	while (*end == ' ') {
+		end++;
+	}
+	switch (*end) {
+		case 'd':
+			val *= 24 * 3600;
+			break;
+		case 'h':
+			val *= 3600;
+			break;
+		case 'm':
+			val *= 60;
+			break;
+		case 's':
+		case '\0':
+			break;
+		default:
+			return def;
+	}
+	if (*end && end[1]) {
+		return def;
+	}
+	return min(val, UINT32_MAX);
+}
+
+void settingsIndexDestroy(settingsIndex_t *this)
+{
+	chunkArenaDestroy(this->arena);
+	free(this->entries);
+	free(this->table);
+	free(this);
+}
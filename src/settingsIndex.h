@@ -0,0 +1,171 @@
+#ifndef _CHELP_SETTINGSINDEX_H
+#define _CHELP_SETTINGSINDEX_H 1
+
+#include "settings_type.h" /* section_t */
+
+/**
+ * Flattened hash index over a settings tree.
+ *
+ * Looking up a dotted key in the section_t tree walks the subsections of each
+ * path segment and, where a lookup fails, the configured fallbacks, on every
+ * call. The index resolves all of this once: each key reachable from the root
+ * is stored with its fully-qualified name (e.g. section-one.subsection.key),
+ * including keys only reachable through fallbacks. A lookup then takes a
+ * single hash probe, regardless of the number of sections or fallbacks.
+ *
+ * Resolution follows the rules of settingsAddFallback(): keys of a section
+ * take precedence over keys of its subsections' fallbacks, which take
+ * precedence over keys of the section's own fallbacks, depth-first in the
+ * order the fallbacks were added. A fallback to an ancestor section, e.g.
+ * conn.peer to conn, only provides the ancestor's keys, not its subsections,
+ * so the index stays linear in the number of such sections.
+ *
+ * The index references keys and values of the tree, it must be rebuilt
+ * whenever the tree is modified, i.e. by settingsLoad*() and settingsSet*().
+ *
+ * @note The hash table uses chunkHash(), chunkHashSeed() must be called
+ * before creating an index.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Maximum length of a fully-qualified key, longer keys are not indexed.
+ */
+#define SETTINGS_INDEX_MAX_KEY 512
+
+typedef struct settingsIndex_t settingsIndex_t;
+
+/**
+ * Create an index over a settings tree.
+ *
+ * @param root		top level section, must outlive the index
+ * @return			index
+ */
+settingsIndex_t *settingsIndexCreate(section_t *root);
+
+/**
+ * Get the number of keys in the index.
+ *
+ * @return			number of fully-qualified keys
+ */
+uint32_t settingsIndexCount(settingsIndex_t *this);
+
+/**
+ * Get the value of a fully-qualified key.
+ *
+ * @param key		key including sections, not a format string
+ * @return			value pointing to the tree, NULL if not found
+ */
+char *settingsIndexGet(settingsIndex_t *this, const char *key);
+
+/**
+ * Get the value of a key, va_list variant.
+ *
+ * @param key		key including sections, printf style format
+ * @param args		argument list for key
+ * @return			value pointing to the tree, NULL if not found
+ */
+char *settingsIndexVget(settingsIndex_t *this, const char *key, va_list args);
+
+/**
+ * Get a settings value as a string.
+ *
+ * @param key		key including sections, printf style format
+ * @param def		value returned if key not found
+ * @param ...		argument list for key
+ * @return			value pointing to the tree
+ */
+char *settingsIndexGetStr(settingsIndex_t *this, char *key, char *def, ...);
+
+/**
+ * Get a boolean yes|no, true|false value.
+ *
+ * @param key		key including sections, printf style format
+ * @param def		value returned if key not found or invalid, as int as
+ *					va_start() can't follow a promoted bool
+ * @param ...		argument list for key
+ * @return			value of the key
+ */
+bool settingsIndexGetBool(settingsIndex_t *this, char *key, int def, ...);
+
+/**
+ * Get a settings value as an integer.
+ *
+ * @param key		key including sections, printf style format
+ * @param def		value returned if key not found or invalid
+ * @param ...		argument list for key
+ * @return			value of the key
+ */
+int settingsIndexGetInt(settingsIndex_t *this, char *key, int def, ...);
+
+/**
+ * Get a settings value as a double.
+ *
+ * @param key		key including sections, printf style format
+ * @param def		value returned if key not found or invalid
+ * @param ...		argument list for key
+ * @return			value of the key
+ */
+double settingsIndexGetDouble(settingsIndex_t *this, char *key, double def, ...);
+
+/**
+ * Get a settings value as a time value, in seconds.
+ *
+ * Values may use the suffixes s, m, h or d.
+ *
+ * @param key		key including sections, printf style format
+ * @param def		value returned if key not found or invalid
+ * @param ...		argument list for key
+ * @return			value of the key
+ */
+uint32_t settingsIndexGetTime(settingsIndex_t *this, char *key, uint32_t def, ...);
+
+/**
+ * Convert a settings value to a boolean.
+ *
+ * @param value		value, may be NULL
+ * @param def		value returned if value is NULL or invalid
+ * @return			converted value
+ */
+bool settingsValueAsBool(char *value, bool def);
+
+/**
+ * Convert a settings value to an integer.
+ *
+ * @param value		value, may be NULL
+ * @param def		value returned if value is NULL or invalid
+ * @return			converted value
+ */
+int settingsValueAsInt(char *value, int def);
+
+/**
+ * Convert a settings value to a double.
+ *
+ * @param value		value, may be NULL
+ * @param def		value returned if value is NULL or invalid
+ * @return			converted value
+ */
+double settingsValueAsDouble(char *value, double def);
+
+/**
+ * Convert a settings value to a time value, in seconds.
+ *
+ * @param value		value, may be NULL
+ * @param def		value returned if value is NULL or invalid
+ * @return			converted value
+ */
+uint32_t settingsValueAsTime(char *value, uint32_t def);
+
+/**
+ * Destroy a settingsIndex_t.
+ */
+void settingsIndexDestroy(settingsIndex_t *this);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CHELP_SETTINGSINDEX_H */
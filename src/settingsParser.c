@@ -0,0 +1,487 @@
+#include "settingsParser.h"
+#include "threadPool.h"
+
+#include <glob.h> /* glob, globfree, GLOB_ONLYDIR */
+#include <errno.h> /* errno */
+#include <limits.h> /* PATH_MAX */
+/* calloc, malloc, free */
+/* memcmp, memchr, memcpy, strerror, strlen, strchr, strrchr */
+/* snprintf */
+/* DBG1, DBG2, DBG_CFG */
+/* TRUE, FALSE, max */
+
+typedef struct parser_t parser_t;
+
+/**
+ * State while parsing a file or string
+ */
+struct parser_t {
+	settingsTree_t *tree;	/**!< tree to parse to */
+	const char *file;		/**!< name of the file, NULL for strings */
+	uint8_t *pos;			/**!< current position */
+	uint8_t *end;			/**!< end of data */
+	int line;				/**!< current line number */
+	int depth;				/**!< include depth */
+	threadPool_t *pool;		/**!< pool to parse includes on, or NULL */
+};
+
+typedef struct parseJob_t parseJob_t;
+
+/**
+ * A file parsed to a separate tree on the thread pool
+ */
+struct parseJob_t {
+	char *file;				/**!< file to parse */
+	int depth;				/**!< include depth */
+	threadPool_t *pool;		/**!< pool for nested includes */
+	settingsTree_t *tree;	/**!< tree parsed to */
+	bool success;			/**!< TRUE if parsing succeeded */
+};
+
+static bool parseInclude(parser_t *this, section_t *section, char *pattern);
+
+/**
+ * Log a parser error
+ */
+#define PARSE_ERROR(this, fmt, ...) \
+	DBG1(DBG_CFG, "parsing settings failed: %s:%d: " fmt, \
+		 (this)->file ?: "<string>", (this)->line, ##__VA_ARGS__)
+
+/**
+ * Skip whitespace and comments, line breaks only if requested
+ */
+static void skipSpace(parser_t *this, bool lines)
+{
+	while (this->pos < this->end) {
+		switch (*this->pos) {
+			case '\n':
+				if (!lines) {
+					return;
+				}
+				this->line++;
+				/* FALL */
+			case ' ':
+			case '\t':
+			case '\r':
+				this->pos++;
+				continue;
+			case '#':
+				while (this->pos < this->end && *this->pos != '\n') {
+					this->pos++;
+				}
+				continue;
+			default:
+				return;
+		}
+	}
+}
+
+/**
+ * Check if a character may be part of a section name or key
+ */
+static inline bool isNameChar(uint8_t c)
+{
+	switch (c) {
+		case ' ':
+		case '\t':
+		case '\r':
+		case '\n':
+		case '{':
+		case '}':
+		case '=':
+		case '#':
+		case '"':
+			return FALSE;
+		default:
+			return TRUE;
+	}
+}
+
+/**
+ * Parse a section name or key
+ */
+static chunk_t parseName(parser_t *this)
+{
+	uint8_t *start = this->pos;
+
+	while (this->pos < this->end && isNameChar(*this->pos)) {
+		this->pos++;
+	}
+	return chunkCreate(start, this->pos - start);
+}
+
+/**
+ * Replace escape sequences in a quoted value, in place
+ */
+static void unescape(char *str)
+{
+	char *out = str;
+
+	for (; *str; str++) {
+		if (*str == '\\' && str[1]) {
+			switch (*++str) {
+				case 'n':
+					*out++ = '\n';
+					continue;
+				case 't':
+					*out++ = '\t';
+					continue;
+				default:
+					break;
+			}
+		}
+		*out++ = *str;
+	}
+	*out = '\0';
+}
+
+/**
+ * Parse a value until the end of the line, or a quoted value
+ */
+static bool parseValue(parser_t *this, char **value)
+{
+	uint8_t *start, *last;
+	int line = this->line;
+
+	while (this->pos < this->end &&
+		  (*this->pos == ' ' || *this->pos == '\t')) {
+		this->pos++;
+	}
+	if (this->pos < this->end && *this->pos == '"') {
+		start = ++this->pos;
+		while (this->pos < this->end && *this->pos != '"') {
+			if (*this->pos == '\\' && this->pos + 1 < this->end) {
+				this->pos++;
+			}
+			if (*this->pos == '\n') {
+				this->line++;
+			}
+			this->pos++;
+		}
+		if (this->pos == this->end) {
+			this->line = line;
+			PARSE_ERROR(this, "missing closing quote");
+			return FALSE;
+		}
+		*value = settingsTreeString(this->tree,
+									chunkCreate(start, this->pos++ - start));
+		unescape(*value);
+	} else {
+		start = last = this->pos;
+		while (this->pos < this->end && *this->pos != '\n' &&
+			   *this->pos != '#') {
+			if (*this->pos != ' ' && *this->pos != '\t' && *this->pos != '\r') {
+				last = this->pos + 1;
+			}
+			this->pos++;
+		}
+		*value = settingsTreeString(this->tree, chunkCreate(start, last - start));
+	}
+	skipSpace(this, FALSE);
+	if (this->pos < this->end && *this->pos != '\n') {
+		PARSE_ERROR(this, "unexpected '%c' after value", *this->pos);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+/**
+ * Parse the contents of a section, until the closing brace if nested
+ */
+static bool parseSection(parser_t *this, section_t *section, bool nested)
+{
+	section_t *sub;
+	chunk_t name;
+	char *value;
+
+	while (TRUE) {
+		skipSpace(this, TRUE);
+		if (this->pos == this->end) {
+			if (nested) {
+				PARSE_ERROR(this, "missing '}'");
+				return FALSE;
+			}
+			return TRUE;
+		}
+		if (*this->pos == '}') {
+			if (!nested) {
+				PARSE_ERROR(this, "unexpected '}'");
+				return FALSE;
+			}
+			this->pos++;
+			return TRUE;
+		}
+		name = parseName(this);
+		if (!name.len) {
+			PARSE_ERROR(this, "unexpected '%c'", *this->pos);
+			return FALSE;
+		}
+		skipSpace(this, FALSE);
+		if (this->pos < this->end && *this->pos == '{') {
+			this->pos++;
+			sub = settingsTreeGetSection(this->tree, section, name, TRUE);
+			if (!parseSection(this, sub, TRUE)) {
+				return FALSE;
+			}
+		} else if (this->pos < this->end && *this->pos == '=') {
+			this->pos++;
+			if (!parseValue(this, &value)) {
+				return FALSE;
+			}
+			settingsTreeSet(this->tree, section, name, value);
+		} else if (name.len == strlen("include") &&
+				   memcmp(name.ptr, "include", name.len) == 0) {
+			if (!parseValue(this, &value) ||
+				!parseInclude(this, section, value)) {
+				return FALSE;
+			}
+		} else {
+			PARSE_ERROR(this, "expected '{' or '=' after '%.*s'",
+						(int)name.len, name.ptr);
+			return FALSE;
+		}
+	}
+}
+
+/**
+ * Parse data of a file or string
+ */
+static bool parseData(settingsTree_t *tree, section_t *section,
+					  const char *file, chunk_t data, int depth,
+					  threadPool_t *pool)
+{
+	parser_t parser = {
+		.tree = tree,
+		.file = file,
+		.pos = data.ptr,
+		.end = data.ptr + data.len,
+		.line = 1,
+		.depth = depth,
+		.pool = pool,
+	};
+
+	return parseSection(&parser, section, FALSE);
+}
+
+/**
+ * Parse a single file at the given include depth
+ */
+static bool parseFile(settingsTree_t *tree, section_t *section, char *file,
+					  int depth, threadPool_t *pool)
+{
+	settingsSource_t source;
+	chunk_t *map;
+	bool success;
+
+	/* stat before reading, so changes while we read invalidate a cache */
+	settingsSourceStat(&source, file);
+	map = chunkMap(file, FALSE);
+	if (!map) {
+		DBG1(DBG_CFG, "failed to open config file '%s': %s", file,
+			 strerror(errno));
+		return FALSE;
+	}
+	DBG2(DBG_CFG, "loading config file '%s'", file);
+	source.hash = chunkHashStatic(*map);
+	settingsTreeAddSource(tree, &source);
+	success = parseData(tree, section, file, *map, depth, pool);
+	chunkUnmap(map);
+	return success;
+}
+
+/**
+ * Parse a file to a separate tree, run on the thread pool
+ */
+static void parseJob(void *data)
+{
+	parseJob_t *job = data;
+
+	job->tree = settingsTreeCreate();
+	job->success = parseFile(job->tree, settingsTreeGetRoot(job->tree),
+							 job->file, job->depth, job->pool);
+}
+
+/**
+ * Parse files concurrently to separate trees, then merge them in order.
+ * The result is the same as parsing them one after the other, as each
+ * file only adds or replaces what the files before it defined. This holds
+ * on failure too, the failed file is partially applied and later files not.
+ */
+static bool parseParallel(settingsTree_t *tree, section_t *section,
+						  char **files, size_t count, int depth,
+						  threadPool_t *pool)
+{
+	parseJob_t *jobs;
+	void **data;
+	bool success = TRUE;
+	size_t i;
+	int j;
+
+	jobs = calloc(count, sizeof(parseJob_t));
+	data = malloc(count * sizeof(void*));
+	for (i = 0; i < count; ++i) {
+		jobs[i] = (parseJob_t) {
+			.file = files[i],
+			.depth = depth,
+			.pool = pool,
+		};
+		data[i] = &jobs[i];
+	}
+	threadPoolRun(pool, parseJob, data, count);
+
+	for (i = 0; i < count; ++i) {
+		if (success) {
+			/* a failed file is merged up to the error, as it would have been
+			 * applied sequentially, but none of the files after it */
+			settingsTreeMerge(tree, section, settingsTreeGetRoot(jobs[i].tree),
+							  NULL);
+			for (j = 0; j < settingsTreeGetSourceCount(jobs[i].tree); ++j) {
+				settingsTreeAddSource(tree,
+								settingsTreeGetSource(jobs[i].tree, j));
+			}
+			success = jobs[i].success;
+		}
+		settingsTreeDestroy(jobs[i].tree);
+	}
+	free(data);
+	free(jobs);
+	return success;
+}
+
+/**
+ * Check if a part of a pattern contains glob wildcards
+ */
+static inline bool hasWildcard(const char *pattern, size_t len)
+{
+	return memchr(pattern, '*', len) || memchr(pattern, '?', len) ||
+		   memchr(pattern, '[', len);
+}
+
+/**
+ * Record the directories searched for a pattern as sources, files added to
+ * or removed from them change the result
+ *
+ * These are the directories followed by a wildcard component or by the file
+ * component. If such a directory contains wildcards itself, all existing
+ * directories it matches are recorded.
+ */
+static void addPatternDirs(settingsTree_t *tree, char *pattern)
+{
+	char dir[PATH_MAX], *pos, *next;
+	settingsSource_t source;
+	glob_t buf;
+	size_t len, i;
+
+	for (pos = strchr(pattern, '/'); pos; pos = next) {
+		next = strchr(pos + 1, '/');
+		len = (next ?: pos + 1 + strlen(pos + 1)) - (pos + 1);
+		if (next && !hasWildcard(pos + 1, len)) {
+			continue;
+		}
+		len = max(pos - pattern, 1);
+		if (len >= sizeof(dir)) {
+			continue;
+		}
+		memcpy(dir, pattern, len);
+		dir[len] = '\0';
+		if (!hasWildcard(pattern, len)) {
+			settingsSourceStat(&source, dir);
+			settingsTreeAddSource(tree, &source);
+			continue;
+		}
+		if (glob(dir, GLOB_ONLYDIR, NULL, &buf) == 0) {
+			for (i = 0; i < buf.gl_pathc; ++i) {
+				settingsSourceStat(&source, buf.gl_pathv[i]);
+				settingsTreeAddSource(tree, &source);
+			}
+		}
+		globfree(&buf);
+	}
+}
+
+/**
+ * Parse the files matching a pattern at the given include depth
+ */
+static bool parseFiles(settingsTree_t *tree, section_t *section,
+					   char *pattern, int depth, threadPool_t *pool)
+{
+	glob_t buf;
+	bool success = TRUE;
+	size_t i;
+
+	addPatternDirs(tree, pattern);
+
+	switch (glob(pattern, GLOB_ERR, NULL, &buf)) {
+		case 0:
+			break;
+		case GLOB_NOMATCH:
+			DBG2(DBG_CFG, "no files found matching '%s', ignored", pattern);
+			return TRUE;
+		default:
+			DBG1(DBG_CFG, "expanding file pattern '%s' failed", pattern);
+			globfree(&buf);
+			return FALSE;
+	}
+	if (pool && buf.gl_pathc > 1) {
+		success = parseParallel(tree, section, buf.gl_pathv, buf.gl_pathc,
+								depth, pool);
+	} else {
+		for (i = 0; i < buf.gl_pathc && success; ++i) {
+			success = parseFile(tree, section, buf.gl_pathv[i], depth, pool);
+		}
+	}
+	globfree(&buf);
+	return success;
+}
+
+/**
+ * Handle an include statement, relative patterns are based on the
+ * directory of the including file
+ */
+static bool parseInclude(parser_t *this, section_t *section, char *pattern)
+{
+	char path[PATH_MAX];
+	const char *dir;
+
+	if (!*pattern) {
+		PARSE_ERROR(this, "include statement without pattern");
+		return FALSE;
+	}
+	if (this->depth == SETTINGS_MAX_INCLUDE_DEPTH) {
+		PARSE_ERROR(this, "maximum include depth exceeded");
+		return FALSE;
+	}
+	if (*pattern != '/' && this->file && (dir = strrchr(this->file, '/'))) {
+		if (snprintf(path, sizeof(path), "%.*s/%s", (int)(dir - this->file),
+					 this->file, pattern) >= sizeof(path)) {
+			PARSE_ERROR(this, "include pattern too long");
+			return FALSE;
+		}
+		pattern = path;
+	}
+	return parseFiles(this->tree, section, pattern, this->depth + 1,
+					  this->pool);
+}
+
+bool settingsParseFiles(settingsTree_t *tree, section_t *section,
+						char *pattern)
+{
+	return parseFiles(tree, section, pattern, 0, NULL);
+}
+
+bool settingsParseFilesParallel(settingsTree_t *tree, section_t *section,
+								char *pattern, threadPool_t *pool)
+{
+	return parseFiles(tree, section, pattern, 0, pool);
+}
+
+bool settingsParseFile(settingsTree_t *tree, section_t *section, char *file)
+{
+	return parseFile(tree, section, file, 0, NULL);
+}
+
+bool settingsParseString(settingsTree_t *tree, section_t *section,
+						 char *settings)
+{
+	return parseData(tree, section, NULL, chunkFromStr(settings), 0, NULL);
+}
@@ -0,0 +1,87 @@
+#ifndef _CHELP_SETTINGSPARSER_H
+#define _CHELP_SETTINGSPARSER_H 1
+
+#include "settingsTree.h" /* settingsTree_t */
+#include "threadPool.h" /* threadPool_t */
+
+/**
+ * Parser for the settings syntax described in settings.h.
+ *
+ * Files are mmap()ed with chunkMap() and parsed in place, without reading
+ * them to a buffer. Section names and keys are interned in the string
+ * table of the settingsTree_t they are parsed to, values are copied to its
+ * arena, so parsing a file takes no allocations per key or value.
+ *
+ * In addition to the syntax in settings.h, values may be put in double
+ * quotes to include leading or trailing whitespace, # or line breaks, with
+ * \\n, \\t, \\" and \\\\ as escape sequences. Comments start with # and last
+ * until the end of the line.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Maximum depth of nested include statements
+ */
+#define SETTINGS_MAX_INCLUDE_DEPTH 10
+
+/**
+ * Parse the files matching a pattern to a section.
+ *
+ * Files are parsed in the order of the sorted glob matches. A pattern not
+ * matching any files is not an error.
+ *
+ * @param tree		tree to parse to
+ * @param section	section of tree to add settings to
+ * @param pattern	file pattern
+ * @return			TRUE if all files were parsed successfully
+ */
+bool settingsParseFiles(settingsTree_t *tree, section_t *section,
+						char *pattern);
+
+/**
+ * Parse the files matching a pattern to a section, concurrently.
+ *
+ * The matching files, and those matched by include statements, are parsed
+ * on the thread pool, each to a separate tree. The trees are then merged
+ * in glob order, so the result is the same as with settingsParseFiles().
+ *
+ * @param tree		tree to parse to
+ * @param section	section of tree to add settings to
+ * @param pattern	file pattern
+ * @param pool		thread pool to parse files on
+ * @return			TRUE if all files were parsed successfully
+ */
+bool settingsParseFilesParallel(settingsTree_t *tree, section_t *section,
+								char *pattern, threadPool_t *pool);
+
+/**
+ * Parse a single file to a section.
+ *
+ * @param tree		tree to parse to
+ * @param section	section of tree to add settings to
+ * @param file		path of the file
+ * @return			TRUE if the file was parsed successfully
+ */
+bool settingsParseFile(settingsTree_t *tree, section_t *section, char *file);
+
+/**
+ * Parse settings from a string.
+ *
+ * Patterns of include statements should be absolute paths.
+ *
+ * @param tree		tree to parse to
+ * @param section	section of tree to add settings to
+ * @param settings	settings to parse
+ * @return			TRUE if the string was parsed successfully
+ */
+bool settingsParseString(settingsTree_t *tree, section_t *section,
+						 char *settings);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CHELP_SETTINGSPARSER_H */
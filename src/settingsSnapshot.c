@@ -0,0 +1,330 @@
+#include "settingsSnapshot.h"
+#include "epoch.h"
+
+#include <pthread.h> /* pthread_mutex_t */
+/* malloc, calloc, realloc, free, strdup */
+/* strchr, strlen, strncmp */
+/* arrayCount, arrayGet */
+/* TRUE, FALSE */
+
+typedef struct fallback_t fallback_t;
+typedef struct hook_t hook_t;
+typedef struct retired_t retired_t;
+
+/**
+ * A fallback, applied to each snapshot
+ */
+struct fallback_t {
+	char *section;	/**!< dotted name of section */
+	char *fallback;	/**!< dotted name of fallback section */
+};
+
+/**
+ * A registered change hook
+ */
+struct hook_t {
+	settingsStoreHook_t hook;	/**!< function to call */
+	void *data;					/**!< argument to hook */
+};
+
+/**
+ * Memory to free after the next snapshot has been published
+ */
+struct retired_t {
+	retired_t *next;	/**!< next retired memory */
+	void *ptr;			/**!< memory to free */
+};
+
+struct settingsSnapshot_t {
+	settingsTree_t *tree;		/**!< settings tree, finalized */
+	settingsIndex_t *index;		/**!< index over tree */
+	uint64_t generation;		/**!< generation of this snapshot */
+};
+
+struct settingsStore_t {
+	epoch_t *epoch;					/**!< protects snapshots from reclamation */
+	pthread_mutex_t mutex;			/**!< serializes updates */
+	settingsSnapshot_t *current;	/**!< published snapshot */
+	fallback_t *fallbacks;			/**!< configured fallbacks */
+	int fallbackCount;				/**!< number of fallbacks */
+	hook_t *hooks;					/**!< registered change hooks */
+	int hookCount;					/**!< number of hooks */
+	uint64_t generation;			/**!< generation of current snapshot */
+	retired_t *retired;				/**!< memory to free, atomic */
+};
+
+/**
+ * Find a section of a finalized tree by dotted name
+ */
+static section_t *findSection(section_t *section, const char *path)
+{
+	section_t *sub = NULL;
+	const char *end;
+	int i;
+
+	while (section && path && *path) {
+		end = strchr(path, '.') ?: path + strlen(path);
+		for (i = 0; i < arrayCount(section->section); ++i) {
+			arrayGet(section->section, i, &sub);
+			if (strlen(sub->name) == end - path &&
+				!strncmp(sub->name, path, end - path)) {
+				break;
+			}
+			sub = NULL;
+		}
+		section = sub;
+		path = *end ? end + 1 : end;
+	}
+	return section;
+}
+
+/**
+ * Create a copy of the current tree to modify, without the contents of
+ * the skipped section
+ */
+static settingsTree_t *copyTree(settingsStore_t *this, section_t *skip)
+{
+	settingsTree_t *tree;
+
+	tree = settingsTreeCreate();
+	settingsTreeMerge(tree, settingsTreeGetRoot(tree),
+					  settingsTreeGetRoot(this->current->tree), skip);
+	return tree;
+}
+
+/**
+ * Apply the configured fallbacks to a new tree
+ */
+static void applyFallbacks(settingsStore_t *this, settingsTree_t *tree)
+{
+	section_t *section, *fallback;
+	int i;
+
+	for (i = 0; i < this->fallbackCount; ++i) {
+		section = settingsTreeFindSection(tree, this->fallbacks[i].section,
+										  TRUE);
+		fallback = settingsTreeFindSection(tree, this->fallbacks[i].fallback,
+										   TRUE);
+		if (section != fallback) {
+			settingsTreeAddFallback(tree, section, fallback);
+		}
+	}
+}
+
+/**
+ * Destroy a snapshot
+ */
+static void snapshotDestroy(settingsSnapshot_t *this)
+{
+	settingsIndexDestroy(this->index);
+	settingsTreeDestroy(this->tree);
+	free(this);
+}
+
+/**
+ * Free a list of retired memory
+ */
+static void freeRetired(retired_t *retired)
+{
+	retired_t *next;
+
+	for (; retired; retired = next) {
+		next = retired->next;
+		free(retired->ptr);
+		free(retired);
+	}
+}
+
+/**
+ * Publish a new tree as snapshot, destroy the old one and memory retired
+ * so far once no reader has it pinned anymore. Must be called with the
+ * mutex held.
+ */
+static void publish(settingsStore_t *this, settingsTree_t *tree)
+{
+	settingsSnapshot_t *new, *old;
+	retired_t *retired;
+	int i;
+
+	applyFallbacks(this, tree);
+	settingsTreeFinalize(tree);
+
+	new = malloc(sizeof(*new));
+	*new = (settingsSnapshot_t) {
+		.tree = tree,
+		.index = settingsIndexCreate(settingsTreeGetRoot(tree)),
+		.generation = this->current ? this->current->generation + 1 : 1,
+	};
+
+	retired = __atomic_exchange_n(&this->retired, NULL, __ATOMIC_ACQ_REL);
+	old = __atomic_exchange_n(&this->current, new, __ATOMIC_ACQ_REL);
+	__atomic_store_n(&this->generation, new->generation, __ATOMIC_RELEASE);
+	if (old || retired) {
+		epochSynchronize(this->epoch);
+	}
+	if (old) {
+		snapshotDestroy(old);
+	}
+	freeRetired(retired);
+	for (i = 0; i < this->hookCount; ++i) {
+		this->hooks[i].hook(this->hooks[i].data, new);
+	}
+}
+
+settingsStore_t *settingsStoreCreate()
+{
+	settingsStore_t *this = (settingsStore_t *)calloc(1, sizeof(*this));
+
+	this->epoch = epochCreate();
+	pthread_mutex_init(&this->mutex, NULL);
+	publish(this, settingsTreeCreate());
+
+	return this;
+}
+
+settingsSnapshot_t *settingsStorePin(settingsStore_t *this)
+{
+	epochEnter(this->epoch);
+	return __atomic_load_n(&this->current, __ATOMIC_ACQUIRE);
+}
+
+void settingsStoreUnpin(settingsStore_t *this)
+{
+	epochExit(this->epoch);
+}
+
+void settingsStoreLoad(settingsStore_t *this, const char *section,
+					   settingsTree_t *settings, bool merge)
+{
+	settingsTree_t *tree;
+	section_t *root, *skip = NULL;
+
+	pthread_mutex_lock(&this->mutex);
+	root = settingsTreeGetRoot(this->current->tree);
+	if (!merge) {
+		skip = findSection(root, section);
+	}
+	if ((!section || !*section) &&
+		(skip == root || (!arrayCount(root->kv) && !arrayCount(root->section)))) {
+		/* replacing everything, use the tree as is, e.g. loaded from cache */
+		tree = settings;
+	} else {
+		tree = copyTree(this, skip);
+		settingsTreeMerge(tree, settingsTreeFindSection(tree, section, TRUE),
+						  settingsTreeGetRoot(settings), NULL);
+		settingsTreeDestroy(settings);
+	}
+	publish(this, tree);
+	pthread_mutex_unlock(&this->mutex);
+}
+
+void settingsStoreSet(settingsStore_t *this, const char *key, const char *value)
+{
+	settingsTree_t *tree;
+	section_t *section;
+	const char *end;
+
+	pthread_mutex_lock(&this->mutex);
+	tree = copyTree(this, NULL);
+	section = settingsTreeGetRoot(tree);
+	while ((end = strchr(key, '.'))) {
+		section = settingsTreeGetSection(tree, section,
+							chunkCreate((uint8_t*)key, end - key), TRUE);
+		key = end + 1;
+	}
+	settingsTreeSet(tree, section, chunkFromStr((char*)key), value ?
+					settingsTreeString(tree, chunkFromStr((char*)value)) : NULL);
+	publish(this, tree);
+	pthread_mutex_unlock(&this->mutex);
+}
+
+void settingsStoreAddFallback(settingsStore_t *this, const char *section,
+							  const char *fallback)
+{
+	pthread_mutex_lock(&this->mutex);
+	this->fallbacks = realloc(this->fallbacks,
+						(this->fallbackCount + 1) * sizeof(fallback_t));
+	this->fallbacks[this->fallbackCount++] = (fallback_t) {
+		.section = strdup(section),
+		.fallback = strdup(fallback),
+	};
+	publish(this, copyTree(this, NULL));
+	pthread_mutex_unlock(&this->mutex);
+}
+
+void settingsStoreAddHook(settingsStore_t *this, settingsStoreHook_t hook,
+						  void *data)
+{
+	pthread_mutex_lock(&this->mutex);
+	this->hooks = realloc(this->hooks, (this->hookCount + 1) * sizeof(hook_t));
+	this->hooks[this->hookCount++] = (hook_t) {
+		.hook = hook,
+		.data = data,
+	};
+	pthread_mutex_unlock(&this->mutex);
+}
+
+void settingsStoreRemoveHook(settingsStore_t *this, settingsStoreHook_t hook,
+							 void *data)
+{
+	int i;
+
+	pthread_mutex_lock(&this->mutex);
+	for (i = 0; i < this->hookCount; ++i) {
+		if (this->hooks[i].hook == hook && this->hooks[i].data == data) {
+			this->hooks[i] = this->hooks[--this->hookCount];
+			break;
+		}
+	}
+	pthread_mutex_unlock(&this->mutex);
+}
+
+uint64_t settingsStoreGetGeneration(settingsStore_t *this)
+{
+	return __atomic_load_n(&this->generation, __ATOMIC_ACQUIRE);
+}
+
+void settingsStoreRetire(settingsStore_t *this, void *ptr)
+{
+	retired_t *retired;
+
+	retired = malloc(sizeof(*retired));
+	retired->ptr = ptr;
+	retired->next = __atomic_load_n(&this->retired, __ATOMIC_RELAXED);
+	while (!__atomic_compare_exchange_n(&this->retired, &retired->next,
+										retired, TRUE, __ATOMIC_RELEASE,
+										__ATOMIC_RELAXED)) {
+	}
+}
+
+void settingsStoreDestroy(settingsStore_t *this)
+{
+	int i;
+
+	snapshotDestroy(this->current);
+	freeRetired(this->retired);
+	for (i = 0; i < this->fallbackCount; ++i) {
+		free(this->fallbacks[i].section);
+		free(this->fallbacks[i].fallback);
+	}
+	free(this->fallbacks);
+	free(this->hooks);
+	epochDestroy(this->epoch);
+	pthread_mutex_destroy(&this->mutex);
+	free(this);
+}
+
+section_t *settingsSnapshotGetRoot(settingsSnapshot_t *this)
+{
+	return settingsTreeGetRoot(this->tree);
+}
+
+settingsIndex_t *settingsSnapshotGetIndex(settingsSnapshot_t *this)
+{
+	return this->index;
+}
+
+uint64_t settingsSnapshotGetGeneration(settingsSnapshot_t *this)
+{
+	return this->generation;
+}
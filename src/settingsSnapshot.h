@@ -0,0 +1,175 @@
+#ifndef _CHELP_SETTINGSSNAPSHOT_H
+#define _CHELP_SETTINGSSNAPSHOT_H 1
+
+#include "settingsTree.h" /* settingsTree_t, section_t */
+#include "settingsIndex.h" /* settingsIndex_t */
+
+/**
+ * Immutable settings snapshots with lock-free readers.
+ *
+ * A settingsStore_t holds the current settings as an immutable snapshot of
+ * the section_t tree and its settingsIndex_t. Readers pin the snapshot,
+ * which never blocks nor writes to shared memory, and may use it until
+ * they unpin it.
+ *
+ * Updates (loading files, setting values, adding fallbacks) never modify a
+ * published tree. They copy it, apply the change to the copy, and swap the
+ * new snapshot in atomically. The old snapshot is destroyed once all
+ * readers that might have pinned it are gone, so a reload never stalls
+ * threads reading settings.
+ *
+ * @code
+ * snapshot = settingsStorePin(store);
+ * index = settingsSnapshotGetIndex(snapshot);
+ * timeout = settingsIndexGetTime(index, "%s.timeout", 30, name);
+ * settingsStoreUnpin(store);
+ * @endcode
+ *
+ * Values obtained from a snapshot must not be used after unpinning it.
+ * Pins may be nested, but updates must not be done while holding a pin,
+ * as the update would wait for the pinning thread itself.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct settingsStore_t settingsStore_t;
+typedef struct settingsSnapshot_t settingsSnapshot_t;
+
+/**
+ * Hook called after a new snapshot has been published.
+ *
+ * Hooks are called with updates serialized, so they must not update the
+ * store themselves. They may pin the store, though.
+ *
+ * @param data		data passed when registering the hook
+ * @param snapshot	the new snapshot
+ */
+typedef void (*settingsStoreHook_t)(void *data, settingsSnapshot_t *snapshot);
+
+/**
+ * Create a settings store with empty settings.
+ *
+ * @return			settings store
+ */
+settingsStore_t *settingsStoreCreate();
+
+/**
+ * Pin the current snapshot for reading.
+ *
+ * @return			current snapshot, valid until settingsStoreUnpin()
+ */
+settingsSnapshot_t *settingsStorePin(settingsStore_t *this);
+
+/**
+ * Release the snapshot pinned by the calling thread.
+ */
+void settingsStoreUnpin(settingsStore_t *this);
+
+/**
+ * Merge parsed settings into the settings.
+ *
+ * Builds and publishes a new snapshot. If merge is FALSE, the existing
+ * contents of the target section are replaced by the new settings.
+ *
+ * If the loaded settings replace all existing settings, the tree is
+ * published as is, without copying it. Values of a tree loaded from a cache
+ * thus keep pointing to the mapped cache file.
+ *
+ * @param section	dotted name of section to load to, NULL for the root
+ * @param settings	parsed settings, e.g. by settingsParseFiles() (adopted)
+ * @param merge		TRUE to merge config with existing values
+ */
+void settingsStoreLoad(settingsStore_t *this, const char *section,
+					   settingsTree_t *settings, bool merge);
+
+/**
+ * Set a value, publishing a new snapshot.
+ *
+ * @param key		dotted key including sections
+ * @param value		value to set (gets cloned), NULL to unset
+ */
+void settingsStoreSet(settingsStore_t *this, const char *key, const char *value);
+
+/**
+ * Add a fallback section, publishing a new snapshot.
+ *
+ * Fallbacks are kept by name and applied to every new snapshot, so they
+ * remain in effect after loading new settings.
+ *
+ * @param section	dotted name of section a fallback is configured for
+ * @param fallback	dotted name of fallback section
+ */
+void settingsStoreAddFallback(settingsStore_t *this, const char *section,
+							  const char *fallback);
+
+/**
+ * Register a hook called for each new snapshot.
+ *
+ * @param hook		function to call
+ * @param data		argument passed to hook
+ */
+void settingsStoreAddHook(settingsStore_t *this, settingsStoreHook_t hook,
+						  void *data);
+
+/**
+ * Unregister a hook registered with settingsStoreAddHook().
+ *
+ * @param hook		function registered
+ * @param data		argument registered
+ */
+void settingsStoreRemoveHook(settingsStore_t *this, settingsStoreHook_t hook,
+							 void *data);
+
+/**
+ * Free memory once no reader that has the store pinned can access it.
+ *
+ * The memory is freed after the next snapshot has been published, or when
+ * the store is destroyed.
+ *
+ * @param ptr		memory to free
+ */
+void settingsStoreRetire(settingsStore_t *this, void *ptr);
+
+/**
+ * Get the generation of the current snapshot, without pinning it.
+ *
+ * @return			generation of the most recently published snapshot
+ */
+uint64_t settingsStoreGetGeneration(settingsStore_t *this);
+
+/**
+ * Destroy a settingsStore_t, no snapshot may be pinned.
+ */
+void settingsStoreDestroy(settingsStore_t *this);
+
+/**
+ * Get the settings tree of a snapshot.
+ *
+ * @return			top level section, must not be modified
+ */
+section_t *settingsSnapshotGetRoot(settingsSnapshot_t *this);
+
+/**
+ * Get the key index of a snapshot.
+ *
+ * @return			index over the settings tree
+ */
+settingsIndex_t *settingsSnapshotGetIndex(settingsSnapshot_t *this);
+
+/**
+ * Get the generation of a snapshot.
+ *
+ * The generation is incremented for every snapshot published by a store,
+ * e.g. to detect if cached values are outdated.
+ *
+ * @return			generation, starting at 1
+ */
+uint64_t settingsSnapshotGetGeneration(settingsSnapshot_t *this);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CHELP_SETTINGSSNAPSHOT_H */
@@ -0,0 +1,388 @@
+#include "settingsTree.h"
+#include "chunkArena.h"
+
+#include <sys/stat.h> /* stat, S_ISDIR */
+
+/* calloc, free */
+/* memcpy, memcmp, strchr, strlen */
+/* arrayCount, arrayGet, arrayInsertCreate, arraySort, arrayDestroy, ARRAY_TAIL */
+/* TRUE, FALSE */
+
+typedef struct internEntry_t internEntry_t;
+typedef struct nodeEntry_t nodeEntry_t;
+typedef struct nodeTable_t nodeTable_t;
+
+/**
+ * An interned string
+ */
+struct internEntry_t {
+	char *str;			/**!< 0-terminated string, NULL if empty */
+	uint32_t len;		/**!< length of str */
+	uint32_t hash;		/**!< chunkHash() of str */
+};
+
+/**
+ * A subsection or key/value of a section, by interned name
+ */
+struct nodeEntry_t {
+	section_t *parent;	/**!< parent section, NULL if empty */
+	char *name;			/**!< interned name */
+	void *node;			/**!< section_t or kv_t */
+};
+
+/**
+ * Hash table of nodeEntry_t
+ */
+struct nodeTable_t {
+	nodeEntry_t *entries;	/**!< entries */
+	uint32_t mask;			/**!< size of entries - 1 */
+	uint32_t count;			/**!< number of used entries */
+};
+
+struct settingsTree_t {
+	chunkArena_t *arena;		/**!< storage of nodes and strings */
+	section_t *root;			/**!< top level section */
+	internEntry_t *strings;		/**!< string table, NULL once finalized */
+	uint32_t stringMask;		/**!< size of strings - 1 */
+	uint32_t stringCount;		/**!< number of interned strings */
+	nodeTable_t sections;		/**!< subsections by parent and name */
+	nodeTable_t kvs;			/**!< key/values by section and key */
+	array_t *sources;			/**!< recorded sources, as settingsSource_t* */
+	array_t *maps;				/**!< attached mappings, as chunk_t* */
+};
+
+/**
+ * Hash a parent and an interned name
+ */
+static inline uint32_t hashNode(section_t *parent, char *name)
+{
+	uintptr_t hash = (uintptr_t)parent ^ ((uintptr_t)name * 0x9e3779b1);
+
+	return hash ^ (hash >> 16);
+}
+
+/**
+ * Find the slot of a node in a table, the slot is empty if not found
+ */
+static nodeEntry_t *findNode(nodeTable_t *table, section_t *parent, char *name)
+{
+	uint32_t i;
+
+	for (i = hashNode(parent, name) & table->mask; table->entries[i].parent;
+		 i = (i + 1) & table->mask) {
+		if (table->entries[i].parent == parent &&
+			table->entries[i].name == name) {
+			break;
+		}
+	}
+	return &table->entries[i];
+}
+
+/**
+ * Add a node to the empty slot returned by findNode()
+ */
+static void addNode(nodeTable_t *table, nodeEntry_t *slot, section_t *parent,
+					char *name, void *node)
+{
+	nodeEntry_t *old;
+	uint32_t i, size;
+
+	*slot = (nodeEntry_t) {
+		.parent = parent,
+		.name = name,
+		.node = node,
+	};
+	if (++table->count * 2 <= table->mask + 1) {
+		return;
+	}
+	old = table->entries;
+	size = (table->mask + 1) * 2;
+	table->entries = calloc(size, sizeof(nodeEntry_t));
+	table->mask = size - 1;
+	for (i = 0; i < size / 2; ++i) {
+		if (old[i].parent) {
+			*findNode(table, old[i].parent, old[i].name) = old[i];
+		}
+	}
+	free(old);
+}
+
+settingsTree_t *settingsTreeCreate()
+{
+	settingsTree_t *this = (settingsTree_t *)calloc(1, sizeof(*this));
+
+	this->arena = chunkArenaCreate(0, FALSE);
+	this->root = chunkArenaAlloc(this->arena, sizeof(section_t));
+	*this->root = (section_t) { .name = NULL };
+	this->stringMask = 255;
+	this->strings = calloc(this->stringMask + 1, sizeof(internEntry_t));
+	this->sections.mask = 63;
+	this->sections.entries = calloc(this->sections.mask + 1, sizeof(nodeEntry_t));
+	this->kvs.mask = 255;
+	this->kvs.entries = calloc(this->kvs.mask + 1, sizeof(nodeEntry_t));
+
+	return this;
+}
+
+section_t *settingsTreeGetRoot(settingsTree_t *this)
+{
+	return this->root;
+}
+
+char *settingsTreeString(settingsTree_t *this, chunk_t str)
+{
+	char *copy;
+
+	copy = chunkArenaAlloc(this->arena, str.len + 1);
+	memcpy(copy, str.ptr, str.len);
+	copy[str.len] = '\0';
+	return copy;
+}
+
+char *settingsTreeIntern(settingsTree_t *this, chunk_t str)
+{
+	internEntry_t *old;
+	uint32_t i, j, hash, size;
+
+	hash = chunkHash(str);
+	for (i = hash & this->stringMask; this->strings[i].str;
+		 i = (i + 1) & this->stringMask) {
+		if (this->strings[i].hash == hash && this->strings[i].len == str.len &&
+			memcmp(this->strings[i].str, str.ptr, str.len) == 0) {
+			return this->strings[i].str;
+		}
+	}
+	this->strings[i] = (internEntry_t) {
+		.str = settingsTreeString(this, str),
+		.len = str.len,
+		.hash = hash,
+	};
+	if (++this->stringCount * 2 > this->stringMask + 1) {
+		old = this->strings;
+		size = (this->stringMask + 1) * 2;
+		this->strings = calloc(size, sizeof(internEntry_t));
+		this->stringMask = size - 1;
+		for (j = 0; j < size / 2; ++j) {
+			if (!old[j].str) {
+				continue;
+			}
+			for (i = old[j].hash & this->stringMask; this->strings[i].str;
+				 i = (i + 1) & this->stringMask) {
+				/* probe */
+			}
+			this->strings[i] = old[j];
+		}
+		free(old);
+		return settingsTreeIntern(this, str);
+	}
+	return this->strings[i].str;
+}
+
+section_t *settingsTreeGetSection(settingsTree_t *this, section_t *parent,
+								  chunk_t name, bool create)
+{
+	section_t *section;
+	nodeEntry_t *slot;
+	char *interned;
+
+	interned = settingsTreeIntern(this, name);
+	slot = findNode(&this->sections, parent, interned);
+	if (slot->parent) {
+		return slot->node;
+	}
+	if (!create) {
+		return NULL;
+	}
+	section = chunkArenaAlloc(this->arena, sizeof(section_t));
+	*section = (section_t) { .name = interned };
+	arrayInsertCreate(&parent->section, ARRAY_TAIL, section);
+	arrayInsertCreate(&parent->sections_order, ARRAY_TAIL, section);
+	addNode(&this->sections, slot, parent, interned, section);
+	return section;
+}
+
+section_t *settingsTreeFindSection(settingsTree_t *this, const char *path,
+								   bool create)
+{
+	section_t *section = this->root;
+	const char *end;
+
+	while (section && path && *path) {
+		end = strchr(path, '.') ?: path + strlen(path);
+		section = settingsTreeGetSection(this, section,
+							chunkCreate((uint8_t*)path, end - path), create);
+		path = *end ? end + 1 : end;
+	}
+	return section;
+}
+
+void settingsTreeSet(settingsTree_t *this, section_t *section, chunk_t key,
+					 char *value)
+{
+	nodeEntry_t *slot;
+	char *interned;
+	kv_t *kv;
+
+	interned = settingsTreeIntern(this, key);
+	slot = findNode(&this->kvs, section, interned);
+	if (slot->parent) {
+		kv = slot->node;
+		kv->value = value;
+		return;
+	}
+	kv = chunkArenaAlloc(this->arena, sizeof(kv_t));
+	*kv = (kv_t) {
+		.key = interned,
+		.value = value,
+	};
+	arrayInsertCreate(&section->kv, ARRAY_TAIL, kv);
+	arrayInsertCreate(&section->kv_order, ARRAY_TAIL, kv);
+	addNode(&this->kvs, slot, section, interned, kv);
+}
+
+void settingsTreeAddFallback(settingsTree_t *this, section_t *section,
+							 section_t *fallback)
+{
+	arrayInsertCreate(&section->fallbacks, ARRAY_TAIL, fallback);
+}
+
+void settingsTreeMerge(settingsTree_t *this, section_t *dst, section_t *src,
+					   section_t *skip)
+{
+	section_t *sub;
+	kv_t *kv;
+	int i;
+
+	if (src == skip) {
+		return;
+	}
+	for (i = 0; i < arrayCount(src->kv_order); ++i) {
+		arrayGet(src->kv_order, i, &kv);
+		settingsTreeSet(this, dst, chunkFromStr(kv->key), kv->value ?
+						settingsTreeString(this, chunkFromStr(kv->value)) : NULL);
+	}
+	for (i = 0; i < arrayCount(src->sections_order); ++i) {
+		arrayGet(src->sections_order, i, &sub);
+		settingsTreeMerge(this, settingsTreeGetSection(this, dst,
+							chunkFromStr(sub->name), TRUE), sub, skip);
+	}
+}
+
+void settingsSourceStat(settingsSource_t *source, char *path)
+{
+	struct stat sb;
+
+	*source = (settingsSource_t) {
+		.path = path,
+	};
+	if (stat(path, &sb) == -1) {
+		source->type = SETTINGS_SOURCE_MISSING;
+		return;
+	}
+	source->mtime = sb.st_mtim.tv_sec * 1000000000ULL + sb.st_mtim.tv_nsec;
+	source->size = sb.st_size;
+	source->type = S_ISDIR(sb.st_mode) ? SETTINGS_SOURCE_DIR
+									   : SETTINGS_SOURCE_FILE;
+}
+
+void settingsTreeAddSource(settingsTree_t *this, settingsSource_t *source)
+{
+	settingsSource_t *copy;
+	char *interned;
+	int i;
+
+	interned = settingsTreeIntern(this, chunkFromStr(source->path));
+	for (i = 0; i < arrayCount(this->sources); ++i) {
+		arrayGet(this->sources, i, &copy);
+		if (copy->path == interned) {
+			return;
+		}
+	}
+	copy = chunkArenaAlloc(this->arena, sizeof(*copy));
+	*copy = *source;
+	copy->path = interned;
+	arrayInsertCreate(&this->sources, ARRAY_TAIL, copy);
+}
+
+int settingsTreeGetSourceCount(settingsTree_t *this)
+{
+	return arrayCount(this->sources);
+}
+
+settingsSource_t *settingsTreeGetSource(settingsTree_t *this, int idx)
+{
+	settingsSource_t *source = NULL;
+
+	arrayGet(this->sources, idx, &source);
+	return source;
+}
+
+void settingsTreeAttach(settingsTree_t *this, chunk_t *map)
+{
+	arrayInsertCreate(&this->maps, ARRAY_TAIL, map);
+}
+
+/**
+ * Sort the arrays of a section and its subsections
+ */
+static void sortSection(section_t *section)
+{
+	section_t *sub;
+	int i;
+
+	arraySort(section->kv, settingsKvSort, NULL);
+	arraySort(section->section, settingsSectionSort, NULL);
+	for (i = 0; i < arrayCount(section->section); ++i) {
+		arrayGet(section->section, i, &sub);
+		sortSection(sub);
+	}
+}
+
+void settingsTreeFinalize(settingsTree_t *this)
+{
+	sortSection(this->root);
+	free(this->strings);
+	free(this->sections.entries);
+	free(this->kvs.entries);
+	this->strings = NULL;
+	this->sections.entries = NULL;
+	this->kvs.entries = NULL;
+}
+
+/**
+ * Destroy the arrays of a section and its subsections
+ */
+static void destroySection(section_t *section)
+{
+	section_t *sub;
+	int i;
+
+	for (i = 0; i < arrayCount(section->section); ++i) {
+		arrayGet(section->section, i, &sub);
+		destroySection(sub);
+	}
+	arrayDestroy(section->fallbacks);
+	arrayDestroy(section->section);
+	arrayDestroy(section->sections_order);
+	arrayDestroy(section->kv);
+	arrayDestroy(section->kv_order);
+}
+
+void settingsTreeDestroy(settingsTree_t *this)
+{
+	chunk_t *map;
+	int i;
+
+	for (i = 0; i < arrayCount(this->maps); ++i) {
+		arrayGet(this->maps, i, &map);
+		chunkUnmap(map);
+	}
+	arrayDestroy(this->maps);
+	arrayDestroy(this->sources);
+	destroySection(this->root);
+	chunkArenaDestroy(this->arena);
+	free(this->strings);
+	free(this->sections.entries);
+	free(this->kvs.entries);
+	free(this);
+}
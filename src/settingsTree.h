@@ -0,0 +1,200 @@
+#ifndef _CHELP_SETTINGSTREE_H
+#define _CHELP_SETTINGSTREE_H 1
+
+#include "chunk.h" /* chunk_t */
+#include "settings_type.h" /* section_t, kv_t */
+
+/**
+ * Settings tree with interned names, allocated from a single arena.
+ *
+ * Sections, key/value pairs and strings of a settingsTree_t are allocated
+ * from a chunkArena_t and freed all at once with the tree. Section names
+ * and keys are interned in a string table, so each distinct name is stored
+ * once, no matter how many sections use it. Subsections and keys are found
+ * through a hash table while the tree is built, instead of searching the
+ * section arrays.
+ *
+ * While building, the section and kv arrays are kept in insertion order
+ * only. settingsTreeFinalize() sorts them once for settingsSectionFind() and
+ * settingsKvFind(), after which the tree must not be modified anymore.
+ *
+ * @note Nodes of a settingsTree_t must not be passed to functions that free
+ * them, e.g. settingsSectionDestroy() or settingsSectionExtend().
+ *
+ * @note The hash tables use chunkHash(), chunkHashSeed() must be called
+ * before creating a tree.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct settingsTree_t settingsTree_t;
+typedef struct settingsSource_t settingsSource_t;
+typedef enum settingsSourceType_t settingsSourceType_t;
+
+/**
+ * Type of a source
+ */
+enum settingsSourceType_t {
+	SETTINGS_SOURCE_MISSING = 0,	/**!< path did not exist */
+	SETTINGS_SOURCE_FILE = 1,		/**!< regular file */
+	SETTINGS_SOURCE_DIR = 2,		/**!< directory */
+};
+
+/**
+ * State of a file or directory the settings were loaded from, as read
+ */
+struct settingsSource_t {
+	char *path;					/**!< path of file or directory */
+	settingsSourceType_t type;	/**!< type of source */
+	uint64_t mtime;				/**!< modification time in ns */
+	uint64_t size;				/**!< file size */
+	uint32_t hash;				/**!< chunkHashStatic() of file contents */
+};
+
+/**
+ * Create an empty settings tree.
+ *
+ * @return			tree with an empty root section
+ */
+settingsTree_t *settingsTreeCreate();
+
+/**
+ * Get the root section of a tree.
+ *
+ * @return			top level section
+ */
+section_t *settingsTreeGetRoot(settingsTree_t *this);
+
+/**
+ * Intern a string, i.e. section names and keys.
+ *
+ * @param str		string to intern, not 0-terminated
+ * @return			0-terminated string owned by the tree, the same pointer
+ *					for equal strings
+ */
+char *settingsTreeIntern(settingsTree_t *this, chunk_t str);
+
+/**
+ * Copy a string to the tree, i.e. values.
+ *
+ * @param str		string to copy, not 0-terminated
+ * @return			0-terminated string owned by the tree
+ */
+char *settingsTreeString(settingsTree_t *this, chunk_t str);
+
+/**
+ * Get a subsection of a section.
+ *
+ * @param parent	section to look in
+ * @param name		name of the subsection
+ * @param create	TRUE to create the subsection if it does not exist
+ * @return			subsection, NULL if not found and not created
+ */
+section_t *settingsTreeGetSection(settingsTree_t *this, section_t *parent,
+								  chunk_t name, bool create);
+
+/**
+ * Get a section by its dotted name.
+ *
+ * @param path		dotted name of the section, relative to the root
+ * @param create	TRUE to create missing sections
+ * @return			section, NULL if not found and not created
+ */
+section_t *settingsTreeFindSection(settingsTree_t *this, const char *path,
+								   bool create);
+
+/**
+ * Set a value in a section, replacing an existing value of the key.
+ *
+ * @param section	section of this tree to set value in
+ * @param key		key to set
+ * @param value		value as returned by settingsTreeString(), NULL to unset
+ */
+void settingsTreeSet(settingsTree_t *this, section_t *section, chunk_t key,
+					 char *value);
+
+/**
+ * Add a fallback to a section.
+ *
+ * @param section	section of this tree to add fallback to
+ * @param fallback	fallback section of this tree
+ */
+void settingsTreeAddFallback(settingsTree_t *this, section_t *section,
+							 section_t *fallback);
+
+/**
+ * Merge the contents of a section into a section of this tree.
+ *
+ * Subsections are merged recursively and existing values replaced. All
+ * strings are copied, so the source may be part of any tree. Fallbacks are
+ * not copied.
+ *
+ * @param dst		section of this tree to merge to
+ * @param src		section to merge from
+ * @param skip		section in src below which nothing is copied, or NULL
+ */
+void settingsTreeMerge(settingsTree_t *this, section_t *dst, section_t *src,
+					   section_t *skip);
+
+/**
+ * Get the type, modification time and size of a source.
+ *
+ * This has to be done before reading the source, so a change while reading
+ * it is detected later. The hash of a file is not set, it must be calculated
+ * from the contents actually read.
+ *
+ * @param source	source to initialize
+ * @param path		path of the source, referenced by source
+ */
+void settingsSourceStat(settingsSource_t *source, char *path);
+
+/**
+ * Record a file or directory the settings were loaded from.
+ *
+ * Sources are used to detect if a cached tree is outdated, see
+ * settingsCache.h. Duplicates are ignored.
+ *
+ * @param source	source to record, the path is copied
+ */
+void settingsTreeAddSource(settingsTree_t *this, settingsSource_t *source);
+
+/**
+ * Get the number of recorded sources.
+ *
+ * @return			number of sources
+ */
+int settingsTreeGetSourceCount(settingsTree_t *this);
+
+/**
+ * Get a recorded source.
+ *
+ * @param idx		index of the source, in the order recorded
+ * @return			source, owned by the tree
+ */
+settingsSource_t *settingsTreeGetSource(settingsTree_t *this, int idx);
+
+/**
+ * Attach a mapped file that values of the tree point to.
+ *
+ * @param map		chunk returned by chunkMap(), unmapped with the tree
+ */
+void settingsTreeAttach(settingsTree_t *this, chunk_t *map);
+
+/**
+ * Sort the section arrays and release the lookup tables. The tree may not
+ * be modified anymore afterwards.
+ */
+void settingsTreeFinalize(settingsTree_t *this);
+
+/**
+ * Destroy a settingsTree_t and all its sections and strings.
+ */
+void settingsTreeDestroy(settingsTree_t *this);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CHELP_SETTINGSTREE_H */
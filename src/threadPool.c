@@ -0,0 +1,202 @@
+#include "threadPool.h"
+
+#include <pthread.h> /* pthread_t, pthread_mutex_t, pthread_cond_t */
+#include <unistd.h> /* sysconf */
+/* malloc, calloc, free */
+/* TRUE, FALSE */
+
+typedef struct poolJob_t poolJob_t;
+typedef struct poolBatch_t poolBatch_t;
+
+/**
+ * Jobs of a threadPoolRun() call
+ */
+struct poolBatch_t {
+	int pending;			/**!< number of jobs not done yet */
+};
+
+/**
+ * A queued job
+ */
+struct poolJob_t {
+	threadPoolJob_t job;	/**!< function to run */
+	void *data;				/**!< argument to job */
+	poolBatch_t *batch;		/**!< batch of the job, NULL if none */
+	poolJob_t *next;		/**!< next job in queue */
+};
+
+struct threadPool_t {
+	pthread_mutex_t mutex;		/**!< protects the queue */
+	pthread_cond_t queued;		/**!< signaled when a job is queued */
+	pthread_cond_t done;		/**!< signaled when a batch is done */
+	poolJob_t *head;			/**!< first queued job */
+	poolJob_t *tail;			/**!< last queued job */
+	bool terminate;				/**!< TRUE if workers should exit */
+	int count;					/**!< number of worker threads */
+	pthread_t threads[];		/**!< worker threads */
+};
+
+/**
+ * Add a job to the queue, mutex must be held
+ */
+static void enqueue(threadPool_t *this, poolJob_t *job)
+{
+	job->next = NULL;
+	if (this->tail) {
+		this->tail->next = job;
+	} else {
+		this->head = job;
+	}
+	this->tail = job;
+	pthread_cond_signal(&this->queued);
+}
+
+/**
+ * Remove the first job from the queue, mutex must be held
+ */
+static poolJob_t *dequeue(threadPool_t *this)
+{
+	poolJob_t *job = this->head;
+
+	if (job) {
+		this->head = job->next;
+		if (!this->head) {
+			this->tail = NULL;
+		}
+	}
+	return job;
+}
+
+/**
+ * Run a dequeued job, mutex must be held and is held again on return
+ */
+static void runJob(threadPool_t *this, poolJob_t *job)
+{
+	pthread_mutex_unlock(&this->mutex);
+	job->job(job->data);
+	pthread_mutex_lock(&this->mutex);
+
+	if (job->batch) {
+		if (--job->batch->pending == 0) {
+			pthread_cond_broadcast(&this->done);
+		}
+	}
+	free(job);
+}
+
+/**
+ * Main loop of worker threads
+ */
+static void *worker(void *data)
+{
+	threadPool_t *this = data;
+	poolJob_t *job;
+
+	pthread_mutex_lock(&this->mutex);
+	while (TRUE) {
+		job = dequeue(this);
+		if (job) {
+			runJob(this, job);
+			continue;
+		}
+		if (this->terminate) {
+			break;
+		}
+		pthread_cond_wait(&this->queued, &this->mutex);
+	}
+	pthread_mutex_unlock(&this->mutex);
+	return NULL;
+}
+
+threadPool_t *threadPoolCreate(int threads)
+{
+	threadPool_t *this;
+	int i;
+
+	if (threads <= 0) {
+		threads = sysconf(_SC_NPROCESSORS_ONLN);
+		threads = threads > 0 ? threads : 1;
+	}
+	this = (threadPool_t *)calloc(1, sizeof(*this) + threads * sizeof(pthread_t));
+	pthread_mutex_init(&this->mutex, NULL);
+	pthread_cond_init(&this->queued, NULL);
+	pthread_cond_init(&this->done, NULL);
+	for (i = 0; i < threads; ++i) {
+		if (pthread_create(&this->threads[this->count], NULL, worker, this) == 0) {
+			this->count++;
+		}
+	}
+	return this;
+}
+
+int threadPoolGetThreads(threadPool_t *this)
+{
+	return this->count;
+}
+
+void threadPoolQueue(threadPool_t *this, threadPoolJob_t job, void *data)
+{
+	poolJob_t *entry;
+
+	entry = malloc(sizeof(*entry));
+	*entry = (poolJob_t) {
+		.job = job,
+		.data = data,
+	};
+	pthread_mutex_lock(&this->mutex);
+	enqueue(this, entry);
+	pthread_mutex_unlock(&this->mutex);
+}
+
+void threadPoolRun(threadPool_t *this, threadPoolJob_t job, void **data,
+				   int count)
+{
+	poolBatch_t batch = { .pending = count };
+	poolJob_t *entry;
+	int i;
+
+	pthread_mutex_lock(&this->mutex);
+	for (i = 0; i < count; ++i) {
+		entry = malloc(sizeof(*entry));
+		*entry = (poolJob_t) {
+			.job = job,
+			.data = data[i],
+			.batch = &batch,
+		};
+		enqueue(this, entry);
+	}
+	while (batch.pending) {
+		/* help out instead of blocking, the jobs might run batches too */
+		entry = dequeue(this);
+		if (entry) {
+			runJob(this, entry);
+			continue;
+		}
+		pthread_cond_wait(&this->done, &this->mutex);
+	}
+	pthread_mutex_unlock(&this->mutex);
+}
+
+void threadPoolDestroy(threadPool_t *this)
+{
+	poolJob_t *job;
+	int i;
+
+	pthread_mutex_lock(&this->mutex);
+	this->terminate = TRUE;
+	pthread_cond_broadcast(&this->queued);
+	pthread_mutex_unlock(&this->mutex);
+	for (i = 0; i < this->count; ++i) {
+		pthread_join(this->threads[i], NULL);
+	}
+	/* without workers, e.g. if none could be created, jobs are still queued */
+	pthread_mutex_lock(&this->mutex);
+	while ((job = dequeue(this))) {
+		runJob(this, job);
+	}
+	pthread_mutex_unlock(&this->mutex);
+	pthread_mutex_destroy(&this->mutex);
+	pthread_cond_destroy(&this->queued);
+	pthread_cond_destroy(&this->done);
+	free(this);
+}
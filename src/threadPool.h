@@ -0,0 +1,68 @@
+#ifndef _CHELP_THREADPOOL_H
+#define _CHELP_THREADPOOL_H 1
+
+/**
+ * Fixed size pool of worker threads.
+ *
+ * Jobs are queued with threadPoolQueue(), or run as a batch with
+ * threadPoolRun(), which returns once all jobs of the batch are done. A
+ * thread waiting for a batch runs queued jobs itself in the meantime, so
+ * jobs may run nested batches without exhausting the workers.
+ */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct threadPool_t threadPool_t;
+
+/**
+ * Job executed by the pool.
+ *
+ * @param data		data passed when queueing the job
+ */
+typedef void (*threadPoolJob_t)(void *data);
+
+/**
+ * Create a thread pool.
+ *
+ * @param threads	number of worker threads, 0 for the number of CPUs
+ * @return			thread pool
+ */
+threadPool_t *threadPoolCreate(int threads);
+
+/**
+ * Get the number of worker threads.
+ *
+ * @return			number of worker threads
+ */
+int threadPoolGetThreads(threadPool_t *this);
+
+/**
+ * Queue a job, without waiting for it.
+ *
+ * @param job		function to run
+ * @param data		argument passed to job
+ */
+void threadPoolQueue(threadPool_t *this, threadPoolJob_t job, void *data);
+
+/**
+ * Run a job for each item of an array and wait until all are done.
+ *
+ * @param job		function to run
+ * @param data		array of items, passed to one job each
+ * @param count		number of items in data
+ */
+void threadPoolRun(threadPool_t *this, threadPoolJob_t job, void **data,
+				   int count);
+
+/**
+ * Destroy a threadPool_t, after running all queued jobs.
+ */
+void threadPoolDestroy(threadPool_t *this);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _CHELP_THREADPOOL_H */